@@ -0,0 +1,98 @@
+#include "DukasArchive.hpp"
+#include "DukasColumnStore.hpp"
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+
+// Compression ratio and decode throughput of the tick archive.
+// usage: ArchiveBench [tick_store_dir point]   (synthetic EURUSD-like ticks without arguments)
+
+static TickBatch synthetic_ticks(size_t n, double point) {
+    std::mt19937_64 rng(42);
+    std::geometric_distribution<int> gap(0.002);
+    std::uniform_int_distribution<int> step(-2, 2);
+    std::uniform_int_distribution<int> spread(1, 4);
+    std::uniform_int_distribution<int> lots(1, 12);
+    TickBatch t;
+    int64_t ts = 1672531200000LL;
+    int64_t bid = 107000;
+    for (size_t i = 0; i < n; ++i) {
+        ts += gap(rng);
+        bid += step(rng);
+        t.push_back(ts, (bid + spread(rng)) / point, bid / point, lots(rng) * 0.75f, lots(rng) * 0.75f);
+    }
+    return t;
+}
+
+int main(int argc, char** argv) {
+    double point = 100000;
+    TickBatch ticks;
+    if (argc > 2) {
+        point = std::stod(argv[2]);
+        ColumnStoreReader store(argv[1]);
+        TickView v = ticks_between(store, INT64_MIN, INT64_MAX);
+        for (size_t i = 0; i < v.count; ++i)
+            ticks.push_back(v.ts_ms[i], v.ask[i], v.bid[i], v.ask_vol[i], v.bid_vol[i]);
+    }
+    else
+        ticks = synthetic_ticks(20000000, point);
+
+    const std::string path = "archive_bench.dka";
+    std::filesystem::remove(path);
+    auto start = std::chrono::steady_clock::now();
+    {
+        TickArchiveWriter writer(path, point);
+        writer.append(ticks);
+    }
+    double encode_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t csv_bytes = 0;
+    char line[128];
+    for (size_t i = 0; i < ticks.size(); ++i)
+        csv_bytes += std::snprintf(line, sizeof(line), "2023-01-01 00:00:00.000,%g,%g,%g,%g\n",
+            ticks.ask[i], ticks.bid[i], ticks.ask_vol[i], ticks.bid_vol[i]);
+    size_t soa_bytes = ticks.size() * 28;
+    size_t archive_bytes = std::filesystem::file_size(path);
+
+    MappedFile image(path);
+    auto blocks = dka::scan_blocks(image.data(), image.size());
+    auto decode_with = [&](size_t threads) {
+        auto t0 = std::chrono::steady_clock::now();
+        std::vector<std::thread> pool;
+        std::vector<size_t> decoded(threads, 0);
+        for (size_t w = 0; w < threads; ++w) {
+            pool.emplace_back([&, w]() {
+                TickBatch out;
+                for (size_t b = w; b < blocks.size(); b += threads) {
+                    out.clear();
+                    dka::decode_block(image.data() + blocks[b], image.size() - blocks[b], point, out);
+                    decoded[w] += out.size();
+                }
+            });
+        }
+        for (auto& t : pool)
+            t.join();
+        double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        size_t total = 0;
+        for (size_t d : decoded)
+            total += d;
+        std::cout << "decode x" << threads << "      : " << total / s / 1e6 << " Mticks/s, "
+            << total * 28 / s / 1e9 << " GB/s decoded, " << archive_bytes / s / 1e9 << " GB/s compressed\n";
+    };
+
+    std::cout << std::fixed << std::setprecision(2)
+        << "ticks          : " << ticks.size() << " in " << blocks.size() << " blocks\n"
+        << "archive        : " << archive_bytes / double(ticks.size()) << " bytes/tick\n"
+        << "ratio vs CSV   : " << csv_bytes / double(archive_bytes) << "x\n"
+        << "ratio vs SoA   : " << soa_bytes / double(archive_bytes) << "x\n"
+        << "encode         : " << ticks.size() / encode_s / 1e6 << " Mticks/s\n";
+    decode_with(1);
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    if (hw > 1)
+        decode_with(hw);
+    std::filesystem::remove(path);
+    return 0;
+}
@@ -0,0 +1,206 @@
+#include "DukasBacktest.hpp"
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <memory>
+
+// Backtester replay rate of three small strategies over synthetic EURUSD ticks held
+// like a mapped tick store, one core each, then every parameter set of them at once
+// through backtest_all.
+//   SmaCross   market orders on a fast/slow SMA cross of the mid, sl/tp in points
+//   Breakout   buy and sell stops at the last n ticks' range, replaced every n ticks
+//   Fade       buy and sell limits k points away from the mid, the other one cancelled
+// usage: BacktestBench [ticks [threads]]   (10M ticks, one thread per core)
+
+static const double point = 100000;
+
+class SmaCross : public Strategy {
+public:
+    SmaCross(size_t fast, size_t slow) : fast(fast), slow(slow), ring(slow, 0.0) {}
+
+    void on_tick(const Tick& t, Backtester& bt) override {
+        double mid = (t.ask + t.bid) / 2;
+        size_t i = seen % slow;
+        sum_slow += mid - ring[i];
+        sum_fast += mid - ring[(seen + slow - fast) % slow];
+        ring[i] = mid;
+        if (++seen < slow)
+            return;
+        bool above = sum_fast / fast > sum_slow / slow;
+        if (seen > slow && above != was_above && bt.positions().empty()) {
+            OrderRequest o;
+            o.buy = above;
+            o.qty = 100000;
+            o.sl = above ? t.bid - 20 / point : t.ask + 20 / point;
+            o.tp = above ? t.bid + 30 / point : t.ask - 30 / point;
+            o.risk = 1;
+            bt.submit(o);
+        }
+        was_above = above;
+    }
+
+private:
+    size_t fast, slow;
+    std::vector<double> ring;
+    double sum_fast = 0, sum_slow = 0;
+    size_t seen = 0;
+    bool was_above = false;
+};
+
+class Breakout : public Strategy {
+public:
+    explicit Breakout(size_t n) : n(n) {}
+
+    void on_tick(const Tick& t, Backtester& bt) override {
+        hi = std::max(hi, t.ask);
+        lo = std::min(lo, t.bid);
+        if (++seen % n != 0)
+            return;
+        bt.cancel(buy);
+        bt.cancel(sell);
+        buy = sell = 0;
+        if (bt.positions().empty()) {
+            OrderRequest o;
+            o.type = OrderType::Stop;
+            o.qty = 100000;
+            o.risk = 0.5;
+            o.price = hi;
+            o.sl = hi - 15 / point;
+            o.tp = hi + 25 / point;
+            buy = bt.submit(o);
+            o.buy = false;
+            o.price = lo;
+            o.sl = lo + 15 / point;
+            o.tp = lo - 25 / point;
+            sell = bt.submit(o);
+        }
+        hi = 0;
+        lo = 1e300;
+    }
+
+private:
+    size_t n;
+    size_t seen = 0;
+    double hi = 0, lo = 1e300;
+    uint64_t buy = 0, sell = 0;
+};
+
+class Fade : public Strategy {
+public:
+    explicit Fade(double k) : k(k / point) {}
+
+    void on_tick(const Tick& t, Backtester& bt) override {
+        if (armed || !bt.positions().empty())
+            return;
+        double mid = (t.ask + t.bid) / 2;
+        OrderRequest o;
+        o.type = OrderType::Limit;
+        o.qty = 100000;
+        o.risk = 1;
+        o.price = mid - k;
+        o.sl = o.price - 2 * k;
+        o.tp = mid;
+        buy = bt.submit(o);
+        o.buy = false;
+        o.price = mid + k;
+        o.sl = o.price + 2 * k;
+        o.tp = mid;
+        sell = bt.submit(o);
+        armed = true;
+    }
+
+    void on_fill(const Fill& f, Backtester& bt) override {
+        if (f.reason == Fill::Reason::Entry)
+            bt.cancel(f.position == buy ? sell : buy);
+        else
+            armed = false;
+    }
+
+private:
+    double k;
+    bool armed = false;
+    uint64_t buy = 0, sell = 0;
+};
+
+static std::vector<std::unique_ptr<Strategy>> make_strategies(std::vector<std::string>& names) {
+    std::vector<std::unique_ptr<Strategy>> out;
+    names.clear();
+    for (size_t fast : { 20, 50 }) {
+        for (size_t slow : { 200, 1000 }) {
+            out.emplace_back(new SmaCross(fast, slow));
+            names.push_back("sma " + std::to_string(fast) + "/" + std::to_string(slow));
+        }
+    }
+    for (size_t n : { 500, 2000 }) {
+        out.emplace_back(new Breakout(n));
+        names.push_back("breakout " + std::to_string(n));
+    }
+    for (int k : { 3, 8 }) {
+        out.emplace_back(new Fade(k));
+        names.push_back("fade " + std::to_string(k));
+    }
+    return out;
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? std::stoull(argv[1]) : 10000000;
+    size_t threads = argc > 2 ? std::stoul(argv[2]) : 0;
+    std::vector<int64_t> ts(n);
+    std::vector<double> ask(n), bid(n);
+    std::vector<float> vol(n, 1.0f);
+    std::mt19937_64 rng(3);
+    std::geometric_distribution<int> gap(0.002);
+    std::uniform_int_distribution<int> step(-1, 1), spread(1, 3);
+    int64_t t = 1704067200000LL, b = 107000;
+    for (size_t i = 0; i < n; ++i) {
+        t += gap(rng);
+        b += step(rng);
+        ts[i] = t;
+        bid[i] = b / point;
+        ask[i] = (b + spread(rng)) / point;
+    }
+    TickView view;
+    view.ts_ms = ts.data();
+    view.ask = ask.data();
+    view.bid = bid.data();
+    view.ask_vol = view.bid_vol = vol.data();
+    view.count = n;
+
+    Backtester::Config config;
+    config.latency_ms = 50;
+    config.slippage = 0.2 / point;
+    config.commission = 0.000035;
+    std::cout << n / 1e6 << "M ticks, latency " << config.latency_ms << " ms, slippage 0.2 points\n" << std::fixed;
+
+    // one core each
+    std::vector<std::string> names;
+    auto strategies = make_strategies(names);
+    for (size_t i = 0; i < strategies.size(); ++i) {
+        Backtester bt(*strategies[i], config);
+        auto t0 = std::chrono::steady_clock::now();
+        bt.run(view);
+        double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        const auto& r = bt.report();
+        std::cout << std::left << std::setw(14) << names[i] << std::right << std::setprecision(1) << std::setw(7) << n / sec / 1e6
+            << " Mticks/s " << std::setw(7) << r.trades.size() << " trades, ret " << r.total_ret << "%, ret mdd " << r.ret_mdd
+            << "%, equity mdd " << std::setprecision(0) << r.max_drawdown << "\n";
+    }
+
+    // all of them at once, on fresh instances
+    size_t cores = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+    for (size_t k : { size_t(1), cores }) {
+        strategies = make_strategies(names);
+        std::vector<Strategy*> all;
+        for (auto& s : strategies)
+            all.push_back(s.get());
+        auto t0 = std::chrono::steady_clock::now();
+        backtest_all(view, all, config, k);
+        double sec = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        std::cout << "backtest_all, " << all.size() << " strategies, " << k << " threads: " << std::setprecision(1)
+            << all.size() * n / sec / 1e6 << " Mticks/s\n";
+        if (k == cores)
+            break;
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include "DukasCsv.hpp"
+#include <filesystem>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+// Rows/s of the CSV emitter against the iostream path it replaces (ofstream, operator<<
+// on doubles, strftime/put_time timestamps).
+// usage: CsvBench [ticks point]   (20M synthetic EURUSD-like ticks by default)
+
+static TickBatch synthetic_ticks(size_t n, double point) {
+    std::mt19937_64 rng(42);
+    std::geometric_distribution<int> gap(0.002);
+    std::uniform_int_distribution<int> step(-2, 2);
+    std::uniform_int_distribution<int> spread(1, 4);
+    std::uniform_int_distribution<int> lots(1, 12);
+    TickBatch t;
+    int64_t ts = 1672531200000LL;
+    int64_t bid = 107000;
+    for (size_t i = 0; i < n; ++i) {
+        ts += gap(rng);
+        bid += step(rng);
+        t.push_back(ts, (bid + spread(rng)) / point, bid / point, lots(rng) * 0.75f, lots(rng) * 0.75f);
+    }
+    return t;
+}
+
+// the previous write_tick: per-second strftime cache, doubles through operator<<
+static void iostream_ticks(const TickBatch& ticks, const std::string& path) {
+    std::ofstream csv(path, std::ios::trunc);
+    int64_t cached_second = INT64_MIN;
+    char prefix[20] = {};
+    char ts[24];
+    for (size_t i = 0; i < ticks.size(); ++i) {
+        int64_t sec = ticks.ts_ms[i] / 1000;
+        if (sec != cached_second) {
+            std::tm tm;
+            time_t t = static_cast<time_t>(sec);
+#ifdef _WIN32
+            gmtime_s(&tm, &t);
+#else
+            gmtime_r(&t, &tm);
+#endif
+            std::strftime(prefix, sizeof(prefix), "%Y-%m-%d %H:%M:%S", &tm);
+            cached_second = sec;
+        }
+        unsigned ms = static_cast<unsigned>(ticks.ts_ms[i] - sec * 1000);
+        std::memcpy(ts, prefix, 19);
+        std::snprintf(ts + 19, 5, ".%03u", ms);
+        csv << ts << "," << ticks.ask[i] << "," << ticks.bid[i] << ","
+            << ticks.ask_vol[i] << "," << ticks.bid_vol[i] << "\n";
+    }
+}
+
+// the previous write_bar_csv: gmtime + put_time per row
+static void iostream_bars(const std::vector<Bar>& bars, const std::string& path) {
+    std::ofstream csv(path, std::ios::trunc);
+    for (const Bar& bar : bars) {
+        std::tm tm;
+        time_t t = static_cast<time_t>(bar.start_ms / 1000);
+#ifdef _WIN32
+        gmtime_s(&tm, &t);
+#else
+        gmtime_r(&t, &tm);
+#endif
+        csv << std::put_time(&tm, "%Y-%m-%d %H:%M:%S") << ","
+            << bar.open_ask << "," << bar.high_ask << "," << bar.low_ask << "," << bar.close_ask << ","
+            << bar.open_bid << "," << bar.high_bid << "," << bar.low_bid << "," << bar.close_bid << ","
+            << bar.total_ask_volume << "," << bar.total_bid_volume << "\n";
+    }
+}
+
+static void emitter_ticks(const TickBatch& ticks, const std::string& path, double point) {
+    std::filesystem::remove(path);
+    CsvFile csv;
+    csv.open(path);
+    CsvEmitter emitter(point);
+    for (size_t i = 0; i < ticks.size(); ++i)
+        emitter.tick(csv, ticks.ts_ms[i], ticks.ask[i], ticks.bid[i], ticks.ask_vol[i], ticks.bid_vol[i]);
+}
+
+static void emitter_bars(const std::vector<Bar>& bars, const std::string& path, double point) {
+    std::filesystem::remove(path);
+    CsvFile csv;
+    csv.open(path);
+    CsvEmitter emitter(point);
+    for (const Bar& bar : bars)
+        emitter.bar(csv, bar);
+}
+
+template <typename F>
+static void measure(const char* label, size_t rows, const std::string& path, F run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double bytes = static_cast<double>(std::filesystem::file_size(path));
+    std::cout << label << ": " << rows / s / 1e6 << " Mrows/s, " << bytes / s / 1e6 << " MB/s ("
+        << bytes / rows << " bytes/row)\n";
+    std::filesystem::remove(path);
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? std::stoull(argv[1]) : 20000000;
+    double point = argc > 2 ? std::stod(argv[2]) : 100000;
+    TickBatch ticks = synthetic_ticks(n, point);
+
+    std::vector<Bar> bars;
+    TimeframeAggregator seconds({ "1s" });
+    seconds.add(ticks, [&](size_t, const Bar& bar) { bars.push_back(bar); });
+    seconds.flush([&](size_t, const Bar& bar) { bars.push_back(bar); });
+
+    const std::string path = "csv_bench.csv";
+    std::cout << std::fixed << std::setprecision(2);
+    measure("ticks iostream", ticks.size(), path, [&]() { iostream_ticks(ticks, path); });
+    measure("ticks emitter ", ticks.size(), path, [&]() { emitter_ticks(ticks, path, point); });
+    measure("1s bars iostream", bars.size(), path, [&]() { iostream_bars(bars, path); });
+    measure("1s bars emitter ", bars.size(), path, [&]() { emitter_bars(bars, path, point); });
+    return 0;
+}
@@ -0,0 +1,97 @@
+#include "Dukasloader.hpp"
+#include "DukasReplay.hpp"
+#include <filesystem>
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+
+// End-to-end throughput of DukascopyDownloader against a local ReplayServer, so runs
+// are offline and reproducible: files/s, ticks/s, MB/s and CPU time per stage for a
+// few network profiles and fetch concurrencies. Ticks go to CSV in a scratch directory.
+// usage: DownloaderBench [days [recorded_dir]]   (synthetic EURUSD hours by default)
+
+struct Scenario {
+    const char* name;
+    ReplayServer::Config server;
+    double budget_rps;                  // 0: no RequestBudget
+};
+
+int main(int argc, char** argv) {
+    int days = argc > 1 ? std::stoi(argv[1]) : 7;
+    std::string recorded = argc > 2 ? argv[2] : "";
+    const std::string asset = "EURUSD";
+    const std::string start = "2024-01-01";
+    std::tm tm = {};
+    std::istringstream(start) >> std::get_time(&tm, "%Y-%m-%d");
+    auto first = std::chrono::system_clock::from_time_t(portable_timegm(&tm));
+    auto last = first + std::chrono::hours(24 * days - 1);
+    time_t end_t = std::chrono::system_clock::to_time_t(first + std::chrono::hours(24 * days));
+    std::tm end_tm = {};
+    portable_gmtime(&end_tm, &end_t);
+    std::ostringstream end;
+    end << std::put_time(&end_tm, "%Y-%m-%d");
+
+    ReplayServer::Config base;
+    base.source_dir = recorded;
+    std::vector<Scenario> scenarios;
+    scenarios.push_back({ "local", base, 0 });
+    Scenario latency{ "50ms latency", base, 0 };
+    latency.server.latency = std::chrono::milliseconds(50);
+    scenarios.push_back(latency);
+    Scenario slow{ "1MB/s per conn", base, 0 };
+    slow.server.bytes_per_second = 1e6;
+    scenarios.push_back(slow);
+    Scenario gaps{ "20% 404", base, 0 };
+    gaps.server.missing_rate = 0.2;
+    scenarios.push_back(gaps);
+    Scenario throttled{ "429 over 50 req/s", base, 200 };
+    throttled.server.max_requests_per_second = 50;
+    scenarios.push_back(throttled);
+
+    auto scratch = std::filesystem::temp_directory_path() / "dukas_downloader_bench";
+    std::cout << std::fixed << std::setprecision(1)
+        << std::left << std::setw(20) << "scenario" << std::right << std::setw(5) << "conc"
+        << std::setw(9) << "wall s" << std::setw(9) << "files/s" << std::setw(10) << "Mticks/s" << std::setw(8) << "MB/s"
+        << std::setw(10) << "fetch ms" << std::setw(9) << "lzma ms" << std::setw(9) << "parse ms" << std::setw(9) << "sink ms"
+        << std::setw(6) << "404" << std::setw(6) << "429" << "\n";
+
+    for (const auto& scenario : scenarios) {
+        for (size_t concurrency : { 1, 4, 16 }) {
+            ReplayServer server(scenario.server);
+            if (recorded.empty())
+                server.prepare(asset, first, last);
+            std::filesystem::remove_all(scratch);
+            std::filesystem::create_directories(scratch);
+            std::unique_ptr<RequestBudget> budget;
+            if (scenario.budget_rps > 0)
+                budget = std::make_unique<RequestBudget>(scenario.budget_rps);
+
+            DownloadChoices choices;
+            choices.existing = 'r';
+            choices.overwrite = 'y';
+            std::ostringstream quiet;
+            auto* saved = std::cout.rdbuf(quiet.rdbuf());
+            auto t0 = std::chrono::steady_clock::now();
+            DukascopyDownloader downloader(asset, start, end.str(), scratch.string(), "", "", 0, &choices);
+            downloader.set_datafeed_url(server.url());
+            downloader.set_hours(first, last);
+            downloader.set_journal_path("");
+            downloader.set_fetch_concurrency(concurrency);
+            downloader.set_request_budget(budget.get());
+            downloader.download();
+            double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            std::cout.rdbuf(saved);
+
+            const auto& s = downloader.stats();
+            const auto& c = server.counters();
+            std::cout << std::left << std::setw(20) << scenario.name << std::right << std::setw(5) << concurrency
+                << std::setw(9) << wall << std::setw(9) << s.files / wall << std::setw(10) << s.ticks / wall / 1e6
+                << std::setw(8) << s.bytes / wall / 1e6
+                << std::setw(10) << s.fetch_cpu_ns / 1e6 << std::setw(9) << s.lzma_cpu_ns / 1e6
+                << std::setw(9) << s.parse_cpu_ns / 1e6 << std::setw(9) << s.sink_cpu_ns / 1e6
+                << std::setw(6) << c.not_found.load() << std::setw(6) << c.throttled.load() << "\n";
+        }
+    }
+    std::filesystem::remove_all(scratch);
+    return 0;
+}
@@ -0,0 +1,348 @@
+#ifndef DUKASARCHIVE_HPP
+#define DUKASARCHIVE_HPP
+
+#include <system_error>
+#include <filesystem>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "DukasDecoder.hpp"
+
+// Compressed tick archive. The file is a header followed by independent blocks:
+//
+//   header : "DUKARCH1" | f64 point
+//   block  : u32 magic 'DKB1' | u32 ticks | u32 payload bytes | payload
+//
+// Payload columns (all LEB128 varints, signed values zigzagged):
+//   ts_ms      first value, then delta-of-delta
+//   ask, bid   integer points (price * point), first value then deltas
+//   volumes    f32 bits XOR previous; 0 -> one byte, else trailing-zero count + shifted value
+//
+// Each block starts from absolute values, so blocks decode in parallel.
+namespace dka {
+
+constexpr char file_magic[8] = { 'D', 'U', 'K', 'A', 'R', 'C', 'H', '1' };
+constexpr uint32_t block_magic = 0x31424b44; // "DKB1"
+constexpr size_t file_header_size = 16;
+constexpr size_t block_header_size = 12;
+constexpr size_t min_tick_bytes = 5;   // ts, ask, bid varints and two volume tags
+
+inline uint64_t zigzag(int64_t v) { return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); }
+inline int64_t unzigzag(uint64_t v) { return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1); }
+
+inline void put_varint(std::vector<uint8_t>& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(static_cast<uint8_t>(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(v));
+}
+
+inline uint64_t get_varint(const uint8_t*& p, const uint8_t* end) {
+    uint64_t v = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        uint8_t b = *p++;
+        v |= static_cast<uint64_t>(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return v;
+    }
+    throw std::runtime_error("Truncated varint in tick archive block");
+}
+
+inline void put_u32(std::vector<uint8_t>& out, uint32_t v) {
+    uint8_t b[4];
+    std::memcpy(b, &v, 4);
+    out.insert(out.end(), b, b + 4);
+}
+
+inline uint32_t get_u32(const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+inline void put_volume(std::vector<uint8_t>& out, uint32_t bits, uint32_t& prev) {
+    uint32_t x = bits ^ prev;
+    prev = bits;
+    if (x == 0) {
+        out.push_back(0);
+        return;
+    }
+    int tz = 0;
+    while (!(x & 1)) {
+        x >>= 1;
+        ++tz;
+    }
+    out.push_back(static_cast<uint8_t>(tz + 1));
+    put_varint(out, x);
+}
+
+inline uint32_t get_volume(const uint8_t*& p, const uint8_t* end, uint32_t& prev) {
+    if (p >= end)
+        throw std::runtime_error("Truncated volume in tick archive block");
+    uint8_t tag = *p++;
+    if (tag != 0)
+        prev ^= static_cast<uint32_t>(get_varint(p, end)) << (tag - 1);
+    return prev;
+}
+
+// Encodes ticks [begin, end) of a batch as one complete block (header included).
+inline void encode_block(const TickBatch& ticks, size_t begin, size_t end, double point, std::vector<uint8_t>& out) {
+    size_t header_at = out.size();
+    put_u32(out, block_magic);
+    put_u32(out, static_cast<uint32_t>(end - begin));
+    put_u32(out, 0);
+    size_t payload_at = out.size();
+
+    int64_t prev_ts = 0, prev_delta = 0, prev_ask = 0, prev_bid = 0;
+    uint32_t prev_av = 0, prev_bv = 0;
+    for (size_t i = begin; i < end; ++i) {
+        int64_t ts = ticks.ts_ms[i];
+        int64_t delta = ts - prev_ts;
+        put_varint(out, zigzag(i == begin ? ts : delta - prev_delta));
+        prev_delta = i == begin ? 0 : delta;
+        prev_ts = ts;
+
+        int64_t ask = std::llround(ticks.ask[i] * point);
+        int64_t bid = std::llround(ticks.bid[i] * point);
+        put_varint(out, zigzag(ask - prev_ask));
+        put_varint(out, zigzag(bid - prev_bid));
+        prev_ask = ask;
+        prev_bid = bid;
+
+        uint32_t av, bv;
+        std::memcpy(&av, &ticks.ask_vol[i], 4);
+        std::memcpy(&bv, &ticks.bid_vol[i], 4);
+        put_volume(out, av, prev_av);
+        put_volume(out, bv, prev_bv);
+    }
+    uint32_t payload = static_cast<uint32_t>(out.size() - payload_at);
+    std::memcpy(out.data() + header_at + 8, &payload, 4);
+}
+
+// Decodes one block (starting at its header) and appends the ticks to out.
+// Returns the block's total size in bytes.
+inline size_t decode_block(const uint8_t* block, size_t available, double point, TickBatch& out) {
+    if (available < block_header_size || get_u32(block) != block_magic)
+        throw std::runtime_error("Bad tick archive block header");
+    uint32_t count = get_u32(block + 4);
+    uint32_t payload = get_u32(block + 8);
+    if (available < block_header_size + payload)
+        throw std::runtime_error("Truncated tick archive block");
+    // every tick takes a byte at least for each of its 5 fields: a corrupt count is
+    // caught before it sizes the batch
+    if (uint64_t(count) * min_tick_bytes > payload)
+        throw std::runtime_error("Bad tick count in tick archive block");
+    const uint8_t* p = block + block_header_size;
+    const uint8_t* end = p + payload;
+
+    size_t base = out.size();
+    out.resize(base + count);
+    int64_t prev_ts = 0, prev_delta = 0, prev_ask = 0, prev_bid = 0;
+    uint32_t prev_av = 0, prev_bv = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        int64_t v = unzigzag(get_varint(p, end));
+        int64_t ts = i == 0 ? v : prev_ts + prev_delta + v;
+        prev_delta = i == 0 ? 0 : ts - prev_ts;
+        prev_ts = ts;
+        prev_ask += unzigzag(get_varint(p, end));
+        prev_bid += unzigzag(get_varint(p, end));
+        uint32_t av = get_volume(p, end, prev_av);
+        uint32_t bv = get_volume(p, end, prev_bv);
+
+        out.ts_ms[base + i] = ts;
+        out.ask[base + i] = static_cast<double>(prev_ask) / point;
+        out.bid[base + i] = static_cast<double>(prev_bid) / point;
+        std::memcpy(&out.ask_vol[base + i], &av, 4);
+        std::memcpy(&out.bid_vol[base + i], &bv, 4);
+    }
+    return block_header_size + payload;
+}
+
+// Offsets of every complete block in an archive image (header excluded); a torn
+// tail block left by a crash is not listed.
+inline std::vector<size_t> scan_blocks(const uint8_t* data, size_t size) {
+    std::vector<size_t> offsets;
+    size_t pos = file_header_size;
+    while (pos + block_header_size <= size && get_u32(data + pos) == block_magic) {
+        size_t total = block_header_size + get_u32(data + pos + 8);
+        if (pos + total > size)
+            break;
+        offsets.push_back(pos);
+        pos += total;
+    }
+    return offsets;
+}
+
+inline double header_point(const uint8_t* data, size_t size) {
+    if (size < file_header_size || std::memcmp(data, file_magic, 8) != 0)
+        throw std::runtime_error("Not a tick archive");
+    double point;
+    std::memcpy(&point, data + 8, 8);
+    return point;
+}
+
+} // namespace dka
+
+// Encoder sink: buffers ticks and writes a block every block_ticks ticks or on flush().
+// Opening an existing archive appends to it after dropping a torn tail block; ticks
+// up to the last one already on disk are skipped, so a resumed hour is not stored
+// twice, while ticks sharing a millisecond within a run are all kept. Rewriting an
+// earlier range needs a fresh archive (the downloader removes it on Restart).
+class TickArchiveWriter {
+public:
+    TickArchiveWriter(const std::string& path, double point, size_t block_ticks = 8192)
+        : point(point), block_ticks(block_ticks)
+    {
+        std::error_code ec;
+        auto parent = std::filesystem::path(path).parent_path();
+        if (!parent.empty())
+            std::filesystem::create_directories(parent, ec);
+        size_t keep = 0;
+        if (std::filesystem::exists(path) && std::filesystem::file_size(path) >= dka::file_header_size)
+            keep = resume_from(path);
+        if (keep > 0)
+            std::filesystem::resize_file(path, keep);
+        out.open(path, std::ios::binary | (keep > 0 ? std::ios::app : std::ios::trunc));
+        if (!out.is_open())
+            throw std::runtime_error("Cannot open tick archive " + path);
+        if (keep == 0) {
+            out.write(dka::file_magic, 8);
+            out.write(reinterpret_cast<const char*>(&point), 8);
+        }
+    }
+
+    ~TickArchiveWriter() {
+        try {
+            flush();
+        }
+        catch (...) {
+        }
+    }
+
+    void append(const TickBatch& ticks) {
+        for (size_t i = 0; i < ticks.size(); ++i) {
+            if (resuming) {
+                int64_t ts = ticks.ts_ms[i];
+                if (ts < tail_ts || (ts == tail_ts && tail_dups > 0)) {
+                    tail_dups -= ts == tail_ts;
+                    continue;
+                }
+                resuming = false;
+            }
+            pending.push_back(ticks.ts_ms[i], ticks.ask[i], ticks.bid[i], ticks.ask_vol[i], ticks.bid_vol[i]);
+            if (pending.size() >= block_ticks)
+                write_block();
+        }
+    }
+
+    // Closes the current (possibly short) block so everything appended is durable.
+    void flush() {
+        write_block();
+        out.flush();
+    }
+
+    uint64_t bytes_written() const { return written; }
+
+private:
+    // Walks the block headers of an existing archive with seeks and decodes only the
+    // last complete block, for the tail to resume after. Returns the bytes to keep.
+    size_t resume_from(const std::string& path) {
+        std::ifstream in(path, std::ios::binary);
+        uint8_t header[dka::file_header_size];
+        if (!in.read(reinterpret_cast<char*>(header), dka::file_header_size))
+            throw std::runtime_error("Cannot read tick archive " + path);
+        if (dka::header_point(header, dka::file_header_size) != point)
+            throw std::runtime_error("Tick archive " + path + " was written with another point size");
+        const uint64_t size = std::filesystem::file_size(path);
+        uint64_t pos = dka::file_header_size, last = 0;
+        uint8_t block_header[dka::block_header_size];
+        while (pos + dka::block_header_size <= size && in.seekg(static_cast<std::streamoff>(pos))
+               && in.read(reinterpret_cast<char*>(block_header), dka::block_header_size)
+               && dka::get_u32(block_header) == dka::block_magic) {
+            uint64_t total = dka::block_header_size + dka::get_u32(block_header + 8);
+            if (pos + total > size)
+                break;
+            last = pos;
+            pos += total;
+        }
+        if (pos == dka::file_header_size)
+            return pos;
+        std::vector<uint8_t> block(static_cast<size_t>(pos - last));
+        in.clear();
+        in.seekg(static_cast<std::streamoff>(last));
+        if (!in.read(reinterpret_cast<char*>(block.data()), static_cast<std::streamsize>(block.size())))
+            throw std::runtime_error("Cannot read tick archive " + path);
+        TickBatch tail;
+        dka::decode_block(block.data(), block.size(), point, tail);
+        if (tail.size() > 0) {
+            tail_ts = tail.ts_ms.back();
+            for (size_t i = tail.size(); i > 0 && tail.ts_ms[i - 1] == tail_ts; --i)
+                ++tail_dups;
+            resuming = true;
+        }
+        return static_cast<size_t>(pos);
+    }
+
+    void write_block() {
+        if (pending.empty())
+            return;
+        buffer.clear();
+        dka::encode_block(pending, 0, pending.size(), point, buffer);
+        out.write(reinterpret_cast<const char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        written += buffer.size();
+        pending.clear();
+    }
+
+    double point;
+    size_t block_ticks;
+    std::ofstream out;
+    TickBatch pending;
+    std::vector<uint8_t> buffer;
+    int64_t tail_ts = 0;            // last tick on disk when reopened
+    size_t tail_dups = 0;           // ticks at tail_ts in the last block
+    bool resuming = false;          // until a tick past the tail arrives
+    uint64_t written = 0;
+};
+
+// Streaming decoder: reads one block at a time from a file.
+class TickArchiveReader {
+public:
+    explicit TickArchiveReader(const std::string& path) : in(path, std::ios::binary) {
+        if (!in.is_open())
+            throw std::runtime_error("Cannot open tick archive " + path);
+        uint8_t header[dka::file_header_size];
+        if (!in.read(reinterpret_cast<char*>(header), dka::file_header_size))
+            throw std::runtime_error("Not a tick archive: " + path);
+        archive_point = dka::header_point(header, dka::file_header_size);
+    }
+
+    double point() const { return archive_point; }
+
+    // Replaces out with the next block's ticks; false at the end (or at a torn tail).
+    bool next(TickBatch& out) {
+        uint8_t header[dka::block_header_size];
+        if (!in.read(reinterpret_cast<char*>(header), dka::block_header_size))
+            return false;
+        uint32_t payload = dka::get_u32(header + 8);
+        block.resize(dka::block_header_size + payload);
+        std::memcpy(block.data(), header, dka::block_header_size);
+        if (!in.read(reinterpret_cast<char*>(block.data() + dka::block_header_size), payload))
+            return false;
+        out.clear();
+        dka::decode_block(block.data(), block.size(), archive_point, out);
+        return true;
+    }
+
+private:
+    std::ifstream in;
+    std::vector<uint8_t> block;
+    double archive_point = 1.0;
+};
+
+#endif // DUKASARCHIVE_HPP
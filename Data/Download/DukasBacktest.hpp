@@ -0,0 +1,461 @@
+#ifndef DUKASBACKTEST_HPP
+#define DUKASBACKTEST_HPP
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <limits>
+#include <cmath>
+
+#include "DukasSink.hpp"
+#include "DukasColumnStore.hpp"
+#include "DukasPipeline.hpp"
+
+class Backtester;
+
+struct Tick {
+    int64_t ts_ms = 0;
+    double ask = 0;
+    double bid = 0;
+    float ask_vol = 0;
+    float bid_vol = 0;
+};
+
+enum class OrderType { Market, Limit, Stop };
+
+// An entry order. Buys fill on the ask and sells on the bid; the position it opens is
+// closed by its stop loss or take profit on the other side, or by Backtester::close.
+struct OrderRequest {
+    OrderType type = OrderType::Market;
+    bool buy = true;
+    double qty = 1;                 // units of the base currency
+    double price = 0;               // limit or stop level
+    double sl = 0;                  // stop loss of the position (0: none)
+    double tp = 0;                  // take profit of the position (0: none)
+    double risk = 0;                // % of the account risked down to sl; ret = R multiple * risk
+};
+
+struct Position {
+    uint64_t id = 0;                // id of the order that opened it
+    bool buy = true;
+    double qty = 0;
+    int64_t entry_ms = 0;
+    double entry = 0;
+    double sl = 0;
+    double tp = 0;
+    double risk = 0;
+    double initial_sl = 0;          // one unit of risk is entry - initial_sl (long)
+};
+
+struct Fill {
+    enum class Reason { Entry, TakeProfit, StopLoss, Close, End };
+    uint64_t position = 0;
+    Reason reason = Reason::Entry;
+    bool buy = true;                // side of this fill (an exit is the opposite side)
+    int64_t ts_ms = 0;
+    double price = 0;
+    double qty = 0;
+};
+
+struct ClosedTrade {
+    uint64_t id = 0;
+    bool buy = true;
+    double qty = 0;
+    int64_t entry_ms = 0;
+    int64_t exit_ms = 0;
+    double entry = 0;
+    double exit = 0;
+    double pnl = 0;                 // account currency, after commission
+    double ret = 0;                 // % of the account: R multiple * risk (0 without sl, risk or room to sl)
+    Fill::Reason reason = Fill::Reason::Close;
+};
+
+struct BacktestReport {
+    std::vector<ClosedTrade> trades;
+    uint64_t ticks = 0;
+    double balance = 0;
+    double equity = 0;
+    double max_drawdown = 0;        // of the equity marked at every tick (<= 0)
+    double max_drawdown_pct = 0;    // the same as % of the equity peak
+    double total_ret = 0;           // sum of ret
+    double ret_mdd = 0;             // deepest fall of the cumulative ret, closed trades (<= 0)
+    size_t wins = 0;
+};
+
+inline const char* fill_reason_name(Fill::Reason r) {
+    switch (r) {
+    case Fill::Reason::Entry: return "entry";
+    case Fill::Reason::TakeProfit: return "tp";
+    case Fill::Reason::StopLoss: return "sl";
+    case Fill::Reason::Close: return "close";
+    case Fill::Reason::End: return "end";
+    }
+    return "";
+}
+
+// Trading logic run by a Backtester, which calls it in time order:
+//
+//   on_start   before the first tick
+//   on_tick    every tick, after the orders and exits it triggered are filled
+//   on_bar     bars of Config::timeframes, built from the ticks: a bar is passed on the
+//              first tick past its end, before that tick's on_tick, so orders sent on
+//              it are timed like orders sent on that tick. Without timeframes, the bars
+//              of the data source as it delivers them: the downloader's come at the
+//              end of each hour, after all of that hour's ticks.
+//   on_fill    fills of the tick, before its on_tick
+//   on_finish  after the open positions were closed at the last quote
+class Strategy {
+public:
+    virtual ~Strategy() = default;
+    virtual void on_start(Backtester& bt) { (void)bt; }
+    virtual void on_tick(const Tick& tick, Backtester& bt) { (void)tick; (void)bt; }
+    virtual void on_bar(size_t series, const std::string& name, const Bar& bar, Backtester& bt) {
+        (void)series; (void)name; (void)bar; (void)bt;
+    }
+    virtual void on_fill(const Fill& fill, Backtester& bt) { (void)fill; (void)bt; }
+    virtual void on_finish(Backtester& bt) { (void)bt; }
+};
+
+// Event-driven simulation of one strategy over ticks, fed either as a DataSink of
+// the downloader (add_sink: decoded batches and bars as they are produced) or from
+// a tick store with run(ticks_between(...)).
+//
+// Orders and closes sent at time t reach the market latency_ms later, at the first
+// later tick from t + latency_ms on; a tick never fills what was sent on it.
+//   market    buy at ask + slippage, sell at bid - slippage
+//   limit     buy once ask <= price at min(ask, price), sell once bid >= price at max
+//   stop      buy once ask >= price at max(ask, price) + slippage, sell mirrored
+// Exits of a long are on the bid (stop loss as a sell stop, take profit as a sell
+// limit), of a short on the ask; when a tick reaches both, the stop loss fills.
+// Positions are not netted. Commission is per unit and side, charged at the close.
+// Equity is marked to market on every tick in O(1) from the net long and short
+// quantities and costs, whatever the number of open positions.
+class Backtester : public DataSink {
+public:
+    struct Config {
+        int64_t latency_ms = 0;
+        double slippage = 0;            // price units against market and stop fills
+        double commission = 0;          // per unit and side, account currency
+        double balance = 100000;
+        std::vector<std::string> timeframes;    // bars for on_bar, built from the ticks (empty: the source's)
+    };
+
+    Backtester(Strategy& strategy, const Config& config) : strategy(strategy), config(config) {
+        result.balance = result.equity = peak_equity = config.balance;
+        // one aggregator per timeframe: cascaded ones would close a coarse bar only when
+        // the next finer bar closes
+        for (size_t k = 0; k < config.timeframes.size(); ++k) {
+            bars.emplace_back(std::vector<std::string>{ config.timeframes[k] });
+            bar_emits.push_back([this, k](size_t, const Bar& bar) { closed_bars.emplace_back(k, bar); });
+        }
+    }
+
+    Backtester(const Backtester&) = delete;
+    Backtester& operator=(const Backtester&) = delete;
+
+    // --- strategy side ---
+
+    // Returns the order id, which becomes the position id once filled.
+    uint64_t submit(const OrderRequest& order) {
+        if (!(order.qty > 0) || (order.type != OrderType::Market && !(order.price > 0)))
+            throw std::invalid_argument("Invalid order: quantity and level must be positive");
+        Request r;
+        r.id = ++last_id;
+        r.order = order;
+        r.due_ms = now_ms + config.latency_ms;
+        pending.push_back(r);
+        return r.id;
+    }
+
+    // Cancels an order not filled yet.
+    bool cancel(uint64_t order) {
+        for (auto& r : pending) {
+            if (r.id == order && !r.close) {
+                r.cancelled = true;
+                return true;
+            }
+        }
+        for (auto& w : working) {
+            if (w.id == order && !w.cancelled) {
+                w.cancelled = true;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Closes an open position at market, after the latency.
+    bool close(uint64_t position) {
+        if (!find(position))
+            return false;
+        Request r;
+        r.id = position;
+        r.close = true;
+        r.due_ms = now_ms + config.latency_ms;
+        pending.push_back(r);
+        return true;
+    }
+
+    // New stop loss and take profit of an open position (0: none), active at once.
+    bool modify(uint64_t position, double sl, double tp) {
+        Position* p = find(position);
+        if (!p)
+            return false;
+        p->sl = sl;
+        p->tp = tp;
+        return true;
+    }
+
+    const std::vector<Position>& positions() const { return open; }
+    const BacktestReport& report() const { return result; }
+    int64_t now() const { return now_ms; }
+    const Tick& last_tick() const { return tick; }
+
+    // --- data side ---
+
+    void run(const TickView& ticks) {
+        for (size_t i = 0; i < ticks.count; ++i)
+            step({ ticks.ts_ms[i], ticks.ask[i], ticks.bid[i], ticks.ask_vol[i], ticks.bid_vol[i] });
+        finish();
+    }
+
+    void on_ticks(const TickBatch& ticks) override {
+        for (size_t i = 0; i < ticks.size(); ++i)
+            step({ ticks.ts_ms[i], ticks.ask[i], ticks.bid[i], ticks.ask_vol[i], ticks.bid_vol[i] });
+    }
+
+    // Ignored when the bars are built from the ticks (Config::timeframes).
+    void on_bars(size_t series, const std::string& name, const Bar* source_bars, size_t count) override {
+        if (!config.timeframes.empty())
+            return;
+        for (size_t i = 0; i < count; ++i)
+            strategy.on_bar(series, name, source_bars[i], *this);
+    }
+
+    void on_finish() override { finish(); }
+
+    // One tick: due orders, triggered orders, exits, equity, then the strategy (fills,
+    // bars the tick closed, the tick).
+    void step(const Tick& t) {
+        if (!started) {
+            started = true;
+            strategy.on_start(*this);
+        }
+        tick = t;
+        now_ms = t.ts_ms;
+        ++result.ticks;
+        // orders sent during the previous tick's callbacks are at the back, so a
+        // request is only due from the tick after the one it was sent on
+        for (size_t n = pending.size(); n > 0 && pending.front().due_ms <= t.ts_ms; --n) {
+            Request r = pending.front();
+            pending.pop_front();
+            if (r.cancelled)
+                continue;
+            if (r.close) {
+                if (Position* p = find(r.id)) {
+                    double px = p->buy ? t.bid - config.slippage : t.ask + config.slippage;
+                    exit(static_cast<size_t>(p - open.data()), px, Fill::Reason::Close);
+                }
+            }
+            else if (r.order.type == OrderType::Market)
+                enter(r.id, r.order, r.order.buy ? t.ask + config.slippage : t.bid - config.slippage);
+            else
+                working.push_back({ r.id, r.order, false });
+        }
+        if (!working.empty()) {
+            size_t w = 0;
+            for (size_t i = 0; i < working.size(); ++i) {
+                const Working& o = working[i];
+                if (o.cancelled)
+                    continue;
+                double px;
+                if (triggered(o.order, px))
+                    enter(o.id, o.order, px);
+                else
+                    working[w++] = o;
+            }
+            working.resize(w);
+        }
+        for (size_t i = 0; i < open.size();) {
+            const Position& p = open[i];
+            double bid = t.bid, ask = t.ask;
+            if (p.buy && p.sl > 0 && bid <= p.sl)
+                exit(i, std::min(bid, p.sl) - config.slippage, Fill::Reason::StopLoss);
+            else if (!p.buy && p.sl > 0 && ask >= p.sl)
+                exit(i, std::max(ask, p.sl) + config.slippage, Fill::Reason::StopLoss);
+            else if (p.buy && p.tp > 0 && bid >= p.tp)
+                exit(i, std::max(bid, p.tp), Fill::Reason::TakeProfit);
+            else if (!p.buy && p.tp > 0 && ask <= p.tp)
+                exit(i, std::min(ask, p.tp), Fill::Reason::TakeProfit);
+            else
+                ++i;
+        }
+        mark();
+        if (!fills.empty()) {
+            // a callback may send orders; fills stays valid as nothing fills during it
+            for (const Fill& f : fills)
+                strategy.on_fill(f, *this);
+            fills.clear();
+        }
+        if (!bars.empty()) {
+            for (size_t k = 0; k < bars.size(); ++k)
+                bars[k].add(t.ts_ms, t.ask, t.bid, t.ask_vol, t.bid_vol, bar_emits[k]);
+            for (const auto& b : closed_bars)
+                strategy.on_bar(b.first, config.timeframes[b.first], b.second, *this);
+            closed_bars.clear();
+        }
+        strategy.on_tick(t, *this);
+    }
+
+    // Closes what is open at the last quote (Fill::Reason::End); later calls do nothing.
+    void finish() {
+        if (finished)
+            return;
+        finished = true;
+        while (!open.empty())
+            exit(open.size() - 1, open.back().buy ? tick.bid : tick.ask, Fill::Reason::End);
+        mark();
+        for (const Fill& f : fills)
+            strategy.on_fill(f, *this);
+        fills.clear();
+        pending.clear();
+        working.clear();
+        strategy.on_finish(*this);
+    }
+
+private:
+    struct Request {
+        uint64_t id = 0;
+        OrderRequest order;
+        int64_t due_ms = 0;
+        bool close = false;
+        bool cancelled = false;
+    };
+
+    struct Working {
+        uint64_t id;
+        OrderRequest order;
+        bool cancelled;
+    };
+
+    Position* find(uint64_t id) {
+        for (auto& p : open)
+            if (p.id == id)
+                return &p;
+        return nullptr;
+    }
+
+    bool triggered(const OrderRequest& o, double& px) const {
+        if (o.type == OrderType::Limit) {
+            if (o.buy ? tick.ask <= o.price : tick.bid >= o.price) {
+                px = o.buy ? std::min(tick.ask, o.price) : std::max(tick.bid, o.price);
+                return true;
+            }
+            return false;
+        }
+        if (o.buy ? tick.ask >= o.price : tick.bid <= o.price) {
+            px = o.buy ? std::max(tick.ask, o.price) + config.slippage : std::min(tick.bid, o.price) - config.slippage;
+            return true;
+        }
+        return false;
+    }
+
+    void enter(uint64_t id, const OrderRequest& o, double px) {
+        Position p;
+        p.id = id;
+        p.buy = o.buy;
+        p.qty = o.qty;
+        p.entry_ms = tick.ts_ms;
+        p.entry = px;
+        p.sl = p.initial_sl = o.sl;
+        p.tp = o.tp;
+        p.risk = o.risk;
+        open.push_back(p);
+        (o.buy ? long_qty : short_qty) += o.qty;
+        (o.buy ? long_cost : short_cost) += o.qty * px;
+        fills.push_back({ id, Fill::Reason::Entry, o.buy, tick.ts_ms, px, o.qty });
+    }
+
+    // Closes open[i] (the last position takes its slot).
+    void exit(size_t i, double px, Fill::Reason reason) {
+        const Position p = open[i];
+        open[i] = open.back();
+        open.pop_back();
+        (p.buy ? long_qty : short_qty) -= p.qty;
+        (p.buy ? long_cost : short_cost) -= p.qty * p.entry;
+        if (open.empty())
+            long_qty = short_qty = long_cost = short_cost = 0;
+
+        ClosedTrade c;
+        c.id = p.id;
+        c.buy = p.buy;
+        c.qty = p.qty;
+        c.entry_ms = p.entry_ms;
+        c.exit_ms = tick.ts_ms;
+        c.entry = p.entry;
+        c.exit = px;
+        double move = p.buy ? px - p.entry : p.entry - px;
+        c.pnl = move * p.qty - 2 * config.commission * p.qty;
+        double unit = p.buy ? p.entry - p.initial_sl : p.initial_sl - p.entry;
+        c.ret = p.initial_sl > 0 && p.risk > 0 && unit > 1e-9 * p.entry ? move / unit * p.risk : 0;
+        c.reason = reason;
+        result.balance += c.pnl;
+        result.total_ret += c.ret;
+        result.wins += c.pnl > 0;
+        peak_ret = std::max(peak_ret, result.total_ret);
+        result.ret_mdd = std::min(result.ret_mdd, result.total_ret - peak_ret);
+        result.trades.push_back(c);
+        fills.push_back({ p.id, reason, !p.buy, tick.ts_ms, px, p.qty });
+    }
+
+    void mark() {
+        double unrealized = long_qty * tick.bid - long_cost + short_cost - short_qty * tick.ask;
+        result.equity = result.balance + unrealized;
+        if (result.equity > peak_equity)
+            peak_equity = result.equity;
+        double dd = result.equity - peak_equity;
+        if (dd < result.max_drawdown) {
+            result.max_drawdown = dd;
+            result.max_drawdown_pct = peak_equity > 0 ? dd / peak_equity * 100 : 0;
+        }
+    }
+
+    Strategy& strategy;
+    Config config;
+    Tick tick;
+    int64_t now_ms = std::numeric_limits<int64_t>::min();
+    bool started = false;
+    bool finished = false;
+    uint64_t last_id = 0;
+    std::deque<Request> pending;
+    std::vector<Working> working;
+    std::vector<Position> open;
+    std::vector<Fill> fills;
+    double long_qty = 0, long_cost = 0;
+    double short_qty = 0, short_cost = 0;
+    double peak_equity = 0;
+    double peak_ret = 0;
+    BacktestReport result;
+    std::vector<TimeframeAggregator> bars;      // per Config::timeframes entry
+    std::vector<TimeframeAggregator::Emit> bar_emits;
+    std::vector<std::pair<size_t, Bar>> closed_bars;
+};
+
+// Every strategy on its own Backtester over the same ticks (read-only, e.g. a mapped
+// tick store), reports in the order of strategies. Threads take the next strategy
+// as they finish one. 0 threads: one per core.
+inline std::vector<BacktestReport> backtest_all(const TickView& ticks, const std::vector<Strategy*>& strategies,
+                                                const Backtester::Config& config, size_t threads = 0) {
+    std::vector<BacktestReport> out(strategies.size());
+    parallel_indices(strategies.size(), threads, [&](size_t, size_t i) {
+        Backtester bt(*strategies[i], config);
+        bt.run(ticks);
+        out[i] = bt.report();
+    });
+    return out;
+}
+
+#endif // DUKASBACKTEST_HPP
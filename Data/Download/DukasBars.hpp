@@ -0,0 +1,391 @@
+#ifndef DUKASBARS_HPP
+#define DUKASBARS_HPP
+
+#include <functional>
+#include <stdexcept>
+#include <algorithm>
+#include <numeric>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "DukasDecoder.hpp"
+
+// OHLC bar on both sides of the book, keyed by its bucket start (UTC epoch ms).
+struct Bar {
+    int64_t start_ms = 0;
+    double open_ask = 0, high_ask = 0, low_ask = 0, close_ask = 0;
+    double open_bid = 0, high_bid = 0, low_bid = 0, close_bid = 0;
+    double total_ask_volume = 0, total_bid_volume = 0;
+    uint64_t ticks = 0;
+
+    void start(int64_t start, double ask, double bid, double ask_vol, double bid_vol) {
+        start_ms = start;
+        open_ask = high_ask = low_ask = close_ask = ask;
+        open_bid = high_bid = low_bid = close_bid = bid;
+        total_ask_volume = ask_vol;
+        total_bid_volume = bid_vol;
+        ticks = 1;
+    }
+
+    void add(double ask, double bid, double ask_vol, double bid_vol) {
+        high_ask = std::max(high_ask, ask);
+        low_ask = std::min(low_ask, ask);
+        close_ask = ask;
+        high_bid = std::max(high_bid, bid);
+        low_bid = std::min(low_bid, bid);
+        close_bid = bid;
+        total_ask_volume += ask_vol;
+        total_bid_volume += bid_vol;
+        ++ticks;
+    }
+
+    // Folds a later, finer bar into this one.
+    void merge(const Bar& later) {
+        high_ask = std::max(high_ask, later.high_ask);
+        low_ask = std::min(low_ask, later.low_ask);
+        close_ask = later.close_ask;
+        high_bid = std::max(high_bid, later.high_bid);
+        low_bid = std::min(low_bid, later.low_bid);
+        close_bid = later.close_bid;
+        total_ask_volume += later.total_ask_volume;
+        total_bid_volume += later.total_bid_volume;
+        ticks += later.ticks;
+    }
+};
+
+// "500ms", "30s", "5m", "1h", "1d", "1w" -> milliseconds
+inline int64_t timeframe_to_ms(const std::string& tf) {
+    size_t pos = 0;
+    long long n = std::stoll(tf, &pos);
+    std::string unit = tf.substr(pos);
+    if (n <= 0)
+        throw std::invalid_argument("Invalid timeframe: " + tf);
+    if (unit == "ms") return n;
+    if (unit == "s") return n * 1000;
+    if (unit == "m" || unit == "min") return n * 60000;
+    if (unit == "h") return n * 3600000;
+    if (unit == "d") return n * 86400000;
+    if (unit == "w") return n * 7 * 86400000;
+    throw std::invalid_argument("Invalid timeframe unit: " + tf);
+}
+
+inline int64_t floor_to(int64_t ts, int64_t step) {
+    int64_t r = ts % step;
+    return r < 0 ? ts - r - step : ts - r;
+}
+
+// Where a timeframe's buckets start relative to the epoch grid. Weeks start on Sunday
+// 00:00 UTC (the epoch was a Thursday), inside the FX weekend, so a "1w" bar holds
+// one trading week from the Sunday evening open to the Friday close, as the weeks of
+// TradingCalendar do. Every other unit stays aligned to the epoch.
+inline int64_t timeframe_offset_ms(const std::string& tf) {
+    size_t pos = 0;
+    std::stoll(tf, &pos);
+    return tf.compare(pos, std::string::npos, "w") == 0 ? 3 * 86400000LL : 0;
+}
+
+inline int64_t floor_to(int64_t ts, int64_t step, int64_t offset) {
+    return floor_to(ts - offset, step) + offset;
+}
+
+// Builds bars for several clock timeframes in one pass over the ticks. Only the
+// timeframes that no finer timeframe divides see ticks; every other timeframe is
+// built from the closed bars of the largest finer timeframe dividing it
+// (1s -> 1m -> 5m -> 1h -> 1d -> 1w). Buckets are aligned to the UTC epoch, weeks
+// to Sunday 00:00 UTC (timeframe_offset_ms).
+class TimeframeAggregator {
+public:
+    // timeframe index (in constructor order) and the bar that just closed
+    using Emit = std::function<void(size_t, const Bar&)>;
+
+    TimeframeAggregator() = default;
+
+    explicit TimeframeAggregator(const std::vector<std::string>& timeframes) {
+        for (const auto& tf : timeframes) {
+            Level level;
+            level.name = tf;
+            level.step = timeframe_to_ms(tf);
+            level.offset = timeframe_offset_ms(tf);
+            levels.push_back(std::move(level));
+        }
+        order.resize(levels.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return levels[a].step < levels[b].step; });
+        for (size_t k = 0; k < order.size(); ++k) {
+            Level& level = levels[order[k]];
+            for (size_t j = k; j-- > 0;) {
+                const Level& finer = levels[order[j]];
+                if (finer.step < level.step && level.step % finer.step == 0 && (level.offset - finer.offset) % finer.step == 0) {
+                    levels[order[j]].consumers.push_back(order[k]);
+                    level.from_ticks = false;
+                    break;
+                }
+            }
+            if (level.from_ticks)
+                roots.push_back(order[k]);
+        }
+    }
+
+    size_t size() const { return levels.size(); }
+    const std::string& name(size_t i) const { return levels[i].name; }
+    int64_t step_ms(size_t i) const { return levels[i].step; }
+
+    // Start of the oldest bar still open: ticks from there on are needed to rebuild them.
+    int64_t open_since() const {
+        int64_t since = std::numeric_limits<int64_t>::max();
+        for (const auto& level : levels) {
+            if (level.open)
+                since = std::min(since, level.bar.start_ms);
+        }
+        return since;
+    }
+
+    void add(const TickBatch& ticks, const Emit& emit) {
+        for (size_t i = 0; i < ticks.size(); ++i)
+            add(ticks.ts_ms[i], ticks.ask[i], ticks.bid[i], ticks.ask_vol[i], ticks.bid_vol[i], emit);
+    }
+
+    // One tick: the bars it closes are emitted before it opens the next ones.
+    void add(int64_t ts, double ask, double bid, double ask_vol, double bid_vol, const Emit& emit) {
+        for (size_t r : roots) {
+            Level& level = levels[r];
+            int64_t bucket = floor_to(ts, level.step, level.offset);
+            if (level.open && bucket == level.bar.start_ms) {
+                level.bar.add(ask, bid, ask_vol, bid_vol);
+                continue;
+            }
+            if (level.open)
+                close(r, emit);
+            level.bar.start(bucket, ask, bid, ask_vol, bid_vol);
+            level.open = true;
+        }
+    }
+
+    // Closes every open bar, finest first so they still cascade into coarser ones.
+    void flush(const Emit& emit) {
+        for (size_t i : order) {
+            if (levels[i].open)
+                close(i, emit);
+        }
+    }
+
+private:
+    struct Level {
+        std::string name;
+        int64_t step = 0;
+        int64_t offset = 0;
+        bool from_ticks = true;
+        std::vector<size_t> consumers;
+        Bar bar;
+        bool open = false;
+    };
+
+    void close(size_t i, const Emit& emit) {
+        Level& level = levels[i];
+        level.open = false;
+        emit(i, level.bar);
+        for (size_t c : level.consumers)
+            feed(c, level.bar, emit);
+    }
+
+    void feed(size_t i, const Bar& child, const Emit& emit) {
+        Level& level = levels[i];
+        int64_t bucket = floor_to(child.start_ms, level.step, level.offset);
+        if (level.open && bucket == level.bar.start_ms) {
+            level.bar.merge(child);
+            return;
+        }
+        if (level.open)
+            close(i, emit);
+        level.bar = child;
+        level.bar.start_ms = bucket;
+        level.open = true;
+    }
+
+    std::vector<Level> levels;
+    std::vector<size_t> order;  // level indices by ascending step
+    std::vector<size_t> roots;  // levels fed directly by ticks
+};
+
+// Activity-sampled bars, one spec each: "<n><kind>"
+//
+//   1000tick   every 1000 ticks            500tib  tick imbalance    500trb  tick runs
+//   50vol      every 50 units of volume    500vib  volume imbalance  500vrb  volume runs
+//   1e7dollar  every 1e7 of mid * volume   500dib  dollar imbalance  500drb  dollar runs
+//
+// Volume is ask_volume + bid_volume. For imbalance and run bars n seeds the expected
+// ticks per bar; the threshold then adapts as EWMAs of bar length and of the signed
+// (tick-rule) flow, following the information-driven bars of Lopez de Prado. State
+// is a handful of doubles whatever the bar length. An unfinished bar is kept across
+// add() calls and never emitted on its own. save_state() / load_state() carry that
+// state across runs: restored, and fed again from open_since(), a builder emits the
+// same bars as one that was never interrupted.
+class ActivityBarBuilder {
+public:
+    enum class Measure { Ticks, Volume, Dollars };
+    enum class Mode { Threshold, Imbalance, Runs };
+
+    static bool is_spec(const std::string& spec) {
+        size_t pos = spec.find_first_not_of("0123456789.eE+");
+        if (pos == 0 || pos == std::string::npos)
+            return false;
+        static const char* kinds[] = { "tick", "vol", "dollar", "tib", "vib", "dib", "trb", "vrb", "drb" };
+        std::string kind = spec.substr(pos);
+        // "1e7dollar" parses its exponent, a trailing 'e' belongs to no kind
+        return std::find_if(std::begin(kinds), std::end(kinds), [&](const char* k) { return kind == k; }) != std::end(kinds);
+    }
+
+    explicit ActivityBarBuilder(const std::string& spec) : spec_name(spec) {
+        size_t pos = 0;
+        double n = std::stod(spec, &pos);
+        std::string kind = spec.substr(pos);
+        if (!(n > 0))
+            throw std::invalid_argument("Invalid bar spec: " + spec);
+        if (kind == "tick") { measure = Measure::Ticks; mode = Mode::Threshold; }
+        else if (kind == "vol") { measure = Measure::Volume; mode = Mode::Threshold; }
+        else if (kind == "dollar") { measure = Measure::Dollars; mode = Mode::Threshold; }
+        else if (kind == "tib") { measure = Measure::Ticks; mode = Mode::Imbalance; }
+        else if (kind == "vib") { measure = Measure::Volume; mode = Mode::Imbalance; }
+        else if (kind == "dib") { measure = Measure::Dollars; mode = Mode::Imbalance; }
+        else if (kind == "trb") { measure = Measure::Ticks; mode = Mode::Runs; }
+        else if (kind == "vrb") { measure = Measure::Volume; mode = Mode::Runs; }
+        else if (kind == "drb") { measure = Measure::Dollars; mode = Mode::Runs; }
+        else
+            throw std::invalid_argument("Invalid bar kind: " + spec);
+        threshold = n;
+        expected_ticks = n;
+        min_ticks = std::max(1.0, n / 8);
+        max_ticks = n * 8;
+    }
+
+    const std::string& name() const { return spec_name; }
+
+    int64_t open_since() const { return open ? bar.start_ms : std::numeric_limits<int64_t>::max(); }
+
+    static constexpr size_t state_words = 10;
+
+    // Adaptive state as it was before the open bar's first tick (or now, with no bar
+    // open) into out[state_words].
+    void save_state(double* out) const {
+        if (open)
+            std::copy(bar_state, bar_state + state_words, out);
+        else
+            capture(out);
+    }
+
+    // Drops any open bar and continues from a save_state() snapshot.
+    void load_state(const double* in) {
+        expected_ticks = in[0];
+        mean_signed = in[1];
+        mean_abs = in[2];
+        buy_share = in[3];
+        mean_buy = in[4];
+        mean_sell = in[5];
+        warm = in[6];
+        last_mid = in[7];
+        sign = static_cast<int>(in[8]);
+        has_mid = in[9] != 0;
+        open = false;
+    }
+
+    template <typename EmitBar>
+    void add(const TickBatch& ticks, EmitBar&& emit) {
+        for (size_t i = 0; i < ticks.size(); ++i) {
+            double ask = ticks.ask[i], bid = ticks.bid[i];
+            double volume = static_cast<double>(ticks.ask_vol[i]) + static_cast<double>(ticks.bid_vol[i]);
+            double mid = 0.5 * (ask + bid);
+            double w = measure == Measure::Ticks ? 1.0 : measure == Measure::Volume ? volume : volume * mid;
+            if (!open)
+                capture(bar_state);
+
+            // tick rule on the mid: an unchanged mid keeps the previous sign
+            if (has_mid && mid != last_mid)
+                sign = mid > last_mid ? 1 : -1;
+            last_mid = mid;
+            has_mid = true;
+
+            if (!open) {
+                bar.start(ticks.ts_ms[i], ask, bid, ticks.ask_vol[i], ticks.bid_vol[i]);
+                open = true;
+                theta = buy_flow = sell_flow = 0;
+            }
+            else
+                bar.add(ask, bid, ticks.ask_vol[i], ticks.bid_vol[i]);
+
+            if (mode == Mode::Threshold) {
+                theta += w;
+                if (theta >= threshold)
+                    close(emit);
+                continue;
+            }
+            // per-tick expectations, window ~ the expected bar length
+            double a = 1.0 / expected_ticks;
+            if (sign > 0)
+                buy_flow += w;
+            else if (sign < 0)
+                sell_flow += w;
+            theta += sign * w;
+            mean_signed += a * (sign * w - mean_signed);
+            mean_abs += a * (w - mean_abs);
+            buy_share += a * ((sign > 0 ? 1.0 : 0.0) - buy_share);
+            mean_buy += sign > 0 ? a * (w - mean_buy) : 0.0;
+            mean_sell += sign < 0 ? a * (w - mean_sell) : 0.0;
+            if (warm < expected_ticks) {
+                ++warm;
+                continue;
+            }
+            double target;
+            if (mode == Mode::Imbalance) {
+                // a balanced market would otherwise shrink the target to a single tick
+                target = expected_ticks * std::max(std::abs(mean_signed), min_imbalance * mean_abs);
+                if (std::abs(theta) >= target)
+                    close(emit);
+            }
+            else {
+                target = expected_ticks * std::max(buy_share * mean_buy, (1.0 - buy_share) * mean_sell);
+                if (std::max(buy_flow, sell_flow) >= target)
+                    close(emit);
+            }
+        }
+    }
+
+private:
+    void capture(double* out) const {
+        const double v[state_words] = { expected_ticks, mean_signed, mean_abs, buy_share, mean_buy, mean_sell,
+            warm, last_mid, static_cast<double>(sign), has_mid ? 1.0 : 0.0 };
+        std::copy(v, v + state_words, out);
+    }
+
+    template <typename EmitBar>
+    void close(EmitBar&& emit) {
+        open = false;
+        if (mode != Mode::Threshold) {
+            expected_ticks += bar_alpha * (static_cast<double>(bar.ticks) - expected_ticks);
+            expected_ticks = std::min(max_ticks, std::max(min_ticks, expected_ticks));
+        }
+        emit(static_cast<const Bar&>(bar));
+    }
+
+    static constexpr double bar_alpha = 0.1;     // EWMA over ~20 bars
+    static constexpr double min_imbalance = 0.1; // of the mean absolute flow per tick
+
+    std::string spec_name;
+    Measure measure = Measure::Ticks;
+    Mode mode = Mode::Threshold;
+    double threshold = 0;
+    double expected_ticks = 0, min_ticks = 1, max_ticks = 0;
+    double mean_signed = 0, mean_abs = 0, buy_share = 0.5, mean_buy = 0, mean_sell = 0;
+    double warm = 0;
+    double theta = 0, buy_flow = 0, sell_flow = 0;
+    double last_mid = 0;
+    bool has_mid = false;
+    int sign = 0;
+    Bar bar;
+    bool open = false;
+    double bar_state[state_words] = {};   // capture() before the open bar's first tick
+};
+
+#endif // DUKASBARS_HPP
@@ -0,0 +1,89 @@
+#ifndef DUKASBUDGET_HPP
+#define DUKASBUDGET_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+
+// Request-rate budget shared by every fetcher in the process (token bucket).
+// The rate adapts AIMD-style: a throttled response (429/503) halves it and
+// pauses new requests for a cool-down, every successful response adds a little
+// back until the configured ceiling is reached again.
+class RequestBudget {
+public:
+    using clock = std::chrono::steady_clock;
+
+    explicit RequestBudget(double max_per_second, double min_per_second = 1.0)
+        : ceiling(std::max(min_per_second, max_per_second)), floor(min_per_second), current(ceiling),
+          tokens(std::min(ceiling, 4.0)), refilled(clock::now()), paused_until(refilled)
+    {
+    }
+
+    // Takes one request token if one is available now.
+    bool try_acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = clock::now();
+        if (now < paused_until)
+            return false;
+        refill(now);
+        if (tokens < 1.0)
+            return false;
+        tokens -= 1.0;
+        return true;
+    }
+
+    // Earliest time try_acquire() can succeed.
+    clock::time_point next_token() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = clock::now();
+        if (now < paused_until)
+            return paused_until;
+        double missing = 1.0 - (tokens + std::chrono::duration<double>(now - refilled).count() * current);
+        if (missing <= 0)
+            return now;
+        return now + std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(missing / current));
+    }
+
+    void on_throttled(std::chrono::milliseconds cool_down = std::chrono::milliseconds(2000)) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto now = clock::now();
+        refill(now);
+        current = std::max(floor, current / 2);
+        tokens = std::min(tokens, 1.0);
+        paused_until = std::max(paused_until, now + cool_down);
+        ++throttle_count;
+    }
+
+    void on_success() {
+        std::lock_guard<std::mutex> lock(mutex);
+        // ~ +1 req/s for every `current` successes, i.e. about one step per second
+        current = std::min(ceiling, current + 1.0 / current);
+    }
+
+    double rate() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return current;
+    }
+
+    size_t throttled() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return throttle_count;
+    }
+
+private:
+    void refill(clock::time_point now) {
+        tokens = std::min(std::max(1.0, current), tokens + std::chrono::duration<double>(now - refilled).count() * current);
+        refilled = now;
+    }
+
+    mutable std::mutex mutex;
+    double ceiling;
+    double floor;
+    double current;
+    double tokens;
+    clock::time_point refilled;
+    clock::time_point paused_until;
+    size_t throttle_count = 0;
+};
+
+#endif // DUKASBUDGET_HPP
@@ -0,0 +1,124 @@
+#ifndef DUKASBUFFERS_HPP
+#define DUKASBUFFERS_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include <atomic>
+#include <lzma.h>
+
+#include "DukasPipeline.hpp"
+
+// Byte buffers recycled across hours and threads (fetch bodies, LZMA output).
+// acquire() hands out an empty buffer whose capacity already covers the sizes seen
+// so far, so curl's write callback and the decoder fill it without reallocating;
+// release() gives it back and feeds its size to the estimate. The estimate follows
+// the largest recent size and decays slowly (1/64 per release) after a busy period,
+// and buffers far above it are dropped instead of pinning memory.
+class BufferPool {
+public:
+    explicit BufferPool(size_t max_cached = 64, size_t initial_hint = 64 * 1024)
+        : free_buffers(max_cached), size_hint(initial_hint) {}
+
+    std::vector<uint8_t> acquire() {
+        std::vector<uint8_t> buf;
+        if (free_buffers.try_pop(buf))
+            reused.fetch_add(1, std::memory_order_relaxed);
+        buf.clear();
+        size_t want = hint();
+        if (buf.capacity() < want) {
+            buf.reserve(want);
+            allocated.fetch_add(1, std::memory_order_relaxed);
+        }
+        return buf;
+    }
+
+    void release(std::vector<uint8_t>&& buf) {
+        observe(buf.size());
+        if (buf.capacity() == 0 || buf.capacity() > 4 * hint())
+            return;
+        free_buffers.try_push(std::move(buf));
+    }
+
+    void observe(size_t bytes) {
+        size_t h = size_hint.load(std::memory_order_relaxed);
+        size_t next = std::max(bytes + bytes / 8, h - h / 64);
+        size_hint.store(std::max<size_t>(next, 4096), std::memory_order_relaxed);
+    }
+
+    // capacity handed out, rounded up to 4 KB
+    size_t hint() const { return (size_hint.load(std::memory_order_relaxed) + 4095) & ~size_t(4095); }
+    uint64_t allocations() const { return allocated.load(std::memory_order_relaxed); }
+    uint64_t reuses() const { return reused.load(std::memory_order_relaxed); }
+
+private:
+    BoundedQueue<std::vector<uint8_t>> free_buffers;
+    std::atomic<size_t> size_hint;
+    std::atomic<uint64_t> allocated{ 0 };
+    std::atomic<uint64_t> reused{ 0 };
+};
+
+// .bi5 (LZMA "alone") decoder that keeps its lzma_stream between files: liblzma
+// re-initializes the same coder in place and keeps the dictionary and probability
+// tables when the next file uses the same dictionary size, which .bi5 files do.
+// The output is sized once from the size field of the header when it is present,
+// but never above 64 times the input: a corrupt header cannot make it allocate
+// gigabytes, and a real file that expands further grows the buffer as needed.
+// One per thread.
+class LzmaDecoder {
+public:
+    explicit LzmaDecoder(const lzma_allocator* allocator = nullptr) {
+        strm.allocator = allocator;
+    }
+
+    ~LzmaDecoder() { lzma_end(&strm); }
+
+    LzmaDecoder(const LzmaDecoder&) = delete;
+    LzmaDecoder& operator=(const LzmaDecoder&) = delete;
+
+    bool decode(const uint8_t* in, size_t n, std::vector<uint8_t>& out) {
+        if (n < header_size || lzma_alone_decoder(&strm, UINT64_MAX) != LZMA_OK)
+            return false;
+        uint64_t declared = 0;
+        for (int i = 7; i >= 0; --i)
+            declared = (declared << 8) | in[5 + i];
+        bool known = declared != UINT64_MAX;
+        uint64_t cap = uint64_t(std::max<size_t>(n, 4096)) * max_ratio;
+        size_t expected = static_cast<size_t>(known ? std::min(declared, cap) : std::min<uint64_t>(std::max(out.capacity(), n * 6), cap));
+        out.resize(std::max<size_t>(expected, 1));
+        strm.next_in = in;
+        strm.avail_in = n;
+        strm.next_out = out.data();
+        strm.avail_out = out.size();
+        for (;;) {
+            lzma_ret ret = lzma_code(&strm, LZMA_FINISH);
+            if (ret == LZMA_STREAM_END)
+                break;
+            if (ret != LZMA_OK && ret != LZMA_BUF_ERROR)
+                return false;
+            if (strm.avail_out != 0)
+                return false;   // truncated input
+            size_t used = out.size();
+            uint64_t grow = uint64_t(used) * 2;
+            if (known && declared > used)
+                grow = std::min(grow, declared);
+            out.resize(static_cast<size_t>(grow));
+            strm.next_out = out.data() + used;
+            strm.avail_out = out.size() - used;
+        }
+        out.resize(static_cast<size_t>(strm.total_out));
+        return true;
+    }
+
+    bool decode(const std::vector<uint8_t>& in, std::vector<uint8_t>& out) {
+        return decode(in.data(), in.size(), out);
+    }
+
+private:
+    static constexpr size_t header_size = 13;   // properties, dictionary size, u64 size
+    static constexpr uint64_t max_ratio = 64;   // initial output size per input byte at most
+
+    lzma_stream strm = LZMA_STREAM_INIT;
+};
+
+#endif // DUKASBUFFERS_HPP
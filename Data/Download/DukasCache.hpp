@@ -0,0 +1,140 @@
+#ifndef DUKASCACHE_HPP
+#define DUKASCACHE_HPP
+
+#include <unordered_map>
+#include <system_error>
+#include <filesystem>
+#include <stdexcept>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <ctime>
+
+// Local mirror of raw .bi5 hour files under dir/ASSET/YYYY/MM/DD/HHh_ticks.bi5
+// (same layout as the datafeed, months 0-based). dir/index.txt is an append-only
+// log of "ASSET <hour epoch s> <http code> <bytes>" lines; it remembers both the
+// cached hours and the confirmed 404 (market closed) hours so neither is requested
+// again. Only hours that are safely in the past are recorded, since the
+// in-progress hour still changes.
+class Bi5Cache {
+public:
+    enum class State { Missing, Cached, Closed };
+
+    explicit Bi5Cache(const std::string& dir, std::chrono::hours settle = std::chrono::hours(2))
+        : root(dir), settle(settle)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(root, ec);
+        if (ec)
+            throw std::runtime_error("Cannot create cache directory " + dir + ": " + ec.message());
+        load_index();
+        index_out.open(root / "index.txt", std::ios::app);
+        if (!index_out.is_open())
+            throw std::runtime_error("Cannot open cache index in " + dir);
+    }
+
+    State lookup(const std::string& asset, std::chrono::system_clock::time_point hour) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto a = entries.find(asset);
+        if (a == entries.end())
+            return State::Missing;
+        auto e = a->second.find(epoch_s(hour));
+        if (e == a->second.end())
+            return State::Missing;
+        return e->second == 404 ? State::Closed : State::Cached;
+    }
+
+    bool load(const std::string& asset, std::chrono::system_clock::time_point hour, std::vector<uint8_t>& out) const {
+        std::ifstream in(hour_path(asset, hour), std::ios::binary | std::ios::ate);
+        if (!in.is_open())
+            return false;
+        std::streamsize size = in.tellg();
+        in.seekg(0);
+        out.resize(static_cast<size_t>(size));
+        return size == 0 || static_cast<bool>(in.read(reinterpret_cast<char*>(out.data()), size));
+    }
+
+    // Both calls ignore hours that may still change. store() is meant for bodies that
+    // decoded, so a truncated transfer is never replayed; it may be called from
+    // several threads.
+    void store(const std::string& asset, std::chrono::system_clock::time_point hour, const std::vector<uint8_t>& data) {
+        if (!settled(hour))
+            return;
+        auto path = hour_path(asset, hour);
+        std::error_code ec;
+        std::filesystem::create_directories(path.parent_path(), ec);
+        auto tmp = path;
+        tmp += ".part";
+        {
+            std::ofstream out(tmp, std::ios::binary | std::ios::trunc);
+            if (!out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size())))
+                return;
+        }
+        std::filesystem::rename(tmp, path, ec);
+        if (!ec)
+            record(asset, hour, 200, data.size());
+    }
+
+    void mark_closed(const std::string& asset, std::chrono::system_clock::time_point hour) {
+        if (settled(hour))
+            record(asset, hour, 404, 0);
+    }
+
+private:
+    static int64_t epoch_s(std::chrono::system_clock::time_point t) {
+        return std::chrono::duration_cast<std::chrono::seconds>(t.time_since_epoch()).count();
+    }
+
+    bool settled(std::chrono::system_clock::time_point hour) const {
+        return hour + std::chrono::hours(1) + settle <= std::chrono::system_clock::now();
+    }
+
+    std::filesystem::path hour_path(const std::string& asset, std::chrono::system_clock::time_point hour) const {
+        std::time_t t = std::chrono::system_clock::to_time_t(hour);
+        std::tm tm = {};
+#ifdef _WIN32
+        gmtime_s(&tm, &t);
+#else
+        gmtime_r(&t, &tm);
+#endif
+        std::ostringstream oss;
+        oss << std::put_time(&tm, "%Y/") << std::setw(2) << std::setfill('0') << tm.tm_mon << "/"
+            << std::put_time(&tm, "%d/%H") << "h_ticks.bi5";
+        return root / asset / oss.str();
+    }
+
+    void load_index() {
+        std::ifstream in(root / "index.txt");
+        std::string asset;
+        int64_t hour = 0;
+        int code = 0;
+        size_t bytes = 0;
+        while (in >> asset >> hour >> code >> bytes)
+            entries[asset][hour] = code;
+    }
+
+    void record(const std::string& asset, std::chrono::system_clock::time_point hour, int code, size_t bytes) {
+        std::lock_guard<std::mutex> lock(mutex);
+        int64_t key = epoch_s(hour);
+        auto& slot = entries[asset];
+        auto it = slot.find(key);
+        if (it != slot.end() && it->second == code)
+            return;
+        slot[key] = code;
+        index_out << asset << " " << key << " " << code << " " << bytes << "\n";
+        index_out.flush();
+    }
+
+    std::filesystem::path root;
+    std::chrono::hours settle;
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::unordered_map<int64_t, int>> entries;
+    std::ofstream index_out;
+};
+
+#endif // DUKASCACHE_HPP
@@ -0,0 +1,171 @@
+#ifndef DUKASCALENDAR_HPP
+#define DUKASCALENDAR_HPP
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <array>
+#include <ctime>
+
+// Hour-level trading calendar consulted before an hour file is requested.
+//
+//   FX        weekly close: Friday 22:00 UTC to Sunday 21:00 UTC is closed whatever
+//             the US daylight saving (the 21:00/22:00 edge hours are asked for)
+//   Crypto    24/7
+//   Exchange  indices, stocks, commodities: the FX week plus full-day holidays
+//
+// On top of the rules it learns from what the datafeed answers: every hour of the
+// week (168 slots) counts the distinct weeks it came back 404 and 200. A slot that
+// was closed in learn_weeks different weeks and never had data is treated as closed,
+// and a slot that ever had data is never closed by the weekly rule again (holidays
+// stay closed). A slot learned closed is still asked for once it has not been
+// answered for reprobe_weeks weeks, so a backfill from before an instrument's history
+// or a feed outage does not close it for good.
+class TradingCalendar {
+public:
+    enum class Session { FX, Crypto, Exchange };
+
+    static Session classify(const std::string& asset) {
+        static const char* crypto[] = { "BTC", "ETH", "LTC", "XRP", "BCH", "ADA", "DOT", "SOL", "DOGE", "XLM", "EOS", "LNK", "UNI", "MAT", "TRX", "AVE", "CMP", "ENJ", "BAT", "XMR" };
+        static const char* currencies[] = { "EUR", "USD", "JPY", "GBP", "CHF", "AUD", "NZD", "CAD", "NOK", "SEK", "DKK", "SGD", "HKD",
+            "MXN", "ZAR", "TRY", "PLN", "HUF", "CZK", "CNH", "RUB", "ILS", "THB", "XAU", "XAG" };
+        for (const char* c : crypto) {
+            if (asset.rfind(c, 0) == 0)
+                return Session::Crypto;
+        }
+        auto is_currency = [&](const std::string& code) {
+            return std::find_if(std::begin(currencies), std::end(currencies), [&](const char* c) { return code == c; }) != std::end(currencies);
+        };
+        if (asset.size() == 6 && is_currency(asset.substr(0, 3)) && is_currency(asset.substr(3)))
+            return Session::FX;
+        return Session::Exchange;
+    }
+
+    explicit TradingCalendar(Session session, const std::string& state_path = "", int learn_weeks = 3, int reprobe_weeks = 8)
+        : session(session), state_path(state_path), learn_weeks(learn_weeks), reprobe_weeks(reprobe_weeks)
+    {
+        if (session == Session::Exchange) {
+            add_holiday(1, 1);
+            add_holiday(12, 25);
+        }
+        load();
+    }
+
+    ~TradingCalendar() {
+        try {
+            save();
+        }
+        catch (...) {
+        }
+    }
+
+    // Whole UTC day without trading, every year (month 1-12).
+    void add_holiday(int month, int day) {
+        holidays.push_back(month * 100 + day);
+    }
+
+    bool is_open(std::chrono::system_clock::time_point hour) const {
+        int64_t h = hour_index(hour);
+        if (holiday(h))
+            return false;
+        const Slot& s = slots[slot_of(h)];
+        if (s.closed_weeks >= learn_weeks && s.open_weeks == 0)
+            return std::llabs(week_of(h) - s.last_closed_week) >= reprobe_weeks;
+        return s.open_weeks > 0 || !weekly_closed(h);
+    }
+
+    // Feeds the datafeed's answer for one hour: 200 (with or without ticks) or 404.
+    void observe(std::chrono::system_clock::time_point hour, long http_code) {
+        if (http_code != 200 && http_code != 404)
+            return;
+        int64_t h = hour_index(hour);
+        Slot& s = slots[slot_of(h)];
+        int32_t week = static_cast<int32_t>(week_of(h));
+        if (http_code == 200 && s.last_open_week != week) {
+            ++s.open_weeks;
+            s.last_open_week = week;
+            dirty = true;
+        }
+        if (http_code == 404 && s.last_closed_week != week) {
+            ++s.closed_weeks;
+            s.last_closed_week = week;
+            dirty = true;
+        }
+    }
+
+    void save() {
+        if (state_path.empty() || !dirty)
+            return;
+        std::ofstream out(state_path, std::ios::trunc);
+        if (!out.is_open())
+            throw std::runtime_error("Cannot write calendar " + state_path);
+        for (const auto& s : slots)
+            out << s.closed_weeks << " " << s.open_weeks << " " << s.last_closed_week << " " << s.last_open_week << "\n";
+        dirty = false;
+    }
+
+private:
+    struct Slot {
+        int32_t closed_weeks = 0;
+        int32_t open_weeks = 0;
+        int32_t last_closed_week = -1;
+        int32_t last_open_week = -1;
+    };
+
+    static int64_t hour_index(std::chrono::system_clock::time_point t) {
+        return std::chrono::duration_cast<std::chrono::hours>(t.time_since_epoch()).count();
+    }
+
+    // epoch day 0 was a Thursday; weeks here run Sunday 00:00 UTC to Saturday 23:00
+    static int64_t week_of(int64_t h) { return (h / 24 + 4) / 7; }
+    static size_t slot_of(int64_t h) { return static_cast<size_t>(((h / 24 + 4) % 7) * 24 + h % 24); }
+
+    bool weekly_closed(int64_t h) const {
+        if (session == Session::Crypto)
+            return false;
+        int weekday = static_cast<int>((h / 24 + 4) % 7); // 0 = Sunday
+        int hour = static_cast<int>(h % 24);
+        return weekday == 6 || (weekday == 5 && hour >= 22) || (weekday == 0 && hour < 21);
+    }
+
+    bool holiday(int64_t h) const {
+        if (holidays.empty())
+            return false;
+        std::tm tm = {};
+        time_t t = static_cast<time_t>(h * 3600);
+#ifdef _WIN32
+        gmtime_s(&tm, &t);
+#else
+        gmtime_r(&t, &tm);
+#endif
+        int key = (tm.tm_mon + 1) * 100 + tm.tm_mday;
+        return std::find(holidays.begin(), holidays.end(), key) != holidays.end();
+    }
+
+    void load() {
+        if (state_path.empty())
+            return;
+        std::ifstream in(state_path);
+        for (auto& s : slots) {
+            if (!(in >> s.closed_weeks >> s.open_weeks >> s.last_closed_week >> s.last_open_week)) {
+                slots.fill(Slot());
+                return;
+            }
+        }
+    }
+
+    Session session;
+    std::string state_path;
+    int learn_weeks;
+    int reprobe_weeks;
+    std::vector<int> holidays;
+    std::array<Slot, 168> slots;
+    bool dirty = false;
+};
+
+#endif // DUKASCALENDAR_HPP
@@ -0,0 +1,343 @@
+#ifndef DUKASCOLUMNSTORE_HPP
+#define DUKASCOLUMNSTORE_HPP
+
+#include <system_error>
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "DukasDecoder.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory map of a whole file.
+class MappedFile {
+public:
+    MappedFile() = default;
+
+    explicit MappedFile(const std::filesystem::path& path) {
+#ifdef _WIN32
+        file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            throw std::runtime_error("Cannot open " + path.string());
+        LARGE_INTEGER size;
+        GetFileSizeEx(file, &size);
+        length = static_cast<size_t>(size.QuadPart);
+        if (length > 0) {
+            mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (!mapping)
+                throw std::runtime_error("Cannot map " + path.string());
+            addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        }
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::runtime_error("Cannot open " + path.string());
+        struct stat st;
+        fstat(fd, &st);
+        length = static_cast<size_t>(st.st_size);
+        if (length > 0) {
+            addr = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED) {
+                addr = nullptr;
+                throw std::runtime_error("Cannot map " + path.string());
+            }
+        }
+#endif
+    }
+
+    ~MappedFile() {
+#ifdef _WIN32
+        if (addr)
+            UnmapViewOfFile(addr);
+        if (mapping)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+#else
+        if (addr)
+            munmap(addr, length);
+        if (fd >= 0)
+            ::close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return static_cast<const uint8_t*>(addr); }
+    size_t size() const { return length; }
+
+private:
+    void* addr = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// Append-only columnar store: one fixed-width file per column (SoA), always led by
+// an int64 ts_ms column, plus index.bin holding (ts_ms, row) every index_stride rows.
+// meta.txt names the columns and their widths so a reader needs no schema.
+//
+//   dir/meta.txt  dir/ts_ms.col  dir/<column>.col ...  dir/index.bin
+class ColumnStoreWriter {
+public:
+    struct Column {
+        std::string name;
+        size_t width;
+    };
+
+    ColumnStoreWriter(const std::string& dir, const std::vector<Column>& value_columns, size_t index_stride = 4096)
+        : root(dir), columns(value_columns), index_stride(index_stride)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(root, ec);
+        columns.insert(columns.begin(), Column{ "ts_ms", 8 });
+        write_meta();
+
+        // a crash can leave columns of different lengths, cut them back to the shortest
+        size_t shortest = SIZE_MAX;
+        for (const auto& c : columns) {
+            auto path = root / (c.name + ".col");
+            size_t n = std::filesystem::exists(path) ? std::filesystem::file_size(path) / c.width : 0;
+            shortest = std::min(shortest, n);
+        }
+        cut_to(shortest);
+        open_files();
+    }
+
+    // Drops every row after the first keep ones, e.g. rows written after the last
+    // checkpoint of a run that did not finish.
+    void truncate(size_t keep) {
+        if (keep >= rows)
+            return;
+        flush();
+        files.clear();
+        index.close();
+        cut_to(keep);
+        open_files();
+    }
+
+    // Appends n rows; values[i] points to n elements of value column i.
+    // Rows not newer than the last stored timestamp are skipped, so an update run
+    // that overlaps the end of the store does not duplicate it. Rewriting an earlier
+    // range needs a fresh store (the downloader removes it on Restart).
+    void append(const int64_t* ts, const void* const* values, size_t n) {
+        size_t first = 0;
+        if (rows > 0)
+            first = std::upper_bound(ts, ts + n, last_ts) - ts;
+        if (first >= n)
+            return;
+        for (size_t r = first; r < n; ++r) {
+            if ((rows + r - first) % index_stride == 0) {
+                uint64_t row = rows + r - first;
+                index.write(reinterpret_cast<const char*>(&ts[r]), 8);
+                index.write(reinterpret_cast<const char*>(&row), 8);
+            }
+        }
+        files[0]->write(reinterpret_cast<const char*>(ts + first), static_cast<std::streamsize>((n - first) * 8));
+        for (size_t c = 1; c < columns.size(); ++c) {
+            const char* base = static_cast<const char*>(values[c - 1]) + first * columns[c].width;
+            files[c]->write(base, static_cast<std::streamsize>((n - first) * columns[c].width));
+        }
+        rows += n - first;
+        last_ts = ts[n - 1];
+    }
+
+    void flush() {
+        for (auto& f : files)
+            f->flush();
+        index.flush();
+    }
+
+    size_t size() const { return rows; }
+
+private:
+    void cut_to(size_t keep) {
+        rows = keep;
+        last_ts = 0;
+        for (const auto& c : columns) {
+            auto path = root / (c.name + ".col");
+            if (std::filesystem::exists(path))
+                std::filesystem::resize_file(path, rows * c.width);
+        }
+        auto index_path = root / "index.bin";
+        size_t index_entries = std::filesystem::exists(index_path) ? std::filesystem::file_size(index_path) / 16 : 0;
+        index_entries = std::min(index_entries, (rows + index_stride - 1) / index_stride);
+        if (std::filesystem::exists(index_path))
+            std::filesystem::resize_file(index_path, index_entries * 16);
+    }
+
+    void open_files() {
+        for (const auto& c : columns) {
+            files.emplace_back(std::make_unique<std::ofstream>(root / (c.name + ".col"), std::ios::binary | std::ios::app));
+            if (!files.back()->is_open())
+                throw std::runtime_error("Cannot open column " + c.name + " in " + root.string());
+        }
+        index.open(root / "index.bin", std::ios::binary | std::ios::app);
+        if (rows > 0) {
+            // last timestamp is needed to keep the store sorted across runs
+            std::ifstream ts(root / "ts_ms.col", std::ios::binary);
+            ts.seekg(static_cast<std::streamoff>((rows - 1) * 8));
+            ts.read(reinterpret_cast<char*>(&last_ts), 8);
+        }
+    }
+
+    void write_meta() {
+        std::ofstream meta(root / "meta.txt", std::ios::trunc);
+        meta << "stride " << index_stride << "\n";
+        for (const auto& c : columns)
+            meta << c.name << " " << c.width << "\n";
+    }
+
+    std::filesystem::path root;
+    std::vector<Column> columns;
+    size_t index_stride;
+    size_t rows = 0;
+    int64_t last_ts = 0;
+    std::vector<std::unique_ptr<std::ofstream>> files;
+    std::ofstream index;
+};
+
+// Maps a store written by ColumnStoreWriter. A time range query is a binary search
+// over the sparse index and then inside one stride of ts_ms; no parsing.
+class ColumnStoreReader {
+public:
+    explicit ColumnStoreReader(const std::string& dir) : root(dir) {
+        std::ifstream meta(root / "meta.txt");
+        if (!meta.is_open())
+            throw std::runtime_error("No column store in " + dir);
+        std::string key;
+        meta >> key >> index_stride;
+        std::string name;
+        size_t width;
+        rows = SIZE_MAX;
+        while (meta >> name >> width) {
+            names.push_back(name);
+            widths.push_back(width);
+            maps.emplace_back(std::make_unique<MappedFile>(root / (name + ".col")));
+            rows = std::min(rows, maps.back()->size() / width);
+        }
+        if (names.empty() || names[0] != "ts_ms")
+            throw std::runtime_error("Corrupt column store meta in " + dir);
+        index = std::make_unique<MappedFile>(root / "index.bin");
+    }
+
+    size_t size() const { return rows; }
+
+    template <typename T>
+    const T* column(const std::string& name) const {
+        for (size_t i = 0; i < names.size(); ++i) {
+            if (names[i] == name) {
+                if (widths[i] != sizeof(T))
+                    throw std::invalid_argument("Column " + name + " has width " + std::to_string(widths[i]));
+                return reinterpret_cast<const T*>(maps[i]->data());
+            }
+        }
+        throw std::invalid_argument("No column " + name);
+    }
+
+    const int64_t* timestamps() const { return reinterpret_cast<const int64_t*>(maps[0]->data()); }
+
+    // Raw access by position, ts_ms being column 0 (used to copy a store column by column).
+    size_t columns() const { return names.size(); }
+    const std::string& column_name(size_t i) const { return names[i]; }
+    size_t column_width(size_t i) const { return widths[i]; }
+    const void* column_data(size_t i) const { return maps[i]->data(); }
+
+    // Rows [first, last) with t0 <= ts_ms < t1.
+    std::pair<size_t, size_t> range(int64_t t0, int64_t t1) const {
+        return { lower_row(t0), lower_row(t1) };
+    }
+
+private:
+    size_t lower_row(int64_t t) const {
+        const int64_t* ts = timestamps();
+        size_t entries = index->size() / 16;
+        const uint8_t* idx = index->data();
+        // last index entry with ts < t bounds the search to one stride
+        size_t lo = 0, hi = entries;
+        while (lo < hi) {
+            size_t mid = (lo + hi) / 2;
+            int64_t key;
+            std::memcpy(&key, idx + mid * 16, 8);
+            if (key < t)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        size_t begin = 0, end = rows;
+        if (lo > 0) {
+            uint64_t row;
+            std::memcpy(&row, idx + (lo - 1) * 16 + 8, 8);
+            begin = std::min<size_t>(row, rows);
+        }
+        if (lo < entries) {
+            uint64_t row;
+            std::memcpy(&row, idx + lo * 16 + 8, 8);
+            end = std::min<size_t>(row + 1, rows);
+        }
+        return std::lower_bound(ts + begin, ts + end, t) - ts;
+    }
+
+    std::filesystem::path root;
+    size_t index_stride = 0;
+    size_t rows = 0;
+    std::vector<std::string> names;
+    std::vector<size_t> widths;
+    std::vector<std::unique_ptr<MappedFile>> maps;
+    std::unique_ptr<MappedFile> index;
+};
+
+// Tick layout of the column store: ts_ms, ask, bid (f64), ask_vol, bid_vol (f32).
+inline std::vector<ColumnStoreWriter::Column> tick_store_columns() {
+    return { { "ask", 8 }, { "bid", 8 }, { "ask_vol", 4 }, { "bid_vol", 4 } };
+}
+
+inline void append_ticks(ColumnStoreWriter& store, const TickBatch& ticks) {
+    const void* values[4] = { ticks.ask.data(), ticks.bid.data(), ticks.ask_vol.data(), ticks.bid_vol.data() };
+    store.append(ticks.ts_ms.data(), values, ticks.size());
+}
+
+// Zero-copy view of the ticks in [t0, t1) of a tick store.
+struct TickView {
+    const int64_t* ts_ms = nullptr;
+    const double* ask = nullptr;
+    const double* bid = nullptr;
+    const float* ask_vol = nullptr;
+    const float* bid_vol = nullptr;
+    size_t count = 0;
+};
+
+inline TickView ticks_between(const ColumnStoreReader& store, int64_t t0, int64_t t1) {
+    auto r = store.range(t0, t1);
+    TickView v;
+    v.count = r.second - r.first;
+    v.ts_ms = store.timestamps() + r.first;
+    v.ask = store.column<double>("ask") + r.first;
+    v.bid = store.column<double>("bid") + r.first;
+    v.ask_vol = store.column<float>("ask_vol") + r.first;
+    v.bid_vol = store.column<float>("bid_vol") + r.first;
+    return v;
+}
+
+#endif // DUKASCOLUMNSTORE_HPP
@@ -0,0 +1,281 @@
+#ifndef DUKASCSV_HPP
+#define DUKASCSV_HPP
+
+#include <system_error>
+#include <stdexcept>
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cmath>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
+#include "DukasBars.hpp"
+
+// Text output of the tick and bar CSVs without iostreams:
+//
+//   CsvTimestamp  epoch ms -> "YYYY-MM-DD HH:MM:SS.mmm" with integer civil-date math;
+//                 the "YYYY-MM-DD HH:" prefix is rebuilt once per hour
+//   CsvEmitter    one row per call, numbers through std::to_chars: prices with the
+//                 fixed decimals of the asset's point (exact, 5 for EURUSD), volumes
+//                 as the shortest text that reads back to the same f32
+//   CsvFile       large reusable buffer flushed with write(2) to an O_APPEND file
+
+class CsvTimestamp {
+public:
+    // Writes 23 characters (19 without milliseconds) and returns the end.
+    char* format(int64_t ts_ms, char* out, bool with_ms = true) {
+        int64_t hour = ts_ms >= 0 ? ts_ms / 3600000 : (ts_ms - 3599999) / 3600000;
+        if (hour != cached_hour)
+            build_prefix(hour);
+        unsigned in_hour = static_cast<unsigned>(ts_ms - hour * 3600000);
+        unsigned sec = in_hour / 1000;
+        std::memcpy(out, prefix, 14);
+        put2(out + 14, sec / 60);
+        out[16] = ':';
+        put2(out + 17, sec % 60);
+        if (!with_ms)
+            return out + 19;
+        unsigned ms = in_hour % 1000;
+        out[19] = '.';
+        out[20] = static_cast<char>('0' + ms / 100);
+        put2(out + 21, ms % 100);
+        return out + 23;
+    }
+
+    // days since 1970-01-01 -> proleptic Gregorian date (H. Hinnant's civil_from_days)
+    static void civil_from_days(int64_t z, int64_t& y, unsigned& m, unsigned& d) {
+        z += 719468;
+        int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+        unsigned doe = static_cast<unsigned>(z - era * 146097);
+        unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        unsigned mp = (5 * doy + 2) / 153;
+        d = doy - (153 * mp + 2) / 5 + 1;
+        m = mp < 10 ? mp + 3 : mp - 9;
+        y = static_cast<int64_t>(yoe) + era * 400 + (m <= 2);
+    }
+
+    static void put2(char* out, unsigned v) {
+        out[0] = static_cast<char>('0' + v / 10);
+        out[1] = static_cast<char>('0' + v % 10);
+    }
+
+private:
+    void build_prefix(int64_t hour) {
+        int64_t days = hour >= 0 ? hour / 24 : (hour - 23) / 24;
+        int64_t y;
+        unsigned m, d;
+        civil_from_days(days, y, m, d);
+        unsigned year = static_cast<unsigned>(std::min<int64_t>(std::max<int64_t>(y, 0), 9999));
+        put2(prefix, year / 100);
+        put2(prefix + 2, year % 100);
+        prefix[4] = '-';
+        put2(prefix + 5, m);
+        prefix[7] = '-';
+        put2(prefix + 8, d);
+        prefix[10] = ' ';
+        put2(prefix + 11, static_cast<unsigned>(hour - days * 24));
+        prefix[13] = ':';
+        cached_hour = hour;
+    }
+
+    int64_t cached_hour = std::numeric_limits<int64_t>::min();
+    char prefix[14] = {};
+};
+
+// Append-only output file with its own buffer. Rows are formatted straight into the
+// buffer (reserve/commit); a full buffer goes out in one write(2).
+class CsvFile {
+public:
+    explicit CsvFile(size_t buffer_bytes = 1 << 20) : buffer(std::max<size_t>(buffer_bytes, 4096)) {}
+
+    CsvFile(const CsvFile&) = delete;
+    CsvFile& operator=(const CsvFile&) = delete;
+
+    ~CsvFile() {
+        try {
+            close();
+        }
+        catch (...) {
+        }
+    }
+
+    bool open(const std::string& file_path) {
+        close();
+#ifdef _WIN32
+        fd = _open(file_path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+        struct _stat64 st;
+        file_bytes = (fd >= 0 && _fstat64(fd, &st) == 0) ? static_cast<uint64_t>(st.st_size) : 0;
+#else
+        fd = ::open(file_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        struct stat st;
+        file_bytes = (fd >= 0 && ::fstat(fd, &st) == 0) ? static_cast<uint64_t>(st.st_size) : 0;
+#endif
+        path = file_path;
+        used = 0;
+        return fd >= 0;
+    }
+
+    bool is_open() const { return fd >= 0; }
+
+    // Bytes in the file once the buffer is flushed.
+    uint64_t size() const { return file_bytes + used; }
+
+    void close() {
+        if (fd < 0)
+            return;
+        flush();
+#ifdef _WIN32
+        _close(fd);
+#else
+        ::close(fd);
+#endif
+        fd = -1;
+    }
+
+    void flush() {
+        const char* p = buffer.data();
+        size_t left = used;
+        while (left > 0) {
+#ifdef _WIN32
+            int n = _write(fd, p, static_cast<unsigned>(std::min<size_t>(left, 1u << 30)));
+#else
+            ssize_t n = ::write(fd, p, left);
+            if (n < 0 && errno == EINTR)
+                continue;
+#endif
+            if (n <= 0)
+                throw std::runtime_error("Failed to write " + path + ": " + std::generic_category().message(errno));
+            p += n;
+            left -= static_cast<size_t>(n);
+        }
+        file_bytes += used;
+        used = 0;
+    }
+
+    // flush() and wait until the file is on disk, e.g. before a checkpoint records size().
+    void sync() {
+        flush();
+#ifdef _WIN32
+        int res = _commit(fd);
+#else
+        int res = ::fsync(fd);
+#endif
+        if (res != 0)
+            throw std::runtime_error("Failed to sync " + path + ": " + std::generic_category().message(errno));
+    }
+
+    void write(const char* data, size_t n) {
+        while (n > 0) {
+            if (used == buffer.size())
+                flush();
+            size_t k = std::min(n, buffer.size() - used);
+            std::memcpy(buffer.data() + used, data, k);
+            used += k;
+            data += k;
+            n -= k;
+        }
+    }
+
+    void write(const std::string& text) { write(text.data(), text.size()); }
+
+    // At least n free bytes (n well below the buffer size); fill them, then commit the end.
+    char* reserve(size_t n) {
+        if (buffer.size() - used < n)
+            flush();
+        return buffer.data() + used;
+    }
+
+    void commit(char* end) { used = static_cast<size_t>(end - buffer.data()); }
+
+private:
+    std::vector<char> buffer;
+    size_t used = 0;
+    int fd = -1;
+    uint64_t file_bytes = 0;
+    std::string path;
+};
+
+// Formats tick and bar rows in the layout of the CSV headers.
+class CsvEmitter {
+public:
+    explicit CsvEmitter(double point = 1.0) { set_point(point); }
+
+    // Prices are integer multiples of 1/point, so log10(point) decimals print them exactly.
+    void set_point(double point) {
+        int d = point > 1 ? static_cast<int>(std::lround(std::log10(point))) : 0;
+        decimals = std::min(std::max(d, 0), 10);
+    }
+
+    int price_decimals() const { return decimals; }
+
+    // Timestamp,Ask,Bid,AskVolume,BidVolume
+    void tick(CsvFile& out, int64_t ts_ms, double ask, double bid, float ask_vol, float bid_vol) {
+        char* p = out.reserve(24 + 4 * number_room);
+        p = clock.format(ts_ms, p);
+        *p++ = ',';
+        p = price(p, ask);
+        *p++ = ',';
+        p = price(p, bid);
+        *p++ = ',';
+        p = volume(p, ask_vol);
+        *p++ = ',';
+        p = volume(p, bid_vol);
+        *p++ = '\n';
+        out.commit(p);
+    }
+
+    // Timestamp,OpenAsk,...,CloseBid,TotalAskVolume,TotalBidVolume; time bars are
+    // stamped to the second, activity bars (ms_timestamp) to the millisecond
+    void bar(CsvFile& out, const Bar& bar, bool ms_timestamp = false) {
+        char* p = out.reserve(24 + 10 * number_room);
+        p = clock.format(ms_timestamp ? bar.start_ms : floor_to(bar.start_ms, 1000), p, ms_timestamp);
+        const double prices[8] = { bar.open_ask, bar.high_ask, bar.low_ask, bar.close_ask,
+            bar.open_bid, bar.high_bid, bar.low_bid, bar.close_bid };
+        for (double v : prices) {
+            *p++ = ',';
+            p = price(p, v);
+        }
+        *p++ = ',';
+        p = volume(p, static_cast<float>(bar.total_ask_volume));
+        *p++ = ',';
+        p = volume(p, static_cast<float>(bar.total_bid_volume));
+        *p++ = '\n';
+        out.commit(p);
+    }
+
+    char* price(char* p, double v) const {
+        auto r = std::to_chars(p, p + number_room, v, std::chars_format::fixed, decimals);
+        return r.ec == std::errc() ? r.ptr : std::to_chars(p, p + number_room, v).ptr;
+    }
+
+    // volumes come from f32 fields; bar totals are rounded to f32 before printing
+    static char* volume(char* p, float v) {
+        auto r = std::to_chars(p, p + number_room, v, std::chars_format::fixed);
+        return r.ec == std::errc() ? r.ptr : std::to_chars(p, p + number_room, v).ptr;
+    }
+
+    CsvTimestamp& timestamps() { return clock; }
+
+private:
+    static constexpr size_t number_room = 48;
+
+    CsvTimestamp clock;
+    int decimals = 0;
+};
+
+#endif // DUKASCSV_HPP
@@ -0,0 +1,173 @@
+#ifndef DUKASDECODER_HPP
+#define DUKASDECODER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+// Struct-of-arrays tick columns for one decoded hour (or any batch of ticks).
+// clear() keeps the capacity, so a recycled batch decodes without allocating.
+struct TickBatch {
+    std::vector<int64_t> ts_ms;     // UTC epoch milliseconds
+    std::vector<double> ask;
+    std::vector<double> bid;
+    std::vector<float> ask_vol;
+    std::vector<float> bid_vol;
+
+    size_t size() const { return ts_ms.size(); }
+    bool empty() const { return ts_ms.empty(); }
+
+    void clear() {
+        ts_ms.clear();
+        ask.clear();
+        bid.clear();
+        ask_vol.clear();
+        bid_vol.clear();
+    }
+
+    void resize(size_t n) {
+        ts_ms.resize(n);
+        ask.resize(n);
+        bid.resize(n);
+        ask_vol.resize(n);
+        bid_vol.resize(n);
+    }
+
+    // Drops the leading ticks stamped at or before ts (ticks are sorted by time).
+    void drop_through(int64_t ts) {
+        size_t k = std::upper_bound(ts_ms.begin(), ts_ms.end(), ts) - ts_ms.begin();
+        if (k == 0)
+            return;
+        ts_ms.erase(ts_ms.begin(), ts_ms.begin() + k);
+        ask.erase(ask.begin(), ask.begin() + k);
+        bid.erase(bid.begin(), bid.begin() + k);
+        ask_vol.erase(ask_vol.begin(), ask_vol.begin() + k);
+        bid_vol.erase(bid_vol.begin(), bid_vol.begin() + k);
+    }
+
+    void push_back(int64_t ts, double a, double b, float av, float bv) {
+        ts_ms.push_back(ts);
+        ask.push_back(a);
+        bid.push_back(b);
+        ask_vol.push_back(av);
+        bid_vol.push_back(bv);
+    }
+};
+
+inline uint32_t bswap32(uint32_t v) {
+#if defined(_MSC_VER)
+    return _byteswap_ulong(v);
+#else
+    return __builtin_bswap32(v);
+#endif
+}
+
+// Swaps every 32-bit word of buf in place. A .bi5 record is five big-endian
+// words, so the whole payload can be swapped without looking at record bounds.
+inline void bswap32_inplace(uint8_t* buf, size_t words) {
+    size_t i = 0;
+#if defined(__SSSE3__)
+    const __m128i mask = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    for (; i + 4 <= words; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i * 4));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(buf + i * 4), _mm_shuffle_epi8(v, mask));
+    }
+#endif
+    for (; i < words; ++i) {
+        uint32_t w;
+        std::memcpy(&w, buf + i * 4, 4);
+        w = bswap32(w);
+        std::memcpy(buf + i * 4, &w, 4);
+    }
+}
+
+// Forward-only view over a decompressed hour; skipping never copies or erases.
+struct ByteCursor {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+
+    bool starts_with(const char* prefix) const {
+        size_t n = std::strlen(prefix);
+        return size >= n && std::memcmp(data, prefix, n) == 0;
+    }
+
+    bool printable_prefix(size_t n) const {
+        n = std::min(n, size);
+        for (size_t i = 0; i < n; ++i) {
+            if (data[i] < 32 || data[i] > 126)
+                return false;
+        }
+        return n > 0;
+    }
+
+    // advances past the next '\n'; returns false (and stays put) if there is none
+    bool skip_line() {
+        const void* nl = std::memchr(data, '\n', size);
+        if (!nl)
+            return false;
+        size_t len = static_cast<const uint8_t*>(nl) - data + 1;
+        data += len;
+        size -= len;
+        return true;
+    }
+};
+
+// Decodes the 20-byte .bi5 tick records
+//   u32 ms offset | u32 ask points | u32 bid points | f32 ask vol | f32 bid vol
+// (all big-endian) into TickBatch columns. The hour's base epoch and the price
+// point are resolved once per call, not per tick.
+class Bi5Decoder {
+public:
+    static constexpr size_t record_size = 20;
+
+    Bi5Decoder() = default;
+    explicit Bi5Decoder(double point) : point(point) {}
+
+    double price_point() const { return point; }
+
+    // Byte-swaps buf in place and appends its records to out. Leading text lines
+    // ("Timestamp..." headers) are skipped, a trailing partial record is ignored.
+    // Returns the number of ticks appended.
+    size_t decode(std::vector<uint8_t>& buf, int64_t hour_epoch_ms, TickBatch& out) const {
+        ByteCursor cursor{ buf.data(), buf.size() };
+        while (cursor.starts_with("Timestamp") || cursor.printable_prefix(10)) {
+            if (!cursor.skip_line())
+                return 0;
+        }
+        size_t offset = cursor.data - buf.data();
+        size_t count = cursor.size / record_size;
+        if (count == 0)
+            return 0;
+
+        uint8_t* records = buf.data() + offset;
+        bswap32_inplace(records, count * (record_size / 4));
+
+        size_t base = out.size();
+        out.resize(base + count);
+        int64_t* ts = out.ts_ms.data() + base;
+        double* ask = out.ask.data() + base;
+        double* bid = out.bid.data() + base;
+        float* ask_vol = out.ask_vol.data() + base;
+        float* bid_vol = out.bid_vol.data() + base;
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t w[5];
+            std::memcpy(w, records + i * record_size, record_size);
+            ts[i] = hour_epoch_ms + w[0];
+            ask[i] = static_cast<double>(w[1]) / point;
+            bid[i] = static_cast<double>(w[2]) / point;
+            std::memcpy(&ask_vol[i], &w[3], 4);
+            std::memcpy(&bid_vol[i], &w[4], 4);
+        }
+        return count;
+    }
+
+private:
+    double point = 1.0;
+};
+
+#endif // DUKASDECODER_HPP
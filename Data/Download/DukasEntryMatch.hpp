@@ -0,0 +1,289 @@
+#ifndef DUKASENTRYMATCH_HPP
+#define DUKASENTRYMATCH_HPP
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <limits>
+#include <tuple>
+#include <cmath>
+
+#include "DukasTrades.hpp"
+#include "DukasCsv.hpp"
+
+// Paris wall-clock time (as parse_utc_ms reads it) -> UTC epoch ms. CET is UTC+1 and
+// CEST UTC+2, from the last Sunday of March to the last Sunday of October, 01:00 UTC.
+// A time repeated when clocks go back is read as its first (summer) occurrence, and a
+// time skipped when they go forward as winter time.
+inline int64_t paris_to_utc_ms(int64_t wall_ms) {
+    const int64_t hour = 3600000, day = 86400000;
+    int64_t y;
+    unsigned m, d;
+    CsvTimestamp::civil_from_days(wall_ms >= 0 ? wall_ms / day : (wall_ms - day + 1) / day, y, m, d);
+    auto last_sunday = [](int64_t year, int month) {
+        int64_t last = days_from_civil(static_cast<int>(year), month, 31);
+        return last - ((last % 7 + 11) % 7);   // 1970-01-01 was a Thursday
+    };
+    int64_t summer_from = last_sunday(y, 3) * day + hour;
+    int64_t summer_to = last_sunday(y, 10) * day + hour;
+    int64_t summer = wall_ms - 2 * hour;
+    return summer >= summer_from && summer < summer_to ? summer : wall_ms - hour;
+}
+
+// One-sided OHLC bars keyed by their start (UTC epoch ms), in time order.
+struct CandleSeries {
+    std::vector<int64_t> start_ms;
+    std::vector<double> open, high, low, close;
+
+    size_t size() const { return start_ms.size(); }
+};
+
+// A Dukascopy candle export: "Gmt time,Open,High,Low,Close,Volume" with times as
+// "DD.MM.YYYY HH:MM:SS.mmm" (UTC); a header line is skipped.
+inline CandleSeries read_candles_csv(const std::string& path) {
+    std::ifstream in(path);
+    if (!in.is_open())
+        throw std::runtime_error("Cannot open candle file " + path);
+    CandleSeries bars;
+    std::string line;
+    size_t line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        size_t comma = line.find(',');
+        int64_t ts;
+        if (comma == std::string::npos || !parse_utc_ms(line.substr(0, comma), ts)) {
+            if (line_no == 1 || line.empty() || line == "\r")
+                continue;
+            throw std::runtime_error("Invalid candle on line " + std::to_string(line_no) + " of " + path);
+        }
+        const char* p = line.c_str() + comma + 1;
+        char* end;
+        double v[4];
+        for (double& x : v) {
+            x = std::strtod(p, &end);
+            if (end == p)
+                throw std::runtime_error("Invalid candle on line " + std::to_string(line_no) + " of " + path);
+            p = *end == ',' ? end + 1 : end;
+        }
+        if (!bars.start_ms.empty() && ts < bars.start_ms.back())
+            throw std::runtime_error("Candles out of order on line " + std::to_string(line_no) + " of " + path);
+        bars.start_ms.push_back(ts);
+        bars.open.push_back(v[0]);
+        bars.high.push_back(v[1]);
+        bars.low.push_back(v[2]);
+        bars.close.push_back(v[3]);
+    }
+    return bars;
+}
+
+// Price-touch index over rows with a [lo, hi] price range each (lo == hi for ticks):
+// min lo and max hi per block of 64 rows and per block of 64 blocks. Looking for the
+// next row whose range holds a price skips every block whose range does not.
+class TouchIndex {
+public:
+    TouchIndex(const double* lo, const double* hi, size_t n) : lo(lo), hi(hi), n(n) {
+        build(lo, hi, n, fine);
+        std::vector<double> flo(fine.size()), fhi(fine.size());
+        for (size_t b = 0; b < fine.size(); ++b) {
+            flo[b] = fine[b].lo;
+            fhi[b] = fine[b].hi;
+        }
+        build(flo.data(), fhi.data(), fine.size(), coarse);
+    }
+
+    size_t size() const { return n; }
+
+    bool touches(size_t row, double p, double tol) const {
+        return lo[row] - tol <= p && p <= hi[row] + tol;
+    }
+
+    // First row in [from, to) whose range holds p (within tol), or to.
+    size_t next_touch(size_t from, size_t to, double p, double tol) const {
+        size_t r = from;
+        while (r < to) {
+            if (r % (block * block) == 0 && !coarse[r / (block * block)].holds(p, tol)) {
+                r += block * block;
+                continue;
+            }
+            if (r % block == 0 && !fine[r / block].holds(p, tol)) {
+                r += block;
+                continue;
+            }
+            if (touches(r, p, tol))
+                return r;
+            ++r;
+        }
+        return to;
+    }
+
+private:
+    static constexpr size_t block = 64;
+
+    struct Range {
+        double lo = std::numeric_limits<double>::infinity();
+        double hi = -std::numeric_limits<double>::infinity();
+
+        bool holds(double p, double tol) const { return lo - tol <= p && p <= hi + tol; }
+    };
+
+    static void build(const double* lo, const double* hi, size_t n, std::vector<Range>& out) {
+        out.assign((n + block - 1) / block, Range());
+        for (size_t i = 0; i < n; ++i) {
+            Range& r = out[i / block];
+            r.lo = std::min(r.lo, lo[i]);
+            r.hi = std::max(r.hi, hi[i]);
+        }
+    }
+
+    const double* lo;
+    const double* hi;
+    size_t n;
+    std::vector<Range> fine;
+    std::vector<Range> coarse;
+};
+
+// A run of rows touching the entry price: consecutive rows, or touches no more than
+// merge_gap_ms apart.
+struct EntryCandidate {
+    int64_t time_ms = 0;            // touch of the run closest to the journal time
+    int64_t offset_ms = 0;          // time_ms - journal time
+    int64_t first_ms = 0;
+    int64_t last_ms = 0;
+    size_t touches = 0;
+};
+
+struct EntryMatch {
+    enum class Status { Touched, Nearest, NoData };
+    Status status = Status::NoData;
+    int64_t entry_ms = 0;           // best candidate, or the row nearest the journal time
+    double price = 0;               // the entry price, or that row's price (Nearest)
+    std::vector<EntryCandidate> candidates;     // by |offset_ms|, then time
+};
+
+inline const char* match_status_name(EntryMatch::Status s) {
+    switch (s) {
+    case EntryMatch::Status::Touched: return "touched";
+    case EntryMatch::Status::Nearest: return "nearest";
+    case EntryMatch::Status::NoData: return "no_data";
+    }
+    return "";
+}
+
+// Recovers exact entry times from approximate journal times: the rows within
+// window_ms of the journal time whose price range holds the entry price, found
+// through the time index of the source (binary search) and a TouchIndex, grouped in
+// runs and ranked by distance to the journal time in ms. Without a touch the entry
+// is the row nearest in time, at its mean OHLC price for bars.
+//
+// On a tick store long entries are looked for on the ask and short ones on the bid;
+// bars (e.g. a Dukascopy ASK candle export) are one side for both.
+class EntryMatcher {
+public:
+    struct Config {
+        int64_t window_ms = 12 * 3600000LL;     // searched on both sides of the journal time
+        double price_tol = 0;                   // touch: low - tol <= price <= high + tol
+        int64_t merge_gap_ms = 60000;           // touches this close are one candidate
+        size_t max_candidates = 5;
+    };
+
+    EntryMatcher(const ColumnStoreReader& ticks, const Config& config) : config(config), store(&ticks) {
+        ts = ticks.timestamps();
+        rows = ticks.size();
+        const double* ask = ticks.column<double>("ask");
+        const double* bid = ticks.column<double>("bid");
+        sides[0] = { ask, ask, nullptr, nullptr, std::make_unique<TouchIndex>(ask, ask, rows) };
+        sides[1] = { bid, bid, nullptr, nullptr, std::make_unique<TouchIndex>(bid, bid, rows) };
+    }
+
+    EntryMatcher(const CandleSeries& bars, const Config& config) : config(config) {
+        ts = bars.start_ms.data();
+        rows = bars.size();
+        sides[0] = { bars.low.data(), bars.high.data(), bars.open.data(), bars.close.data(),
+                     std::make_unique<TouchIndex>(bars.low.data(), bars.high.data(), rows) };
+        single_side = true;
+    }
+
+    EntryMatch match(int64_t approx_ms, double price, bool is_long) const {
+        const Side& side = sides[single_side || is_long ? 0 : 1];
+        EntryMatch out;
+        size_t r0, r1;
+        if (store)
+            std::tie(r0, r1) = store->range(approx_ms - config.window_ms, approx_ms + config.window_ms + 1);
+        else {
+            r0 = std::lower_bound(ts, ts + rows, approx_ms - config.window_ms) - ts;
+            r1 = std::upper_bound(ts, ts + rows, approx_ms + config.window_ms) - ts;
+        }
+        if (r0 == r1)
+            return out;
+
+        auto distance = [approx_ms](int64_t t) { return t >= approx_ms ? t - approx_ms : approx_ms - t; };
+        size_t r = side.index->next_touch(r0, r1, price, config.price_tol);
+        while (r < r1) {
+            EntryCandidate c;
+            c.first_ms = c.time_ms = ts[r];
+            size_t last = r;
+            do {
+                ++c.touches;
+                if (distance(ts[r]) < distance(c.time_ms))
+                    c.time_ms = ts[r];
+                last = r;
+                r = side.index->next_touch(r + 1, r1, price, config.price_tol);
+            } while (r < r1 && (r == last + 1 || ts[r] - ts[last] <= config.merge_gap_ms));
+            c.last_ms = ts[last];
+            c.offset_ms = c.time_ms - approx_ms;
+            out.candidates.push_back(c);
+        }
+        if (!out.candidates.empty()) {
+            std::stable_sort(out.candidates.begin(), out.candidates.end(), [](const EntryCandidate& a, const EntryCandidate& b) {
+                return std::llabs(a.offset_ms) < std::llabs(b.offset_ms);
+            });
+            if (out.candidates.size() > config.max_candidates)
+                out.candidates.resize(std::max<size_t>(config.max_candidates, 1));
+            out.status = EntryMatch::Status::Touched;
+            out.entry_ms = out.candidates.front().time_ms;
+            out.price = price;
+            return out;
+        }
+        size_t near = std::lower_bound(ts + r0, ts + r1, approx_ms) - ts;
+        if (near == r1 || (near > r0 && distance(ts[near - 1]) <= distance(ts[near])))
+            --near;
+        out.status = EntryMatch::Status::Nearest;
+        out.entry_ms = ts[near];
+        out.price = side.open ? (side.open[near] + side.hi[near] + side.lo[near] + side.close[near]) / 4 : side.lo[near];
+        return out;
+    }
+
+    // Matches in the order of trades (entry_ms being the journal time, in UTC); threads
+    // take the next trade as they finish one. 0 threads: one per core.
+    std::vector<EntryMatch> match_all(const std::vector<Trade>& trades, size_t threads = 0) const {
+        std::vector<EntryMatch> out(trades.size());
+        parallel_indices(trades.size(), threads, [&](size_t, size_t i) {
+            out[i] = match(trades[i].entry_ms, trades[i].entry_price, trades[i].is_long);
+        });
+        return out;
+    }
+
+private:
+    struct Side {
+        const double* lo = nullptr;
+        const double* hi = nullptr;
+        const double* open = nullptr;       // bars only
+        const double* close = nullptr;
+        std::unique_ptr<TouchIndex> index;
+    };
+
+    Config config;
+    const ColumnStoreReader* store = nullptr;
+    const int64_t* ts = nullptr;
+    size_t rows = 0;
+    Side sides[2];
+    bool single_side = false;
+};
+
+#endif // DUKASENTRYMATCH_HPP
@@ -0,0 +1,262 @@
+#ifndef DUKASFETCHER_HPP
+#define DUKASFETCHER_HPP
+
+#include <curl/curl.h>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <thread>
+
+#include "DukasBudget.hpp"
+#include "DukasBuffers.hpp"
+
+// Concurrent .bi5 fetch engine: up to max_in_flight hour files are transferred
+// at once on a single curl multi handle. Easy handles are recycled between hours
+// so the multi handle's connection cache keeps the keep-alive sockets warm.
+// Results are always returned in submission order (i.e. chronologically).
+// With a RequestBudget, transfers start only when it grants a token, and
+// throttled (429/503) or failed transfers are retried with exponential backoff.
+class DukasFetcher {
+public:
+    struct Result {
+        std::chrono::system_clock::time_point hour;
+        std::string url;
+        long http_code = 0;
+        CURLcode curl_code = CURLE_OK;
+        std::vector<uint8_t> data;
+        std::chrono::steady_clock::time_point started;
+        std::chrono::steady_clock::time_point finished;
+        int retries = 0;
+        bool from_cache = false;        // queued by submit_completed, no transfer
+    };
+
+    explicit DukasFetcher(size_t max_in_flight = 8, long timeout_s = 10)
+        : max_in_flight(std::max<size_t>(1, max_in_flight)), timeout_s(timeout_s)
+    {
+        multi = curl_multi_init();
+        if (!multi)
+            throw std::runtime_error("Failed to initialize cURL multi handle");
+        long limit = static_cast<long>(this->max_in_flight);
+        curl_multi_setopt(multi, CURLMOPT_MAX_HOST_CONNECTIONS, limit);
+        curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, limit);
+        curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, limit);
+        curl_multi_setopt(multi, CURLMOPT_PIPELINING, static_cast<long>(CURLPIPE_MULTIPLEX));
+        slots.reserve(this->max_in_flight); // never grows past this, so Slot* stays valid
+    }
+
+    ~DukasFetcher() {
+        for (auto& job : queue) {
+            if (job->slot)
+                curl_multi_remove_handle(multi, job->slot->easy);
+        }
+        for (auto& slot : slots)
+            curl_easy_cleanup(slot.easy);
+        curl_multi_cleanup(multi);
+    }
+
+    DukasFetcher(const DukasFetcher&) = delete;
+    DukasFetcher& operator=(const DukasFetcher&) = delete;
+
+    void set_budget(RequestBudget* shared, int retries = 6) {
+        budget = shared;
+        max_retries = retries;
+    }
+
+    // Transfers write into buffers taken from pool, pre-sized to the usual file size;
+    // the caller hands them back with pool->release() once done with Result::data.
+    void set_buffer_pool(BufferPool* shared) {
+        pool = shared;
+    }
+
+    void submit(std::chrono::system_clock::time_point hour, const std::string& url) {
+        auto job = std::make_unique<Job>();
+        job->result.hour = hour;
+        job->result.url = url;
+        queue.push_back(std::move(job));
+    }
+
+    // Queues an hour that needs no transfer (e.g. served from a local cache), so it
+    // is still returned in order with the hours around it.
+    void submit_completed(std::chrono::system_clock::time_point hour, const std::string& url, long http_code, std::vector<uint8_t>&& data) {
+        auto job = std::make_unique<Job>();
+        job->result.hour = hour;
+        job->result.url = url;
+        job->result.http_code = http_code;
+        job->result.data = std::move(data);
+        job->result.started = job->result.finished = std::chrono::steady_clock::now();
+        job->result.from_cache = true;
+        job->done = true;
+        queue.push_back(std::move(job));
+    }
+
+    // Submitted hours not yet returned by next(), including the ones in flight.
+    size_t pending() const { return queue.size(); }
+
+    // Blocks until the oldest submitted hour has completed and moves it into out.
+    // Returns false when nothing is pending.
+    bool next(Result& out) {
+        if (queue.empty())
+            return false;
+        start_jobs();
+        while (!queue.front()->done) {
+            if (in_flight() == 0)
+                wait_for_start();
+            else
+                pump();
+            start_jobs();
+        }
+        out = std::move(queue.front()->result);
+        queue.pop_front();
+        start_jobs();
+        return true;
+    }
+
+private:
+    struct Slot {
+        CURL* easy = nullptr;
+        bool busy = false;
+    };
+
+    struct Job {
+        Result result;
+        Slot* slot = nullptr;
+        bool done = false;
+        int attempts = 0;
+        std::chrono::steady_clock::time_point not_before;
+    };
+
+    static size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
+        auto* buffer = static_cast<std::vector<uint8_t>*>(userp);
+        size_t total = size * nmemb;
+        buffer->insert(buffer->end(), static_cast<uint8_t*>(contents), static_cast<uint8_t*>(contents) + total);
+        return total;
+    }
+
+    Slot* acquire_slot() {
+        for (auto& slot : slots) {
+            if (!slot.busy)
+                return &slot;
+        }
+        if (slots.size() >= max_in_flight)
+            return nullptr;
+        CURL* easy = curl_easy_init();
+        if (!easy)
+            throw std::runtime_error("Failed to initialize cURL easy handle");
+        curl_easy_setopt(easy, CURLOPT_WRITEFUNCTION, write_callback);
+        curl_easy_setopt(easy, CURLOPT_USERAGENT, "libcurl/1.0");
+        curl_easy_setopt(easy, CURLOPT_FOLLOWLOCATION, 1L);
+        curl_easy_setopt(easy, CURLOPT_TIMEOUT, timeout_s);
+        curl_easy_setopt(easy, CURLOPT_CONNECTTIMEOUT, timeout_s);
+        curl_easy_setopt(easy, CURLOPT_TCP_KEEPALIVE, 1L);
+        curl_easy_setopt(easy, CURLOPT_NOSIGNAL, 1L);
+        slots.push_back({ easy, false });
+        return &slots.back();
+    }
+
+    void start_jobs() {
+        auto now = std::chrono::steady_clock::now();
+        for (auto& job : queue) {
+            if (job->done || job->slot || job->not_before > now)
+                continue;
+            Slot* slot = acquire_slot();
+            if (!slot)
+                return;
+            if (budget && !budget->try_acquire())
+                return;
+            if (pool && job->result.data.capacity() == 0)
+                job->result.data = pool->acquire();
+            job->result.data.clear();
+            curl_easy_setopt(slot->easy, CURLOPT_URL, job->result.url.c_str());
+            curl_easy_setopt(slot->easy, CURLOPT_WRITEDATA, &job->result.data);
+            curl_easy_setopt(slot->easy, CURLOPT_PRIVATE, job.get());
+            CURLMcode mc = curl_multi_add_handle(multi, slot->easy);
+            if (mc != CURLM_OK)
+                throw std::runtime_error(std::string("Failed to add cURL transfer: ") + curl_multi_strerror(mc));
+            slot->busy = true;
+            job->slot = slot;
+            job->result.started = std::chrono::steady_clock::now();
+        }
+    }
+
+    void pump() {
+        int running = 0;
+        CURLMcode mc = curl_multi_perform(multi, &running);
+        if (mc != CURLM_OK)
+            throw std::runtime_error(std::string("cURL multi perform failed: ") + curl_multi_strerror(mc));
+
+        bool completed = false;
+        int msgs_left = 0;
+        while (CURLMsg* msg = curl_multi_info_read(multi, &msgs_left)) {
+            if (msg->msg != CURLMSG_DONE)
+                continue;
+            Job* job = nullptr;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, reinterpret_cast<char**>(&job));
+            job->result.curl_code = msg->data.result;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &job->result.http_code);
+            job->result.finished = std::chrono::steady_clock::now();
+            release(*job);
+            completed = true;
+            bool throttled = job->result.http_code == 429 || job->result.http_code == 503;
+            if (budget) {
+                if (throttled)
+                    budget->on_throttled();
+                else if (job->result.curl_code == CURLE_OK)
+                    budget->on_success();
+            }
+            if (budget && (throttled || job->result.curl_code != CURLE_OK) && job->attempts < max_retries) {
+                // 250 ms, 500 ms, 1 s, ... capped at 30 s
+                auto backoff = std::chrono::milliseconds(std::min<long long>(30000, 250LL << job->attempts));
+                ++job->attempts;
+                job->not_before = job->result.finished + backoff;
+                job->result.http_code = 0;
+                job->result.curl_code = CURLE_OK;
+                continue;
+            }
+            job->result.retries = job->attempts;
+            job->done = true;
+        }
+        if (!completed && running > 0)
+            curl_multi_poll(multi, nullptr, 0, 100, nullptr);
+    }
+
+    size_t in_flight() const {
+        return static_cast<size_t>(std::count_if(slots.begin(), slots.end(), [](const Slot& s) { return s.busy; }));
+    }
+
+    // Nothing is running: sleep until a backed-off job or the budget allows a start.
+    void wait_for_start() {
+        auto wake = std::chrono::steady_clock::time_point::max();
+        for (auto& job : queue) {
+            if (!job->done && !job->slot)
+                wake = std::min(wake, job->not_before);
+        }
+        if (budget)
+            wake = std::max(wake, budget->next_token());
+        auto limit = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+        std::this_thread::sleep_until(std::min(wake, limit));
+    }
+
+    void release(Job& job) {
+        if (!job.slot)
+            return;
+        curl_multi_remove_handle(multi, job.slot->easy);
+        job.slot->busy = false;
+        job.slot = nullptr;
+    }
+
+    CURLM* multi = nullptr;
+    size_t max_in_flight;
+    long timeout_s;
+    std::vector<Slot> slots;
+    std::deque<std::unique_ptr<Job>> queue;
+    RequestBudget* budget = nullptr;
+    BufferPool* pool = nullptr;
+    int max_retries = 0;
+};
+
+#endif // DUKASFETCHER_HPP
@@ -0,0 +1,249 @@
+#ifndef DUKASJOURNAL_HPP
+#define DUKASJOURNAL_HPP
+
+#include <system_error>
+#include <filesystem>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cerrno>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Append-only checkpoint log of fully committed hours. The file is a header and
+// fixed-size records, so the last checkpoint is found from the file size alone:
+//
+//   header : "DKJ2" | u32 slots | u32 state words
+//   record : u32 checksum | u32 0 | i64 hour_ms | i64 resume_ms | slots * (u64 bytes, u64 rows, i64 last_ms, i64 open_ms)
+//            | state words * f64
+//
+// A slot is one output (CSV file, table, column store) and remembers how far it
+// had been written when the hour was committed. The state words carry whatever the
+// writer needs besides, e.g. the adaptive thresholds of activity bars. A torn record at the tail (crash
+// mid-append) fails its checksum and is cut off on open. Every append is synced
+// to disk before commit() returns.
+class ResumeJournal {
+public:
+    struct Mark {
+        uint64_t bytes = 0;                                 // CSV size
+        uint64_t rows = 0;                                  // column store rows
+        int64_t last_ms = std::numeric_limits<int64_t>::min(); // newest tick or bar start written
+        int64_t open_ms = std::numeric_limits<int64_t>::max(); // first tick of the bar still open
+    };
+
+    struct Checkpoint {
+        int64_t hour_ms = 0;   // last hour whose output is complete
+        int64_t resume_ms = 0; // first hour to fetch again (earlier when bars were still open)
+        std::vector<Mark> marks;
+        std::vector<double> state;
+    };
+
+    // A journal written for another number of slots or state words cannot be trusted
+    // and is started over.
+    ResumeJournal(const std::string& path, size_t slots, size_t state_words = 0)
+        : path(path), slots(slots), state_words(state_words)
+    {
+        std::error_code ec;
+        auto parent = std::filesystem::path(path).parent_path();
+        if (!parent.empty())
+            std::filesystem::create_directories(parent, ec);
+        record.resize(record_size());
+        uint64_t size = std::filesystem::exists(path) ? std::filesystem::file_size(path) : 0;
+        uint64_t keep = 0;
+        if (size >= header_size && header_matches()) {
+            keep = header_size;
+            uint64_t records = (size - header_size) / record_size();
+            std::ifstream in(path, std::ios::binary);
+            // only the last two records are ever read: a torn append damages one at most
+            for (int tries = 0; tries < 2 && records > 0; ++tries, --records) {
+                in.seekg(static_cast<std::streamoff>(header_size + (records - 1) * record_size()));
+                if (in.read(reinterpret_cast<char*>(record.data()), static_cast<std::streamsize>(record.size())) && valid()) {
+                    decode(last_checkpoint);
+                    has_last = true;
+                    keep = header_size + records * record_size();
+                    break;
+                }
+                in.clear();
+            }
+        }
+        if (keep > 0)
+            std::filesystem::resize_file(path, keep);
+        open(keep == 0);
+    }
+
+    ~ResumeJournal() {
+        close();
+    }
+
+    ResumeJournal(const ResumeJournal&) = delete;
+    ResumeJournal& operator=(const ResumeJournal&) = delete;
+
+    bool last(Checkpoint& out) const {
+        if (has_last)
+            out = last_checkpoint;
+        return has_last;
+    }
+
+    void commit(const Checkpoint& c) {
+        if (c.marks.size() != slots)
+            throw std::invalid_argument("Checkpoint has " + std::to_string(c.marks.size()) + " slots, journal " + std::to_string(slots));
+        if (c.state.size() != state_words)
+            throw std::invalid_argument("Checkpoint has " + std::to_string(c.state.size()) + " state words, journal " + std::to_string(state_words));
+        uint8_t* p = record.data() + 8;
+        put(p, c.hour_ms);
+        put(p, c.resume_ms);
+        for (const auto& m : c.marks) {
+            put(p, m.bytes);
+            put(p, m.rows);
+            put(p, m.last_ms);
+            put(p, m.open_ms);
+        }
+        for (double v : c.state)
+            put(p, v);
+        uint32_t sum = checksum();
+        std::memcpy(record.data(), &sum, 4);
+        write(record.data(), record.size());
+        last_checkpoint = c;
+        has_last = true;
+    }
+
+    // Forgets every checkpoint, e.g. when the outputs were restarted from scratch.
+    void reset() {
+        close();
+        open(true);
+        has_last = false;
+    }
+
+private:
+    static constexpr char magic[4] = { 'D', 'K', 'J', '2' };
+    static constexpr size_t header_size = 12;
+
+    size_t record_size() const { return 24 + 32 * slots + 8 * state_words; }
+
+    bool header_matches() const {
+        std::ifstream in(path, std::ios::binary);
+        char header[header_size];
+        if (!in.read(header, header_size) || std::memcmp(header, magic, 4) != 0)
+            return false;
+        uint32_t n, words;
+        std::memcpy(&n, header + 4, 4);
+        std::memcpy(&words, header + 8, 4);
+        return n == slots && words == state_words;
+    }
+
+    void open(bool fresh) {
+#ifdef _WIN32
+        fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY | (fresh ? _O_TRUNC : 0), _S_IREAD | _S_IWRITE);
+#else
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (fresh ? O_TRUNC : 0), 0644);
+#endif
+        if (fd < 0)
+            throw std::runtime_error("Cannot open journal " + path);
+        if (fresh) {
+            uint8_t header[header_size];
+            uint32_t n = static_cast<uint32_t>(slots), words = static_cast<uint32_t>(state_words);
+            std::memcpy(header, magic, 4);
+            std::memcpy(header + 4, &n, 4);
+            std::memcpy(header + 8, &words, 4);
+            write(header, header_size);
+        }
+    }
+
+    void close() {
+        if (fd < 0)
+            return;
+#ifdef _WIN32
+        _close(fd);
+#else
+        ::close(fd);
+#endif
+        fd = -1;
+    }
+
+    // one append, on disk when this returns
+    void write(const uint8_t* p, size_t left) {
+        while (left > 0) {
+#ifdef _WIN32
+            int n = _write(fd, p, static_cast<unsigned>(left));
+#else
+            ssize_t n = ::write(fd, p, left);
+            if (n < 0 && errno == EINTR)
+                continue;
+#endif
+            if (n <= 0)
+                throw std::runtime_error("Failed to append to journal " + path + ": " + std::generic_category().message(errno));
+            p += n;
+            left -= static_cast<size_t>(n);
+        }
+#ifdef _WIN32
+        int res = _commit(fd);
+#else
+        int res = ::fsync(fd);
+#endif
+        if (res != 0)
+            throw std::runtime_error("Failed to sync journal " + path + ": " + std::generic_category().message(errno));
+    }
+
+    // FNV-1a over everything after the checksum field
+    uint32_t checksum() const {
+        uint32_t h = 2166136261u;
+        for (size_t i = 4; i < record.size(); ++i)
+            h = (h ^ record[i]) * 16777619u;
+        return h;
+    }
+
+    bool valid() const {
+        uint32_t sum;
+        std::memcpy(&sum, record.data(), 4);
+        return sum == checksum();
+    }
+
+    void decode(Checkpoint& c) const {
+        const uint8_t* p = record.data() + 8;
+        get(p, c.hour_ms);
+        get(p, c.resume_ms);
+        c.marks.resize(slots);
+        for (auto& m : c.marks) {
+            get(p, m.bytes);
+            get(p, m.rows);
+            get(p, m.last_ms);
+            get(p, m.open_ms);
+        }
+        c.state.resize(state_words);
+        for (double& v : c.state)
+            get(p, v);
+    }
+
+    template <typename T>
+    static void put(uint8_t*& p, T v) {
+        std::memcpy(p, &v, sizeof(T));
+        p += sizeof(T);
+    }
+
+    template <typename T>
+    static void get(const uint8_t*& p, T& v) {
+        std::memcpy(&v, p, sizeof(T));
+        p += sizeof(T);
+    }
+
+    std::string path;
+    size_t slots;
+    size_t state_words;
+    std::vector<uint8_t> record;
+    int fd = -1;
+    Checkpoint last_checkpoint;
+    bool has_last = false;
+};
+
+#endif // DUKASJOURNAL_HPP
@@ -0,0 +1,157 @@
+#ifndef DUKASLEDGER_HPP
+#define DUKASLEDGER_HPP
+
+#include <system_error>
+#include <filesystem>
+#include <stdexcept>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+
+// Shared work ledger on a directory that every worker can reach (local disk for
+// several processes, NFS/SMB for several hosts). A unit of work is a name such as
+// "EURUSD_20240115" and owns two files under dir/units:
+//
+//   <unit>.lease  "<worker> <expiry epoch ms>", present while a worker holds it
+//   <unit>.done   written once the unit's output is complete
+//
+// Files are created through a hard link of a fully written temporary file, which
+// fails if the target exists, so a claim is atomic and never half-written. A lease
+// that is not renewed before it expires (crashed or stuck worker) can be taken
+// over: the taker first renames it away, which only one worker can do.
+class WorkLedger {
+public:
+    enum class State { Open, Leased, Done };
+
+    WorkLedger(const std::string& dir, const std::string& worker, std::chrono::milliseconds lease = std::chrono::minutes(10))
+        : root(std::filesystem::path(dir) / "units"), worker(worker), lease(lease)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(root, ec);
+        if (ec)
+            throw std::runtime_error("Cannot create ledger directory " + root.string() + ": " + ec.message());
+        if (worker.empty() || worker.find_first_of(" \n") != std::string::npos)
+            throw std::invalid_argument("Invalid worker id: '" + worker + "'");
+    }
+
+    const std::string& worker_id() const { return worker; }
+
+    State state(const std::string& unit) const {
+        if (std::filesystem::exists(path(unit, ".done")))
+            return State::Done;
+        return std::filesystem::exists(path(unit, ".lease")) ? State::Leased : State::Open;
+    }
+
+    // True when this worker now holds the unit; false if it is done or leased elsewhere.
+    bool claim(const std::string& unit) {
+        if (state(unit) == State::Done)
+            return false;
+        if (create(path(unit, ".lease"), lease_text()))
+            return !std::filesystem::exists(path(unit, ".done")); // completed between the checks
+        std::string owner;
+        int64_t expiry = 0;
+        if (!read_lease(unit, owner, expiry) || expiry > now_ms())
+            return false;
+        // expired: move it aside (only one taker wins the rename), then check that what
+        // was moved is still the expired lease and not a fresh claim from another taker
+        auto stale = path(unit, ".stale." + worker);
+        std::error_code ec;
+        std::filesystem::rename(path(unit, ".lease"), stale, ec);
+        if (ec)
+            return false;
+        std::string moved_owner;
+        int64_t moved_expiry = 0;
+        bool same = read_file(stale, moved_owner, moved_expiry) && moved_owner == owner && moved_expiry == expiry;
+        if (!same) {
+            std::filesystem::create_hard_link(stale, path(unit, ".lease"), ec);
+            std::filesystem::remove(stale, ec);
+            return false;
+        }
+        std::filesystem::remove(stale, ec);
+        return create(path(unit, ".lease"), lease_text());
+    }
+
+    // Pushes the expiry out again; false if the lease was lost (expired and taken).
+    bool renew(const std::string& unit) {
+        std::string owner;
+        int64_t expiry = 0;
+        if (!read_lease(unit, owner, expiry) || owner != worker)
+            return false;
+        auto tmp = temp_path(unit);
+        if (!write_file(tmp, lease_text()))
+            return false;
+        std::error_code ec;
+        std::filesystem::rename(tmp, path(unit, ".lease"), ec);
+        return !ec;
+    }
+
+    void complete(const std::string& unit) {
+        create(path(unit, ".done"), worker + " " + std::to_string(now_ms()) + "\n");
+        release(unit);
+    }
+
+    // Gives a unit back without completing it (e.g. after an error), so others retry it.
+    void release(const std::string& unit) {
+        std::string owner;
+        int64_t expiry = 0;
+        std::error_code ec;
+        if (read_lease(unit, owner, expiry) && owner == worker)
+            std::filesystem::remove(path(unit, ".lease"), ec);
+    }
+
+private:
+    std::filesystem::path path(const std::string& unit, const std::string& suffix) const {
+        return root / (unit + suffix);
+    }
+
+    std::filesystem::path temp_path(const std::string& unit) const {
+        static thread_local std::mt19937_64 rng(std::random_device{}());
+        return root / (unit + ".tmp." + worker + "." + std::to_string(rng()));
+    }
+
+    static int64_t now_ms() {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    std::string lease_text() const {
+        return worker + " " + std::to_string(now_ms() + lease.count()) + "\n";
+    }
+
+    static bool write_file(const std::filesystem::path& p, const std::string& text) {
+        std::ofstream out(p, std::ios::trunc);
+        out << text;
+        out.flush();
+        return static_cast<bool>(out);
+    }
+
+    static bool read_file(const std::filesystem::path& p, std::string& owner, int64_t& expiry) {
+        std::ifstream in(p);
+        return static_cast<bool>(in >> owner >> expiry);
+    }
+
+    bool read_lease(const std::string& unit, std::string& owner, int64_t& expiry) const {
+        return read_file(path(unit, ".lease"), owner, expiry);
+    }
+
+    // exclusive create with complete content: write a temporary file, hard link it in
+    bool create(const std::filesystem::path& target, const std::string& text) const {
+        auto tmp = temp_path(target.filename().string());
+        if (!write_file(tmp, text))
+            throw std::runtime_error("Cannot write to ledger " + root.string());
+        std::error_code ec;
+        std::filesystem::create_hard_link(tmp, target, ec);
+        std::error_code ignored;
+        std::filesystem::remove(tmp, ignored);
+        return !ec;
+    }
+
+    std::filesystem::path root;
+    std::string worker;
+    std::chrono::milliseconds lease;
+};
+
+#endif // DUKASLEDGER_HPP
@@ -0,0 +1,294 @@
+#ifndef DUKASMETRICS_HPP
+#define DUKASMETRICS_HPP
+
+#include <condition_variable>
+#include <system_error>
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+
+// Monotonic counter; relaxed atomics, safe from any pipeline thread.
+class MetricCounter {
+public:
+    void add(uint64_t n = 1) { v.fetch_add(n, std::memory_order_relaxed); }
+    uint64_t value() const { return v.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<uint64_t> v{ 0 };
+};
+
+// Latency histogram with power-of-two buckets from 1 us to ~67 s (+Inf), recorded
+// in nanoseconds: one bit scan and two relaxed increments per observation.
+class LatencyHistogram {
+public:
+    static constexpr size_t buckets = 28;               // le 1us * 2^k, k < 27, then +Inf
+
+    void observe(std::chrono::steady_clock::duration d) {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(d).count();
+        observe_ns(ns > 0 ? static_cast<uint64_t>(ns) : 0);
+    }
+
+    void observe_ns(uint64_t ns) {
+        uint64_t us = (ns + 999) / 1000;
+        size_t k = 0;
+        while (k < buckets - 1 && (1ULL << k) < us)
+            ++k;
+        counts[k].fetch_add(1, std::memory_order_relaxed);
+        sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    // seconds of bucket k's upper bound
+    static double bound(size_t k) { return static_cast<double>(1ULL << k) * 1e-6; }
+    uint64_t count(size_t k) const { return counts[k].load(std::memory_order_relaxed); }
+    double sum_seconds() const { return sum_ns.load(std::memory_order_relaxed) * 1e-9; }
+
+    uint64_t total() const {
+        uint64_t n = 0;
+        for (const auto& c : counts)
+            n += c.load(std::memory_order_relaxed);
+        return n;
+    }
+
+private:
+    std::atomic<uint64_t> counts[buckets] = {};
+    std::atomic<uint64_t> sum_ns{ 0 };
+};
+
+// Counters and histograms of one download pipeline. Everything is per hour file,
+// never per tick, so the cost stays far below 1% of a run. `enabled` can be flipped
+// at any time; while it is off the pipeline skips its clock reads and updates.
+//
+//   http_*        transfers (wall time from start to completion), 404s, failures,
+//                 retries after 429/503/errors, hours served from the local cache
+//   lzma_seconds  decompression of one hour, parse_seconds .bi5 records -> ticks
+//   sink_seconds  one hour through the outputs, bars and journal; rows_written
+//                 counts ticks and bars handed to the sinks
+//   ticks_*       ticks the TickFilter flagged, and the ones it removed
+struct PipelineMetrics {
+    explicit PipelineMetrics(std::string asset) : asset(std::move(asset)) {}
+
+    bool on() const { return enabled.load(std::memory_order_relaxed); }
+
+    std::string asset;
+    std::atomic<bool> enabled{ true };
+
+    MetricCounter http_requests;
+    MetricCounter http_not_found;
+    MetricCounter http_errors;
+    MetricCounter retries;
+    MetricCounter cache_hits;
+    MetricCounter bytes_downloaded;
+    MetricCounter files_decoded;
+    MetricCounter ticks_parsed;
+    MetricCounter rows_written;
+    MetricCounter ticks_flagged;
+    MetricCounter ticks_dropped;
+    LatencyHistogram http_seconds;
+    LatencyHistogram lzma_seconds;
+    LatencyHistogram parse_seconds;
+    LatencyHistogram sink_seconds;
+
+    template <typename Fn>
+    void for_each_counter(Fn&& fn) const {
+        fn("http_requests_total", http_requests);
+        fn("http_not_found_total", http_not_found);
+        fn("http_errors_total", http_errors);
+        fn("http_retries_total", retries);
+        fn("cache_hits_total", cache_hits);
+        fn("bytes_downloaded_total", bytes_downloaded);
+        fn("files_decoded_total", files_decoded);
+        fn("ticks_parsed_total", ticks_parsed);
+        fn("rows_written_total", rows_written);
+        fn("ticks_flagged_total", ticks_flagged);
+        fn("ticks_dropped_total", ticks_dropped);
+    }
+
+    template <typename Fn>
+    void for_each_histogram(Fn&& fn) const {
+        fn("http_seconds", http_seconds);
+        fn("lzma_seconds", lzma_seconds);
+        fn("parse_seconds", parse_seconds);
+        fn("sink_seconds", sink_seconds);
+    }
+};
+
+// Writes a set of PipelineMetrics every `interval` (and once more when destroyed):
+//
+//   Prometheus  text exposition format, the whole file replaced atomically, for the
+//               node_exporter textfile collector or any scraper reading files
+//   JsonLines   one object per pipeline and interval appended to the file
+//
+// The metrics objects must outlive the exporter.
+class MetricsExporter {
+public:
+    enum class Format { Prometheus, JsonLines };
+
+    MetricsExporter(const std::string& path, Format format, std::chrono::milliseconds interval = std::chrono::seconds(10))
+        : path(path), format(format), interval(interval)
+    {
+        worker = std::thread([this]() { loop(); });
+    }
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    ~MetricsExporter() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cv.notify_all();
+        worker.join();
+        try {
+            export_now();
+        }
+        catch (...) {
+        }
+    }
+
+    void add(const PipelineMetrics* metrics) {
+        std::lock_guard<std::mutex> lock(mutex);
+        sources.push_back(metrics);
+    }
+
+    void remove(const PipelineMetrics* metrics) {
+        std::lock_guard<std::mutex> lock(mutex);
+        sources.erase(std::remove(sources.begin(), sources.end(), metrics), sources.end());
+    }
+
+    void export_now() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (format == Format::Prometheus)
+            write_prometheus();
+        else
+            write_json_lines();
+    }
+
+private:
+    void loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!cv.wait_for(lock, interval, [this]() { return stopping; })) {
+            lock.unlock();
+            try {
+                export_now();
+            }
+            catch (const std::exception& e) {
+                std::cerr << "Metrics export failed: " << e.what() << std::endl;
+            }
+            lock.lock();
+        }
+    }
+
+    static std::string escape(const std::string& s) {
+        std::string out;
+        for (char c : s) {
+            if (c == '\\' || c == '"')
+                out += '\\';
+            out += c;
+        }
+        return out;
+    }
+
+    void write_prometheus() {
+        std::ostringstream out;
+        out << std::setprecision(9);
+        if (!sources.empty()) {
+            sources.front()->for_each_counter([&](const char* name, const MetricCounter&) {
+                out << "# TYPE dukas_" << name << " counter\n";
+                for (const auto* m : sources) {
+                    m->for_each_counter([&](const char* n, const MetricCounter& c) {
+                        if (std::string(n) == name)
+                            out << "dukas_" << name << "{asset=\"" << escape(m->asset) << "\"} " << c.value() << "\n";
+                    });
+                }
+            });
+            sources.front()->for_each_histogram([&](const char* name, const LatencyHistogram&) {
+                out << "# TYPE dukas_" << name << " histogram\n";
+                for (const auto* m : sources) {
+                    m->for_each_histogram([&](const char* n, const LatencyHistogram& h) {
+                        if (std::string(n) != name)
+                            return;
+                        std::string label = "asset=\"" + escape(m->asset) + "\"";
+                        uint64_t cumulative = 0;
+                        for (size_t k = 0; k < LatencyHistogram::buckets; ++k) {
+                            cumulative += h.count(k);
+                            out << "dukas_" << name << "_bucket{" << label << ",le=\"";
+                            if (k + 1 == LatencyHistogram::buckets)
+                                out << "+Inf";
+                            else
+                                out << LatencyHistogram::bound(k);
+                            out << "\"} " << cumulative << "\n";
+                        }
+                        out << "dukas_" << name << "_sum{" << label << "} " << h.sum_seconds() << "\n";
+                        out << "dukas_" << name << "_count{" << label << "} " << cumulative << "\n";
+                    });
+                }
+            });
+        }
+        auto tmp = path + ".tmp";
+        {
+            std::ofstream file(tmp, std::ios::trunc);
+            if (!file.is_open())
+                throw std::runtime_error("Cannot write metrics file " + tmp);
+            file << out.str();
+        }
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        if (ec)
+            throw std::runtime_error("Cannot replace metrics file " + path + ": " + ec.message());
+    }
+
+    void write_json_lines() {
+        std::ofstream file(path, std::ios::app);
+        if (!file.is_open())
+            throw std::runtime_error("Cannot open metrics file " + path);
+        file << std::setprecision(9);
+        auto ts_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        for (const auto* m : sources) {
+            file << "{\"ts_ms\":" << ts_ms << ",\"asset\":\"" << escape(m->asset) << "\"";
+            m->for_each_counter([&](const char* name, const MetricCounter& c) {
+                file << ",\"" << name << "\":" << c.value();
+            });
+            // histograms as count, sum and the non-empty buckets (upper bound in s -> count)
+            m->for_each_histogram([&](const char* name, const LatencyHistogram& h) {
+                file << ",\"" << name << "\":{\"count\":" << h.total() << ",\"sum\":" << h.sum_seconds() << ",\"buckets\":{";
+                bool first = true;
+                for (size_t k = 0; k < LatencyHistogram::buckets; ++k) {
+                    if (h.count(k) == 0)
+                        continue;
+                    file << (first ? "" : ",") << "\"";
+                    if (k + 1 == LatencyHistogram::buckets)
+                        file << "+Inf";
+                    else
+                        file << LatencyHistogram::bound(k);
+                    file << "\":" << h.count(k);
+                    first = false;
+                }
+                file << "}}";
+            });
+            file << "}\n";
+        }
+    }
+
+    std::string path;
+    Format format;
+    std::chrono::milliseconds interval;
+    std::vector<const PipelineMetrics*> sources;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+    std::thread worker;
+};
+
+#endif // DUKASMETRICS_HPP
@@ -0,0 +1,504 @@
+#ifndef DUKASMONTECARLO_HPP
+#define DUKASMONTECARLO_HPP
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <tuple>
+#include <cmath>
+
+#include "DukasPipeline.hpp"
+
+// Counter-based random numbers: draw `counter` of `stream` is a fixed function of
+// the seed (SplitMix64 outputs from a start hashed out of seed and stream), so a
+// resample draws the same numbers whichever thread runs it and in whatever order.
+class CounterRng {
+public:
+    CounterRng(uint64_t seed, uint64_t stream) : start(mix(seed ^ mix(stream + 0x632be59bd9b4e019ULL))) {}
+
+    uint64_t at(uint64_t counter) const { return mix(start + counter * 0x9e3779b97f4a7c15ULL); }
+
+    // uniform in [0, n) (multiply-shift, bias below n / 2^64)
+    size_t below(uint64_t counter, size_t n) const {
+        return static_cast<size_t>(mul_high(at(counter), n));
+    }
+
+private:
+    // high 64 bits of a * b; from 32-bit halves where there is no 128-bit type (MSVC)
+    static uint64_t mul_high(uint64_t a, uint64_t b) {
+#ifdef __SIZEOF_INT128__
+        return static_cast<uint64_t>((static_cast<unsigned __int128>(a) * b) >> 64);
+#else
+        uint64_t a_lo = a & 0xffffffffULL, a_hi = a >> 32, b_lo = b & 0xffffffffULL, b_hi = b >> 32;
+        uint64_t lo_lo = a_lo * b_lo, hi_lo = a_hi * b_lo, lo_hi = a_lo * b_hi;
+        uint64_t cross = (lo_lo >> 32) + (hi_lo & 0xffffffffULL) + lo_hi;
+        return a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+#endif
+    }
+
+    static uint64_t mix(uint64_t z) {
+        z += 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t start;
+};
+
+// Fixed-range histogram as a streaming quantile sketch: counts are integers, so the
+// per-thread sketches add up to the same result in any order. Values off the range
+// are counted at its ends; exact min and max are kept beside it.
+class QuantileSketch {
+public:
+    QuantileSketch() = default;
+
+    QuantileSketch(double lo, double hi, size_t bins) : lo(lo), width((hi - lo) / bins), counts(bins, 0) {
+        if (!(hi > lo) || bins == 0)
+            throw std::invalid_argument("Invalid quantile sketch range");
+    }
+
+    void add(double x) {
+        double b = (x - lo) / width;
+        size_t i = b <= 0 ? 0 : b >= counts.size() ? counts.size() - 1 : static_cast<size_t>(b);
+        ++counts[i];
+        ++n;
+        min = std::min(min, x);
+        max = std::max(max, x);
+    }
+
+    void merge(const QuantileSketch& o) {
+        for (size_t i = 0; i < counts.size(); ++i)
+            counts[i] += o.counts[i];
+        n += o.n;
+        min = std::min(min, o.min);
+        max = std::max(max, o.max);
+    }
+
+    // q in [0, 1], interpolated inside its bin and clamped to the seen min and max
+    double quantile(double q) const {
+        if (n == 0)
+            return 0;
+        double target = q * static_cast<double>(n);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts.size(); ++i) {
+            if (counts[i] && static_cast<double>(seen + counts[i]) >= target) {
+                double frac = (target - static_cast<double>(seen)) / static_cast<double>(counts[i]);
+                return std::min(max, std::max(min, lo + (static_cast<double>(i) + frac) * width));
+            }
+            seen += counts[i];
+        }
+        return max;
+    }
+
+    uint64_t size() const { return n; }
+    double lowest() const { return min; }
+    double highest() const { return max; }
+
+private:
+    double lo = 0;
+    double width = 1;
+    std::vector<uint64_t> counts;
+    uint64_t n = 0;
+    double min = std::numeric_limits<double>::infinity();
+    double max = -std::numeric_limits<double>::infinity();
+};
+
+// Resampled equity curves of a journal's per-trade returns (ret, % of the account).
+//
+//   Iid          draws trades with replacement
+//   Block        circular blocks of `block` consecutive trades, for serial dependence
+//   Permutation  the same trades in a shuffled order (same final return, other paths)
+//
+// Equity starts at 100: additive (100 + sum of ret, as the journal adds returns) or
+// compounded; drawdown is in points of the start (additive) or % of the peak. A path
+// is ruined once equity reaches 100 - ruin_pct.
+//
+// Resamples run in chunks taken by the threads, each chunk `lanes` paths side by
+// side: the draws fill a step-major block and the running max, drawdown and ruin
+// loops run across the lanes, which the compiler vectorizes. Resample i always uses
+// CounterRng(seed, i), quantiles come from QuantileSketch ranges set by a pilot run,
+// and sums are added per chunk in chunk order, so results are identical for any
+// number of threads.
+class MonteCarlo {
+public:
+    enum class Method { Iid, Block, Permutation };
+
+    struct Config {
+        Method method = Method::Iid;
+        size_t resamples = 100000;
+        size_t length = 0;              // trades per path (0: as many as the journal; Permutation: always)
+        size_t block = 10;              // trades per block (Block)
+        bool compound = false;
+        double ruin_pct = 50;
+        uint64_t seed = 1;
+        std::vector<double> quantiles{ 0.01, 0.05, 0.25, 0.5, 0.75, 0.95, 0.99 };
+        size_t band_points = 100;       // equity quantiles at this many steps along the path
+        size_t bins = 4096;             // per sketch
+    };
+
+    struct Distribution {
+        double mean = 0;
+        double sd = 0;
+        double min = 0;
+        double max = 0;
+        std::vector<double> q;          // at Config::quantiles
+    };
+
+    struct Result {
+        size_t trades = 0;
+        size_t length = 0;
+        size_t resamples = 0;
+        std::vector<double> quantiles;
+        Distribution final_return;      // equity at the end - 100
+        Distribution max_drawdown;      // <= 0
+        double ruin_probability = 0;
+        std::vector<size_t> band_steps;     // 1-based trade counts
+        std::vector<std::vector<double>> bands;     // [band point][quantile], equity
+    };
+
+    static Method parse_method(const std::string& s) {
+        if (s == "iid")
+            return Method::Iid;
+        if (s == "block")
+            return Method::Block;
+        if (s == "permutation")
+            return Method::Permutation;
+        throw std::invalid_argument("Invalid resampling method: " + s);
+    }
+
+    MonteCarlo(std::vector<double> returns, const Config& config) : rets(std::move(returns)), config(config) {
+        if (rets.empty())
+            throw std::invalid_argument("Monte Carlo needs at least one trade return");
+        if (config.method == Method::Block && config.block == 0)
+            throw std::invalid_argument("Invalid block size: 0");
+        length = config.method == Method::Permutation || config.length == 0 ? rets.size() : config.length;
+        size_t points = std::max<size_t>(1, std::min(config.band_points, length));
+        for (size_t k = 1; k <= points; ++k)
+            steps.push_back((length * k + points - 1) / points);
+    }
+
+    Result run(size_t threads = 0) const {
+        // pilot: the first resamples set the sketch ranges, a quarter span wider per side
+        std::vector<double> lo, hi;
+        std::tie(lo, hi) = ranges_of(std::min<size_t>(config.resamples, 2048));
+        for (size_t i = 0; i < lo.size(); ++i) {
+            double span = std::max(hi[i] - lo[i], 1e-6 * std::max(1.0, std::fabs(lo[i])));
+            lo[i] -= span / 4;
+            hi[i] += span / 4;
+        }
+
+        const size_t chunks = (config.resamples + chunk - 1) / chunk;
+        std::vector<ChunkSums> sums(chunks);
+        const size_t workers = parallel_workers(chunks, threads);
+        std::vector<Sketches> partial(workers, sketches_for(lo, hi));
+        std::vector<Scratch> scratch(workers, Scratch(length));
+        parallel_indices(chunks, threads, [&](size_t worker, size_t c) {
+            size_t first = c * chunk, last = std::min(config.resamples, first + chunk);
+            for (size_t r = first; r < last; r += lanes)
+                simulate(r, std::min(lanes, last - r), scratch[worker], partial[worker], sums[c]);
+        });
+        for (size_t k = 1; k < partial.size(); ++k)
+            partial[0].merge(partial[k]);
+
+        ChunkSums total;
+        for (const auto& c : sums)
+            total.add(c);
+        Result out;
+        out.trades = rets.size();
+        out.length = length;
+        out.resamples = config.resamples;
+        out.quantiles = config.quantiles;
+        double n = static_cast<double>(std::max<size_t>(config.resamples, 1));
+        out.final_return = describe(partial[0].final_return, total.final_sum / n, total.final_sq / n);
+        out.max_drawdown = describe(partial[0].max_drawdown, total.mdd_sum / n, total.mdd_sq / n);
+        out.ruin_probability = static_cast<double>(total.ruined) / n;
+        out.band_steps = steps;
+        for (const auto& b : partial[0].bands) {
+            out.bands.emplace_back();
+            for (double q : config.quantiles)
+                out.bands.back().push_back(b.quantile(q));
+        }
+        return out;
+    }
+
+private:
+    static constexpr size_t lanes = 16;
+    static constexpr size_t chunk = 1024;
+
+    struct ChunkSums {
+        double final_sum = 0, final_sq = 0;
+        double mdd_sum = 0, mdd_sq = 0;
+        uint64_t ruined = 0;
+
+        void add(const ChunkSums& o) {
+            final_sum += o.final_sum;
+            final_sq += o.final_sq;
+            mdd_sum += o.mdd_sum;
+            mdd_sq += o.mdd_sq;
+            ruined += o.ruined;
+        }
+    };
+
+    struct Sketches {
+        QuantileSketch final_return;
+        QuantileSketch max_drawdown;
+        std::vector<QuantileSketch> bands;
+
+        std::vector<QuantileSketch*> all() {
+            std::vector<QuantileSketch*> v{ &final_return, &max_drawdown };
+            for (auto& b : bands)
+                v.push_back(&b);
+            return v;
+        }
+
+        void merge(const Sketches& o) {
+            final_return.merge(o.final_return);
+            max_drawdown.merge(o.max_drawdown);
+            for (size_t i = 0; i < bands.size(); ++i)
+                bands[i].merge(o.bands[i]);
+        }
+    };
+
+    struct Scratch {
+        explicit Scratch(size_t length) : path(length * lanes), order(length) {}
+        std::vector<double> path;       // step-major: path[t * lanes + lane]
+        std::vector<size_t> order;      // permutation
+    };
+
+    // One sketch per output over [lo, hi], in Sketches::all() order.
+    Sketches sketches_for(const std::vector<double>& lo, const std::vector<double>& hi) const {
+        Sketches s;
+        s.final_return = QuantileSketch(lo[0], hi[0], config.bins);
+        s.max_drawdown = QuantileSketch(lo[1], hi[1], config.bins);
+        for (size_t i = 0; i < steps.size(); ++i)
+            s.bands.emplace_back(lo[2 + i], hi[2 + i], config.bins);
+        return s;
+    }
+
+    // min and max of every output over the first n resamples
+    std::pair<std::vector<double>, std::vector<double>> ranges_of(size_t n) const {
+        size_t outputs = 2 + steps.size();
+        std::vector<double> lo(outputs, 0.0), hi(outputs, 1.0);
+        Sketches s = sketches_for(lo, hi);
+        Scratch scratch(length);
+        ChunkSums ignored;
+        for (size_t r = 0; r < n; r += lanes)
+            simulate(r, std::min(lanes, n - r), scratch, s, ignored);
+        auto all = s.all();
+        for (size_t i = 0; i < outputs; ++i) {
+            lo[i] = all[i]->size() ? all[i]->lowest() : 0;
+            hi[i] = all[i]->size() ? all[i]->highest() : 0;
+        }
+        return { lo, hi };
+    }
+
+    void draw(size_t resample, size_t lane, Scratch& s) const {
+        CounterRng rng(config.seed, resample);
+        const size_t n = rets.size();
+        double* out = s.path.data() + lane;
+        if (config.method == Method::Iid) {
+            for (size_t t = 0; t < length; ++t)
+                out[t * lanes] = rets[rng.below(t, n)];
+        }
+        else if (config.method == Method::Block) {
+            size_t pos = 0;
+            for (size_t t = 0; t < length; ++t, ++pos) {
+                if (t % config.block == 0)
+                    pos = rng.below(t / config.block, n);
+                out[t * lanes] = rets[pos % n];
+            }
+        }
+        else {
+            for (size_t i = 0; i < n; ++i)
+                s.order[i] = i;
+            for (size_t i = n; i > 1; --i)
+                std::swap(s.order[i - 1], s.order[rng.below(n - i, i)]);
+            for (size_t t = 0; t < length; ++t)
+                out[t * lanes] = rets[s.order[t]];
+        }
+    }
+
+    // resamples [first, first + count), count <= lanes
+    void simulate(size_t first, size_t count, Scratch& s, Sketches& sk, ChunkSums& sums) const {
+        for (size_t l = 0; l < count; ++l)
+            draw(first + l, l, s);
+        for (size_t l = count; l < lanes; ++l)
+            for (size_t t = 0; t < length; ++t)
+                s.path[t * lanes + l] = 0;
+
+        double eq[lanes], peak[lanes], mdd[lanes], low[lanes];
+        for (size_t l = 0; l < lanes; ++l)
+            eq[l] = peak[l] = low[l] = 100, mdd[l] = 0;
+        size_t band = 0;
+        for (size_t t = 0; t < length; ++t) {
+            const double* r = s.path.data() + t * lanes;
+            if (config.compound) {
+                for (size_t l = 0; l < lanes; ++l) {
+                    eq[l] *= 1 + r[l] / 100;
+                    peak[l] = std::max(peak[l], eq[l]);
+                    mdd[l] = std::min(mdd[l], (eq[l] / peak[l] - 1) * 100);
+                    low[l] = std::min(low[l], eq[l]);
+                }
+            }
+            else {
+                for (size_t l = 0; l < lanes; ++l) {
+                    eq[l] += r[l];
+                    peak[l] = std::max(peak[l], eq[l]);
+                    mdd[l] = std::min(mdd[l], eq[l] - peak[l]);
+                    low[l] = std::min(low[l], eq[l]);
+                }
+            }
+            if (band < steps.size() && steps[band] == t + 1) {
+                for (size_t l = 0; l < count; ++l)
+                    sk.bands[band].add(eq[l]);
+                ++band;
+            }
+        }
+        for (size_t l = 0; l < count; ++l) {
+            double fin = eq[l] - 100;
+            sk.final_return.add(fin);
+            sk.max_drawdown.add(mdd[l]);
+            sums.final_sum += fin;
+            sums.final_sq += fin * fin;
+            sums.mdd_sum += mdd[l];
+            sums.mdd_sq += mdd[l] * mdd[l];
+            sums.ruined += low[l] <= 100 - config.ruin_pct;
+        }
+    }
+
+    Distribution describe(const QuantileSketch& s, double mean, double mean_sq) const {
+        Distribution d;
+        d.mean = mean;
+        d.sd = std::sqrt(std::max(0.0, mean_sq - mean * mean));
+        d.min = s.size() ? s.lowest() : 0;
+        d.max = s.size() ? s.highest() : 0;
+        for (double q : config.quantiles)
+            d.q.push_back(s.quantile(q));
+        return d;
+    }
+
+    std::vector<double> rets;
+    Config config;
+    size_t length = 0;
+    std::vector<size_t> steps;
+};
+
+// Summary as CSV: one row per distribution (final_return, max_drawdown) with mean, sd,
+// min, max and the quantiles, a ruin_probability row; and the bands as
+// step,q<level>... rows in PREFIX_bands.csv.
+inline void write_monte_carlo_csv(const MonteCarlo::Result& r, const std::string& prefix) {
+    std::ofstream out(prefix + "_summary.csv", std::ios::trunc);
+    std::ofstream bands(prefix + "_bands.csv", std::ios::trunc);
+    if (!out.is_open() || !bands.is_open())
+        throw std::runtime_error("Cannot open output files: " + prefix + "_summary.csv / _bands.csv");
+    out.precision(10);
+    bands.precision(10);
+    out << "metric,mean,sd,min,max";
+    bands << "step";
+    for (double q : r.quantiles) {
+        out << ",q" << q;
+        bands << ",q" << q;
+    }
+    out << "\n";
+    bands << "\n";
+    auto row = [&](const char* name, const MonteCarlo::Distribution& d) {
+        out << name << "," << d.mean << "," << d.sd << "," << d.min << "," << d.max;
+        for (double v : d.q)
+            out << "," << v;
+        out << "\n";
+    };
+    row("final_return", r.final_return);
+    row("max_drawdown", r.max_drawdown);
+    out << "ruin_probability," << r.ruin_probability << "\n";
+    for (size_t i = 0; i < r.band_steps.size(); ++i) {
+        bands << r.band_steps[i];
+        for (double v : r.bands[i])
+            bands << "," << v;
+        bands << "\n";
+    }
+}
+
+// The same as one little-endian file:
+//   "DKMC" u32 version=1, u64 trades, length, resamples, u32 Q, u32 B, f64 ruin_probability
+//   f64 quantiles[Q]
+//   final_return, max_drawdown: f64 mean, sd, min, max, q[Q]
+//   B x (u64 step, f64 q[Q])
+inline void write_monte_carlo_binary(const MonteCarlo::Result& r, const std::string& path) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.is_open())
+        throw std::runtime_error("Cannot open output file: " + path);
+    auto put = [&](const auto& v) { out.write(reinterpret_cast<const char*>(&v), sizeof(v)); };
+    out.write("DKMC", 4);
+    put(uint32_t(1));
+    put(uint64_t(r.trades));
+    put(uint64_t(r.length));
+    put(uint64_t(r.resamples));
+    put(uint32_t(r.quantiles.size()));
+    put(uint32_t(r.band_steps.size()));
+    put(r.ruin_probability);
+    for (double q : r.quantiles)
+        put(q);
+    for (const auto* d : { &r.final_return, &r.max_drawdown }) {
+        put(d->mean);
+        put(d->sd);
+        put(d->min);
+        put(d->max);
+        for (double v : d->q)
+            put(v);
+    }
+    for (size_t i = 0; i < r.band_steps.size(); ++i) {
+        put(uint64_t(r.band_steps[i]));
+        for (double v : r.bands[i])
+            put(v);
+    }
+    if (!out)
+        throw std::runtime_error("Failed to write " + path);
+}
+
+// Per-trade returns from a CSV: the "return" (or "ret") column if the header has
+// one, as in TradeEval's output, else the first column; empty cells are skipped.
+inline std::vector<double> read_returns_csv(const std::string& path) {
+    std::ifstream in(path);
+    if (!in.is_open())
+        throw std::runtime_error("Cannot open returns file " + path);
+    std::vector<double> out;
+    std::string line;
+    size_t column = 0, line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        std::vector<std::string> f;
+        std::stringstream ss(line);
+        std::string cell;
+        while (std::getline(ss, cell, ','))
+            f.push_back(cell);
+        if (line_no == 1) {
+            auto it = std::find_if(f.begin(), f.end(), [](const std::string& s) { return s == "return" || s == "ret"; });
+            if (it != f.end()) {
+                column = static_cast<size_t>(it - f.begin());
+                continue;
+            }
+        }
+        if (column >= f.size() || f[column].empty())
+            continue;
+        char* end;
+        double v = std::strtod(f[column].c_str(), &end);
+        if (end == f[column].c_str()) {
+            if (line_no == 1)
+                continue;
+            throw std::runtime_error("Invalid return on line " + std::to_string(line_no) + " of " + path);
+        }
+        out.push_back(v);
+    }
+    return out;
+}
+
+#endif // DUKASMONTECARLO_HPP
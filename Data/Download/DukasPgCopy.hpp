@@ -0,0 +1,140 @@
+#ifndef DUKASPGCOPY_HPP
+#define DUKASPGCOPY_HPP
+
+#include <libpq-fe.h>
+#include <stdexcept>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Streams rows of (timestamp, double...) into a table with
+// COPY ... FROM STDIN (FORMAT binary), one transaction per flush.
+// flush_rows == 0 means the caller decides via end_batch() (one commit per hour);
+// otherwise a commit is issued every flush_rows rows as well.
+class PgCopyWriter {
+public:
+    PgCopyWriter(PGconn* conn, const std::string& table, size_t flush_rows = 0)
+        : conn(conn), table(table), flush_rows(flush_rows)
+    {
+        buffer.reserve(buffer_limit + 256);
+    }
+
+    ~PgCopyWriter() {
+        if (in_copy) {
+            // never commit half a batch from a destructor, roll it back instead
+            PQputCopyEnd(conn, "writer destroyed");
+            while (PGresult* res = PQgetResult(conn))
+                PQclear(res);
+            exec("ROLLBACK", PGRES_COMMAND_OK, false);
+        }
+    }
+
+    PgCopyWriter(const PgCopyWriter&) = delete;
+    PgCopyWriter& operator=(const PgCopyWriter&) = delete;
+
+    void add_row(int64_t ts_ms, const double* values, size_t n) {
+        if (!in_copy)
+            begin();
+        put_be16(static_cast<int16_t>(1 + n));
+        put_be32(8);
+        put_be64(static_cast<uint64_t>((ts_ms - pg_epoch_ms) * 1000)); // microseconds since 2000-01-01
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t bits;
+            std::memcpy(&bits, &values[i], 8);
+            put_be32(8);
+            put_be64(bits);
+        }
+        ++batch_rows;
+        if (buffer.size() >= buffer_limit)
+            send();
+        if (flush_rows && batch_rows >= flush_rows)
+            commit();
+    }
+
+    // End of a logical batch (an hour): commits unless a row-count flush size is set.
+    void end_batch() {
+        if (flush_rows == 0)
+            commit();
+    }
+
+    void commit() {
+        if (!in_copy)
+            return;
+        put_be16(-1);
+        send();
+        if (PQputCopyEnd(conn, nullptr) != 1)
+            throw std::runtime_error("Failed to end COPY: " + std::string(PQerrorMessage(conn)));
+        PGresult* res = PQgetResult(conn);
+        bool ok = PQresultStatus(res) == PGRES_COMMAND_OK;
+        PQclear(res);
+        while (PGresult* extra = PQgetResult(conn))
+            PQclear(extra);
+        in_copy = false;
+        if (!ok) {
+            exec("ROLLBACK", PGRES_COMMAND_OK, false);
+            throw std::runtime_error("COPY into \"" + table + "\" failed: " + std::string(PQerrorMessage(conn)));
+        }
+        exec("COMMIT", PGRES_COMMAND_OK);
+        total_rows += batch_rows;
+        batch_rows = 0;
+    }
+
+    size_t rows_committed() const { return total_rows; }
+
+private:
+    static constexpr int64_t pg_epoch_ms = 946684800000LL;
+    static constexpr size_t buffer_limit = 1 << 20;
+
+    void begin() {
+        exec("BEGIN", PGRES_COMMAND_OK);
+        exec("COPY \"" + table + "\" FROM STDIN (FORMAT binary)", PGRES_COPY_IN);
+        in_copy = true;
+        static const char header[] = "PGCOPY\n\377\r\n";
+        buffer.insert(buffer.end(), header, header + 11);
+        put_be32(0); // flags
+        put_be32(0); // header extension length
+    }
+
+    void send() {
+        if (buffer.empty())
+            return;
+        if (PQputCopyData(conn, buffer.data(), static_cast<int>(buffer.size())) != 1)
+            throw std::runtime_error("Failed to send COPY data: " + std::string(PQerrorMessage(conn)));
+        buffer.clear();
+    }
+
+    void exec(const std::string& sql, ExecStatusType expected, bool throw_on_error = true) {
+        PGresult* res = PQexec(conn, sql.c_str());
+        bool ok = PQresultStatus(res) == expected;
+        PQclear(res);
+        if (!ok && throw_on_error)
+            throw std::runtime_error("Failed to execute \"" + sql + "\": " + std::string(PQerrorMessage(conn)));
+    }
+
+    void put_be16(int16_t v) {
+        uint16_t u = static_cast<uint16_t>(v);
+        buffer.push_back(static_cast<char>(u >> 8));
+        buffer.push_back(static_cast<char>(u));
+    }
+
+    void put_be32(uint32_t v) {
+        char b[4] = { char(v >> 24), char(v >> 16), char(v >> 8), char(v) };
+        buffer.insert(buffer.end(), b, b + 4);
+    }
+
+    void put_be64(uint64_t v) {
+        put_be32(static_cast<uint32_t>(v >> 32));
+        put_be32(static_cast<uint32_t>(v));
+    }
+
+    PGconn* conn;
+    std::string table;
+    size_t flush_rows;
+    std::vector<char> buffer;
+    bool in_copy = false;
+    size_t batch_rows = 0;
+    size_t total_rows = 0;
+};
+
+#endif // DUKASPGCOPY_HPP
@@ -0,0 +1,209 @@
+#ifndef DUKASPGPIPELINE_HPP
+#define DUKASPGPIPELINE_HPP
+
+#include <libpq-fe.h>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <deque>
+#include <chrono>
+
+// Low-latency inserts for livestream mode using libpq pipeline mode (PostgreSQL 14+).
+// One writer owns the connection's pipeline; each target table gets a prepared
+// statement from prepare(). A batch is queued as BEGIN, one INSERT per row, COMMIT and a sync
+// point, without waiting for the server. poll() collects acknowledgements
+// without blocking, so the caller can go back to the network right away, and
+// reports the lag between each committed batch's ticks and its commit.
+class PgPipelineWriter {
+public:
+    struct CommitReport {
+        size_t rows = 0;
+        int64_t oldest_ts_ms = 0;
+        int64_t newest_ts_ms = 0;
+        int64_t committed_ms = 0;
+
+        int64_t newest_lag_ms() const { return committed_ms - newest_ts_ms; }
+        int64_t oldest_lag_ms() const { return committed_ms - oldest_ts_ms; }
+    };
+
+    explicit PgPipelineWriter(PGconn* conn) : conn(conn) {
+        if (PQpipelineStatus(conn) == PQ_PIPELINE_OFF && PQenterPipelineMode(conn) != 1)
+            throw std::runtime_error("Failed to enter pipeline mode: " + std::string(PQerrorMessage(conn)));
+    }
+
+    // Prepares "INSERT INTO table VALUES (timestamp, value_columns x float8)" and
+    // returns the id to pass to add_row. The result is collected with the next sync.
+    size_t prepare(const std::string& table, size_t value_columns) {
+        Statement st;
+        st.name = "dukas_live_" + std::to_string(statements.size());
+        st.columns = value_columns;
+        std::string sql = "INSERT INTO \"" + table + "\" VALUES ($1";
+        std::vector<Oid> types = { 1114 }; // timestamp
+        for (size_t i = 0; i < value_columns; ++i) {
+            sql += ",$" + std::to_string(i + 2);
+            types.push_back(701); // float8
+        }
+        sql += ")";
+        if (PQsendPrepare(conn, st.name.c_str(), sql.c_str(), static_cast<int>(types.size()), types.data()) != 1)
+            throw std::runtime_error("Failed to prepare live insert: " + std::string(PQerrorMessage(conn)));
+        st.params.resize(8 * (1 + value_columns));
+        for (size_t i = 0; i <= value_columns; ++i)
+            st.param_values.push_back(&st.params[8 * i]);
+        st.param_lengths.assign(1 + value_columns, 8);
+        st.param_formats.assign(1 + value_columns, 1);
+        statements.push_back(std::move(st));
+        unsynced = true;
+        return statements.size() - 1;
+    }
+
+    ~PgPipelineWriter() {
+        try {
+            drain();
+        }
+        catch (...) {
+        }
+        PQexitPipelineMode(conn);
+    }
+
+    PgPipelineWriter(const PgPipelineWriter&) = delete;
+    PgPipelineWriter& operator=(const PgPipelineWriter&) = delete;
+
+    void add_row(size_t statement, int64_t ts_ms, const double* values, size_t n) {
+        Statement& st = statements.at(statement);
+        if (n != st.columns)
+            throw std::invalid_argument("Live insert expects " + std::to_string(st.columns) + " values per row");
+        if (!open_batch) {
+            send("BEGIN");
+            open = Batch{ 0, ts_ms, ts_ms };
+            open_batch = true;
+        }
+        put_be64(&st.params[0], static_cast<uint64_t>((ts_ms - pg_epoch_ms) * 1000));
+        for (size_t i = 0; i < n; ++i) {
+            uint64_t bits;
+            std::memcpy(&bits, &values[i], 8);
+            put_be64(&st.params[8 * (i + 1)], bits);
+        }
+        if (PQsendQueryPrepared(conn, st.name.c_str(), static_cast<int>(1 + n), st.param_values.data(), st.param_lengths.data(), st.param_formats.data(), 0) != 1)
+            throw std::runtime_error("Failed to queue live insert: " + std::string(PQerrorMessage(conn)));
+        open.rows++;
+        open.oldest_ts_ms = std::min(open.oldest_ts_ms, ts_ms);
+        open.newest_ts_ms = std::max(open.newest_ts_ms, ts_ms);
+    }
+
+    // Queues COMMIT and a sync point for the rows added since the last call.
+    void end_batch() {
+        if (!open_batch)
+            return;
+        send("COMMIT");
+        if (PQpipelineSync(conn) != 1)
+            throw std::runtime_error("Failed to sync pipeline: " + std::string(PQerrorMessage(conn)));
+        PQflush(conn);
+        in_flight.push_back(open);
+        open_batch = false;
+        unsynced = false;
+    }
+
+    // Non-blocking: appends a report for every batch whose COMMIT has been acknowledged.
+    void poll(std::vector<CommitReport>& out) {
+        if (PQconsumeInput(conn) != 1)
+            throw std::runtime_error("Lost connection in pipeline: " + std::string(PQerrorMessage(conn)));
+        collect(out, false);
+    }
+
+    // Blocks until every queued batch has been acknowledged. Prepares not followed by
+    // a batch get a sync point of their own, so no result is left unread.
+    void drain(std::vector<CommitReport>* out = nullptr) {
+        end_batch();
+        if (unsynced) {
+            if (PQpipelineSync(conn) != 1)
+                throw std::runtime_error("Failed to sync pipeline: " + std::string(PQerrorMessage(conn)));
+            PQflush(conn);
+            in_flight.push_back(Batch());
+            unsynced = false;
+        }
+        std::vector<CommitReport> reports;
+        collect(reports, true);
+        if (out)
+            out->insert(out->end(), reports.begin(), reports.end());
+    }
+
+    size_t batches_in_flight() const { return in_flight.size(); }
+
+private:
+    struct Statement {
+        std::string name;
+        size_t columns = 0;
+        std::vector<char> params;
+        std::vector<const char*> param_values;
+        std::vector<int> param_lengths;
+        std::vector<int> param_formats;
+    };
+
+    struct Batch {
+        size_t rows = 0;
+        int64_t oldest_ts_ms = 0;
+        int64_t newest_ts_ms = 0;
+    };
+
+    static constexpr int64_t pg_epoch_ms = 946684800000LL;
+
+    static void put_be64(char* dst, uint64_t v) {
+        for (int i = 7; i >= 0; --i) {
+            dst[i] = static_cast<char>(v & 0xff);
+            v >>= 8;
+        }
+    }
+
+    void send(const char* sql) {
+        if (PQsendQueryParams(conn, sql, 0, nullptr, nullptr, nullptr, nullptr, 0) != 1)
+            throw std::runtime_error(std::string("Failed to queue ") + sql + ": " + PQerrorMessage(conn));
+    }
+
+    void collect(std::vector<CommitReport>& out, bool block) {
+        while (!in_flight.empty()) {
+            if (!block && PQisBusy(conn))
+                return;
+            PGresult* res = PQgetResult(conn);
+            if (!res)
+                continue; // end of one query's results, more are queued
+            ExecStatusType status = PQresultStatus(res);
+            if (status == PGRES_FATAL_ERROR || status == PGRES_PIPELINE_ABORTED) {
+                if (error.empty())
+                    error = PQresultErrorMessage(res);
+            }
+            PQclear(res);
+            if (status != PGRES_PIPELINE_SYNC)
+                continue;
+
+            Batch done = in_flight.front();
+            in_flight.pop_front();
+            if (!error.empty()) {
+                std::string message = error;
+                error.clear();
+                throw std::runtime_error("Live insert batch failed: " + message);
+            }
+            if (done.rows == 0)
+                continue; // prepares only
+            CommitReport report;
+            report.rows = done.rows;
+            report.oldest_ts_ms = done.oldest_ts_ms;
+            report.newest_ts_ms = done.newest_ts_ms;
+            report.committed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            out.push_back(report);
+        }
+    }
+
+    PGconn* conn;
+    std::vector<Statement> statements;
+    Batch open;
+    bool open_batch = false;
+    bool unsynced = false;          // queued since the last sync point (prepares)
+    std::deque<Batch> in_flight;
+    std::string error;
+};
+
+#endif // DUKASPGPIPELINE_HPP
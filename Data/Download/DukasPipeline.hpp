@@ -0,0 +1,309 @@
+#ifndef DUKASPIPELINE_HPP
+#define DUKASPIPELINE_HPP
+
+#include <stdexcept>
+#include <exception>
+#include <functional>
+#include <algorithm>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <chrono>
+#include <mutex>
+#include <map>
+#include <ctime>
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Bounded lock-free multi-producer/multi-consumer ring (Vyukov). Capacity is
+// rounded up to a power of two; try_push fails instead of growing.
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) {
+        size_t cap = 2;
+        while (cap < capacity)
+            cap <<= 1;
+        mask = cap - 1;
+        cells.reset(new Cell[cap]);
+        for (size_t i = 0; i < cap; ++i)
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    bool try_push(T&& value) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    bool try_pop(T& out) {
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    out = std::move(cell.data);
+                    cell.sequence.store(pos + mask + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if (diff < 0)
+                return false;
+            else
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+        }
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> enqueue_pos{ 0 };
+    alignas(64) std::atomic<size_t> dequeue_pos{ 0 };
+};
+
+// CPU time consumed so far by the calling thread, for per-stage accounting.
+inline uint64_t thread_cpu_ns() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user))
+        return 0;
+    auto ticks = [](const FILETIME& f) { return (static_cast<uint64_t>(f.dwHighDateTime) << 32) | f.dwLowDateTime; };
+    return (ticks(kernel) + ticks(user)) * 100;
+#else
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return 0;
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+#endif
+}
+
+// spin, then yield, then sleep: keeps idle stages off the CPU without a mutex
+inline void pipeline_backoff(unsigned& spins) {
+    if (spins < 64) {
+        ++spins;
+        return;
+    }
+    if (spins < 128) {
+        ++spins;
+        std::this_thread::yield();
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+}
+
+// Threads parallel_indices runs for n items: `threads`, 0 meaning one per core, and
+// no more than there are items.
+inline size_t parallel_workers(size_t n, size_t threads) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    return std::min(threads, std::max<size_t>(n, 1));
+}
+
+// Calls fn(worker, i) for every i in [0, n), on parallel_workers(n, threads) threads
+// including the calling one; each takes the next index as it finishes one, so items
+// of uneven cost balance out. worker (0 for the caller) indexes per-thread state. The
+// first exception thrown stops the others from taking new items and is rethrown here.
+template <typename Fn>
+void parallel_indices(size_t n, size_t threads, Fn&& fn) {
+    const size_t workers = parallel_workers(n, threads);
+    std::atomic<size_t> next{ 0 };
+    std::mutex failure_mutex;
+    std::exception_ptr failure;
+    auto work = [&](size_t worker) {
+        try {
+            for (size_t i; (i = next.fetch_add(1)) < n;)
+                fn(worker, i);
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(failure_mutex);
+            if (!failure)
+                failure = std::current_exception();
+            next.store(n);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (size_t k = 1; k < workers; ++k)
+        pool.emplace_back(work, k);
+    work(0);
+    for (auto& t : pool)
+        t.join();
+    if (failure)
+        std::rethrow_exception(failure);
+}
+
+// Three-stage pipeline: one producer thread, decode_threads parallel transform
+// workers and an ordered consumer running on the calling thread. Items are handed
+// to the consumer in the order the producer emitted them. At most max_buffered
+// items exist between emit() and the end of consume(), so memory stays bounded
+// when the consumer is slower than the producer.
+template <typename Item>
+class HourPipeline {
+public:
+    struct Config {
+        size_t decode_threads = 2;
+        size_t max_buffered = 32;
+    };
+
+    // returns false once the pipeline is aborting, the producer should then return
+    using Emit = std::function<bool(Item&&)>;
+
+    explicit HourPipeline(const Config& config)
+        : config(config),
+          to_decode(std::max<size_t>(1, config.max_buffered)),
+          to_write(std::max<size_t>(1, config.max_buffered)) {}
+
+    void run(const std::function<void(const Emit&)>& produce,
+             const std::function<void(Item&)>& transform,
+             const std::function<void(Item&)>& consume) {
+        size_t max_buffered = std::max<size_t>(1, config.max_buffered);
+        size_t workers = std::max<size_t>(1, config.decode_threads);
+        active_workers.store(workers);
+
+        std::thread producer([&]() {
+            guard([&]() {
+                size_t seq = 0;
+                Emit emit = [&](Item&& item) {
+                    unsigned spins = 0;
+                    while (buffered.load(std::memory_order_acquire) >= max_buffered) {
+                        if (aborted.load())
+                            return false;
+                        pipeline_backoff(spins);
+                    }
+                    buffered.fetch_add(1, std::memory_order_acq_rel);
+                    Sequenced entry{ seq++, std::move(item) };
+                    spins = 0;
+                    while (!to_decode.try_push(std::move(entry))) {
+                        if (aborted.load())
+                            return false;
+                        pipeline_backoff(spins);
+                    }
+                    return !aborted.load();
+                };
+                produce(emit);
+            });
+            producer_done.store(true, std::memory_order_release);
+        });
+
+        std::vector<std::thread> decoders;
+        for (size_t i = 0; i < workers; ++i) {
+            decoders.emplace_back([&]() {
+                guard([&]() {
+                    Sequenced entry;
+                    unsigned spins = 0;
+                    while (!aborted.load()) {
+                        if (!to_decode.try_pop(entry)) {
+                            // the producer publishes done after its last push, so one more pop drains it
+                            if (!producer_done.load(std::memory_order_acquire)) {
+                                pipeline_backoff(spins);
+                                continue;
+                            }
+                            if (!to_decode.try_pop(entry))
+                                break;
+                        }
+                        transform(entry.item);
+                        spins = 0;
+                        while (!to_write.try_push(std::move(entry))) {
+                            if (aborted.load())
+                                return;
+                            pipeline_backoff(spins);
+                        }
+                        spins = 0;
+                    }
+                });
+                active_workers.fetch_sub(1, std::memory_order_acq_rel);
+            });
+        }
+
+        guard([&]() {
+            std::map<size_t, Item> reorder;
+            size_t next_seq = 0;
+            Sequenced entry;
+            unsigned spins = 0;
+            while (!aborted.load()) {
+                if (!to_write.try_pop(entry)) {
+                    if (active_workers.load(std::memory_order_acquire) != 0) {
+                        pipeline_backoff(spins);
+                        continue;
+                    }
+                    if (!to_write.try_pop(entry))
+                        break;
+                }
+                spins = 0;
+                reorder.emplace(entry.seq, std::move(entry.item));
+                for (auto it = reorder.find(next_seq); it != reorder.end(); it = reorder.find(next_seq)) {
+                    consume(it->second);
+                    reorder.erase(it);
+                    ++next_seq;
+                    buffered.fetch_sub(1, std::memory_order_acq_rel);
+                }
+            }
+        });
+
+        producer.join();
+        for (auto& decoder : decoders)
+            decoder.join();
+        if (failure)
+            std::rethrow_exception(failure);
+    }
+
+private:
+    struct Sequenced {
+        size_t seq = 0;
+        Item item;
+    };
+
+    template <typename Fn>
+    void guard(Fn&& fn) {
+        try {
+            fn();
+        }
+        catch (...) {
+            std::lock_guard<std::mutex> lock(failure_mutex);
+            if (!failure)
+                failure = std::current_exception();
+            aborted.store(true);
+        }
+    }
+
+    Config config;
+    BoundedQueue<Sequenced> to_decode;
+    BoundedQueue<Sequenced> to_write;
+    std::atomic<size_t> buffered{ 0 };
+    std::atomic<size_t> active_workers{ 0 };
+    std::atomic<bool> producer_done{ false };
+    std::atomic<bool> aborted{ false };
+    std::mutex failure_mutex;
+    std::exception_ptr failure;
+};
+
+#endif // DUKASPIPELINE_HPP
@@ -0,0 +1,404 @@
+#ifndef DUKASQUALITY_HPP
+#define DUKASQUALITY_HPP
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <cmath>
+
+#include "DukasDecoder.hpp"
+
+// Median of the last `window` integer keys (prices in points). The keys are counted
+// in a histogram of `range` slots around the median, and the median is a cursor on it
+// with the number of keys below it: a push moves the cursor by a slot or two, so an
+// update costs the same for any window. Keys outside the histogram (spikes) are only
+// counted as far below or above; when the cursor nears an edge after a level shift,
+// the histogram is rebuilt around the exact median of the window.
+class RollingMedian {
+public:
+    explicit RollingMedian(size_t window = 64, int64_t range = 1 << 14)
+        : ring(std::max<size_t>(window, 3)), hist(static_cast<size_t>(range)), range(range)
+    {
+        scratch.reserve(ring.size());
+    }
+
+    void push(int64_t key) {
+        if (count == 0) {
+            mid = key;
+            base = key - range / 2;
+        }
+        if (count == ring.size())
+            remove(ring[head]);
+        else
+            ++count;
+        ring[head] = key;
+        head = head + 1 == ring.size() ? 0 : head + 1;
+        insert(key);
+        settle();
+    }
+
+    size_t size() const { return count; }
+    int64_t median() const { return mid; }
+
+    void clear() {
+        std::fill(hist.begin(), hist.end(), 0u);
+        head = count = below = far_below = far_above = 0;
+    }
+
+    // Median absolute deviation from the median, scanning the histogram outwards.
+    int64_t mad() const {
+        size_t need = count / 2 + 1;
+        size_t seen = at(mid);
+        int64_t d = 0;
+        while (seen < need && d < range / 2) {
+            ++d;
+            seen += at(mid - d) + at(mid + d);
+        }
+        return d;
+    }
+
+private:
+    uint32_t at(int64_t key) const {
+        return key >= base && key < base + range ? hist[static_cast<size_t>(key - base)] : 0;
+    }
+
+    void insert(int64_t key) {
+        if (key < base)
+            ++far_below;
+        else if (key >= base + range)
+            ++far_above;
+        else
+            ++hist[static_cast<size_t>(key - base)];
+        if (key < mid)
+            ++below;
+    }
+
+    void remove(int64_t key) {
+        if (key < base)
+            --far_below;
+        else if (key >= base + range)
+            --far_above;
+        else
+            --hist[static_cast<size_t>(key - base)];
+        if (key < mid)
+            --below;
+    }
+
+    // moves the cursor until below <= count / 2 < below + at(mid)
+    void settle() {
+        size_t rank = count / 2;
+        while (below > rank) {
+            if (mid <= base)
+                return rebuild();
+            --mid;
+            below -= at(mid);
+        }
+        while (below + at(mid) <= rank) {
+            below += at(mid);
+            ++mid;
+            if (mid >= base + range)
+                return rebuild();
+        }
+        if (mid - base < range / 8 || mid - base >= range - range / 8)
+            rebuild();
+    }
+
+    void rebuild() {
+        scratch.assign(ring.begin(), ring.begin() + count);
+        std::nth_element(scratch.begin(), scratch.begin() + count / 2, scratch.end());
+        mid = scratch[count / 2];
+        base = mid - range / 2;
+        std::fill(hist.begin(), hist.end(), 0u);
+        far_below = far_above = below = 0;
+        for (size_t i = 0; i < count; ++i)
+            insert(ring[i]);
+    }
+
+    std::vector<int64_t> ring;
+    std::vector<uint32_t> hist;
+    std::vector<int64_t> scratch;
+    int64_t range;
+    int64_t base = 0;
+    int64_t mid = 0;
+    size_t head = 0;
+    size_t count = 0;
+    size_t below = 0;
+    size_t far_below = 0;
+    size_t far_above = 0;
+};
+
+// Why a tick was flagged; a tick can carry several.
+enum TickFlag : uint8_t {
+    TickNonPositive = 1,    // ask or bid <= 0 (or NaN)
+    TickCrossed = 2,        // ask < bid
+    TickSpike = 4,          // mid too far from the rolling median (Hampel), and back within confirm_ticks
+    TickWideSpread = 8,     // spread above its bounds
+    TickStale = 16          // the same quote repeated more than stale_repeats times
+};
+
+// Streaming tick-quality filter, run on every batch in time order before the ticks
+// reach any output. State carries over batch boundaries, so hours are judged with the
+// end of the previous one. Prices are compared in points (mid as ask + bid points).
+// Per tick it costs one update of two RollingMedians (mid and spread); the MAD is
+// recomputed every 8 ticks or when a tick is near the spike bound. It runs well above
+// the single-thread .bi5 decode rate (see QualityBench).
+//
+// A tick off the spike bound is only a spike if the price comes back: confirm_ticks
+// such ticks in a row on the same side are a real move (news, a gap), are kept clean
+// and restart the medians at the new level. A run still open at the end of a batch
+// cannot be confirmed and stays flagged. A pause of reset_gap_ms (weekend, halt) also
+// restarts the medians.
+//
+//   Flag    keeps every tick, flags() tells which ones are suspect (the downloader
+//           writes them to ASSET_flags.csv)
+//   Drop    removes flagged ticks from the batch
+//   Repair  gives bad prices the last clean quote, keeping time and volumes (flags()
+//           still marks them); stale repeats and ticks before any clean quote are dropped
+class TickFilter {
+public:
+    enum class Action { Flag, Drop, Repair };
+
+    struct Config {
+        Action action = Action::Flag;
+        double point = 0;               // price point of the asset (1 / tick size), required
+        size_t window = 64;             // ticks in the rolling median / MAD
+        size_t warmup = 16;             // ticks seen before spikes and spreads are judged
+        double spike_k = 8.0;           // spike: |mid - median| > spike_k * 1.4826 * MAD
+        size_t confirm_ticks = 3;       // ticks off the bound on one side that make a level shift
+        int64_t reset_gap_ms = 15 * 60000;  // pause that restarts the medians (0: off)
+        double min_mad = 2e-5;          // MAD floor relative to the median, for flat markets
+        double spread_k = 10.0;         // wide: spread > spread_k * median spread, 1 point at least (0: off)
+        double max_spread = 0;          // wide: spread above this, in price units (0: off)
+        size_t stale_repeats = 0;       // identical quotes in a row before they are stale (0: off)
+    };
+
+    // Flag counts of some span of ticks (a tick with several flags counts in each).
+    struct Counts {
+        uint64_t ticks = 0;
+        uint64_t nonpositive = 0;
+        uint64_t crossed = 0;
+        uint64_t spikes = 0;
+        uint64_t wide_spread = 0;
+        uint64_t stale = 0;
+        uint64_t flagged = 0;
+        uint64_t dropped = 0;
+        uint64_t repaired = 0;
+
+        void add(const Counts& o) {
+            ticks += o.ticks;
+            nonpositive += o.nonpositive;
+            crossed += o.crossed;
+            spikes += o.spikes;
+            wide_spread += o.wide_spread;
+            stale += o.stale;
+            flagged += o.flagged;
+            dropped += o.dropped;
+            repaired += o.repaired;
+        }
+    };
+
+    static Action parse_action(const std::string& s) {
+        if (s == "flag")
+            return Action::Flag;
+        if (s == "drop")
+            return Action::Drop;
+        if (s == "repair")
+            return Action::Repair;
+        throw std::invalid_argument("Invalid tick filter action: " + s);
+    }
+
+    explicit TickFilter(const Config& config)
+        : config(config), mids(config.window), spreads(config.window)
+    {
+        if (!(config.point > 0))
+            throw std::invalid_argument("Tick filter needs the price point of the asset");
+    }
+
+    const Config& settings() const { return config; }
+
+    // Checks ticks in place and applies the action.
+    void apply(TickBatch& ticks) {
+        const size_t n = ticks.size();
+        judge(ticks);
+        const bool keep_flags = config.action != Action::Drop;
+        size_t w = 0;
+        for (size_t i = 0; i < n; ++i) {
+            double a = ticks.ask[i], b = ticks.bid[i];
+            uint8_t f = tick_flags[i];
+            ++hour_counts.ticks;
+            if (f) {
+                ++hour_counts.flagged;
+                hour_counts.nonpositive += (f & TickNonPositive) != 0;
+                hour_counts.crossed += (f & TickCrossed) != 0;
+                hour_counts.spikes += (f & TickSpike) != 0;
+                hour_counts.wide_spread += (f & TickWideSpread) != 0;
+                hour_counts.stale += (f & TickStale) != 0;
+            }
+            else {
+                good_ask = a;
+                good_bid = b;
+                has_good = true;
+            }
+
+            if (f && config.action == Action::Drop) {
+                ++hour_counts.dropped;
+                continue;
+            }
+            if (f && config.action == Action::Repair) {
+                if ((f & TickStale) || !has_good) {
+                    ++hour_counts.dropped;
+                    continue;
+                }
+                a = good_ask;
+                b = good_bid;
+                ++hour_counts.repaired;
+            }
+            if (w != i) {
+                ticks.ts_ms[w] = ticks.ts_ms[i];
+                ticks.ask_vol[w] = ticks.ask_vol[i];
+                ticks.bid_vol[w] = ticks.bid_vol[i];
+            }
+            ticks.ask[w] = a;
+            ticks.bid[w] = b;
+            if (keep_flags)
+                tick_flags[w] = f;
+            ++w;
+        }
+        tick_flags.resize(keep_flags ? w : 0);
+        if (w != n)
+            ticks.resize(w);
+    }
+
+    // TickFlag bits of each tick of the last batch as apply() left it (empty for Drop).
+    const std::vector<uint8_t>& flags() const { return tick_flags; }
+
+    // Counts since the last end_hour(), and of the whole run.
+    const Counts& hour() const { return hour_counts; }
+    const Counts& total() const { return total_counts; }
+
+    void end_hour() {
+        total_counts.add(hour_counts);
+        hour_counts = Counts();
+    }
+
+private:
+    // Flags of every tick of the batch into tick_flags, before any is dropped.
+    void judge(const TickBatch& ticks) {
+        const size_t n = ticks.size();
+        const double spike_scale = config.spike_k * 1.4826;
+        tick_flags.assign(n, 0);
+        run_rows.clear();
+        for (size_t i = 0; i < n; ++i) {
+            if (config.reset_gap_ms > 0 && has_ts && ticks.ts_ms[i] - last_ts >= config.reset_gap_ms)
+                restart();
+            last_ts = ticks.ts_ms[i];
+            has_ts = true;
+            double a = ticks.ask[i], b = ticks.bid[i];
+            uint8_t& f = tick_flags[i];
+            if (!(a > 0 && b > 0))
+                f |= TickNonPositive;
+            else {
+                int64_t ak = std::llround(a * config.point), bk = std::llround(b * config.point);
+                int64_t mid = ak + bk, spread = ak - bk;
+                if (spread < 0)
+                    f |= TickCrossed;
+                else {
+                    if (mids.size() >= config.warmup) {
+                        double med = static_cast<double>(mids.median());
+                        double floor = config.min_mad * med;
+                        double dev = std::fabs(static_cast<double>(mid) - med);
+                        if (++since_mad >= 8) {
+                            cached_mad = static_cast<double>(mids.mad());
+                            since_mad = 0;
+                        }
+                        bool off = false;
+                        if (dev > spike_scale * std::max(cached_mad, floor)) {
+                            cached_mad = static_cast<double>(mids.mad());
+                            since_mad = 0;
+                            off = dev > spike_scale * std::max(cached_mad, floor);
+                        }
+                        if (off && !level_shift(i, mid, static_cast<double>(mid) > med))
+                            f |= TickSpike;
+                        else if (!off) {
+                            run_rows.clear();
+                            run_length = 0;
+                        }
+                        if (config.spread_k > 0 && spread > config.spread_k * std::max<double>(static_cast<double>(spreads.median()), 1.0))
+                            f |= TickWideSpread;
+                    }
+                    if (config.max_spread > 0 && a - b > config.max_spread)
+                        f |= TickWideSpread;
+                    mids.push(mid);
+                    spreads.push(spread);
+                }
+            }
+            if (config.stale_repeats > 0 && a == last_ask && b == last_bid) {
+                if (++repeats > config.stale_repeats)
+                    f |= TickStale;
+            }
+            else
+                repeats = 0;
+            last_ask = a;
+            last_bid = b;
+        }
+    }
+
+    // Extends the run of ticks off the bound on one side with row i; once it is
+    // confirm_ticks long the move is real: its rows in this batch lose TickSpike and the
+    // mid median restarts from the run. Returns true for such a confirmed tick.
+    bool level_shift(size_t i, int64_t mid, bool above) {
+        if (run_length == 0 || above != run_above) {
+            run_rows.clear();
+            run_mids.clear();
+            run_length = 0;
+            run_above = above;
+        }
+        ++run_length;
+        run_rows.push_back(i);
+        run_mids.push_back(mid);
+        if (run_length < std::max<size_t>(config.confirm_ticks, 1))
+            return false;
+        for (size_t r : run_rows)
+            tick_flags[r] &= static_cast<uint8_t>(~TickSpike);
+        mids.clear();
+        for (size_t k = 0; k + 1 < run_mids.size(); ++k)
+            mids.push(run_mids[k]);     // this tick's mid is pushed by judge()
+        since_mad = 8;
+        run_rows.clear();
+        run_mids.clear();
+        run_length = 0;
+        return true;
+    }
+
+    void restart() {
+        mids.clear();
+        spreads.clear();
+        since_mad = 8;
+        run_rows.clear();
+        run_mids.clear();
+        run_length = 0;
+    }
+
+    Config config;
+    RollingMedian mids;
+    RollingMedian spreads;
+    double cached_mad = 0;
+    unsigned since_mad = 8;
+    double last_ask = 0, last_bid = 0;
+    size_t repeats = 0;
+    double good_ask = 0, good_bid = 0;
+    bool has_good = false;
+    int64_t last_ts = 0;
+    bool has_ts = false;
+    size_t run_length = 0;          // ticks off the bound in a row, on the run_above side
+    bool run_above = false;
+    std::vector<size_t> run_rows;   // of them, the rows in the current batch
+    std::vector<int64_t> run_mids;
+    std::vector<uint8_t> tick_flags;
+    Counts hour_counts;
+    Counts total_counts;
+};
+
+#endif // DUKASQUALITY_HPP
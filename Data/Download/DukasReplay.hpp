@@ -0,0 +1,434 @@
+#ifndef DUKASREPLAY_HPP
+#define DUKASREPLAY_HPP
+
+#include <unordered_map>
+#include <system_error>
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <cstdio>
+#include <cmath>
+#include <ctime>
+#include <lzma.h>
+
+#include "DukasDecoder.hpp"
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <poll.h>
+#endif
+
+// Compresses ticks of one hour into a datafeed .bi5 file (LZMA "alone" container of
+// big-endian 20-byte records, prices in integer points).
+inline std::vector<uint8_t> encode_bi5(const TickBatch& ticks, int64_t hour_ms, double point, uint32_t preset = 6) {
+    std::vector<uint8_t> raw(ticks.size() * Bi5Decoder::record_size);
+    for (size_t i = 0; i < ticks.size(); ++i) {
+        float av = ticks.ask_vol[i], bv = ticks.bid_vol[i];
+        uint32_t w[5] = {
+            static_cast<uint32_t>(ticks.ts_ms[i] - hour_ms),
+            static_cast<uint32_t>(std::llround(ticks.ask[i] * point)),
+            static_cast<uint32_t>(std::llround(ticks.bid[i] * point)), 0, 0 };
+        std::memcpy(&w[3], &av, 4);
+        std::memcpy(&w[4], &bv, 4);
+        uint8_t* out = raw.data() + i * Bi5Decoder::record_size;
+        for (uint32_t v : w) {
+            out[0] = static_cast<uint8_t>(v >> 24);
+            out[1] = static_cast<uint8_t>(v >> 16);
+            out[2] = static_cast<uint8_t>(v >> 8);
+            out[3] = static_cast<uint8_t>(v);
+            out += 4;
+        }
+    }
+    lzma_options_lzma options;
+    if (lzma_lzma_preset(&options, preset))
+        throw std::runtime_error("Failed to set LZMA preset " + std::to_string(preset));
+    lzma_stream strm = LZMA_STREAM_INIT;
+    if (lzma_alone_encoder(&strm, &options) != LZMA_OK)
+        throw std::runtime_error("Failed to initialize LZMA encoder");
+    std::vector<uint8_t> out(raw.size() / 2 + 1024);
+    strm.next_in = raw.data();
+    strm.avail_in = raw.size();
+    strm.next_out = out.data();
+    strm.avail_out = out.size();
+    for (;;) {
+        lzma_ret ret = lzma_code(&strm, LZMA_FINISH);
+        if (ret == LZMA_STREAM_END)
+            break;
+        if (ret != LZMA_OK) {
+            lzma_end(&strm);
+            throw std::runtime_error("Failed to compress .bi5 hour: LZMA error " + std::to_string(ret));
+        }
+        if (strm.avail_out == 0) {
+            size_t used = out.size();
+            out.resize(used * 2);
+            strm.next_out = out.data() + used;
+            strm.avail_out = out.size() - used;
+        }
+    }
+    out.resize(strm.total_out);
+    lzma_end(&strm);
+    return out;
+}
+
+// Local HTTP/1.1 stand-in for the datafeed, for benchmarks and offline runs:
+// DukascopyDownloader::set_datafeed_url(server.url()). It answers
+// GET /datafeed/ASSET/YYYY/MM/DD/HHh_ticks.bi5 (month 0-based) with
+//
+//   - the recorded file under source_dir (a Bi5Cache directory has that layout), or
+//     a synthetic hour (random walk, deterministic per asset and hour) without one
+//   - 404 for weekend hours (weekend_closed), a stable random share of the other
+//     hours (missing_rate) and recorded hours that are absent
+//   - 429 above max_requests_per_second and for a random share throttle_rate
+//
+// after `latency`, paced to `bytes_per_second` per connection. Connections are kept
+// alive, one thread each. Counters are readable while it runs.
+class ReplayServer {
+public:
+    struct Config {
+        uint16_t port = 0;                              // 0: any free port
+        std::string source_dir;                         // recorded hours; empty: synthetic
+        double point = 100000;                          // synthetic price point
+        size_t ticks_per_hour = 3000;                   // synthetic, on average
+        std::chrono::milliseconds latency{ 0 };         // before each response
+        double bytes_per_second = 0;                    // per connection, 0: unlimited
+        bool weekend_closed = true;                     // Fri 22:00 - Sun 21:00 UTC
+        double missing_rate = 0;                        // extra 404 hours
+        double max_requests_per_second = 0;             // 429 above this, 0: off
+        double throttle_rate = 0;                       // random 429 share
+        uint64_t seed = 1;
+    };
+
+    struct Counters {
+        std::atomic<uint64_t> requests{ 0 };
+        std::atomic<uint64_t> ok{ 0 };
+        std::atomic<uint64_t> not_found{ 0 };
+        std::atomic<uint64_t> throttled{ 0 };
+        std::atomic<uint64_t> bytes{ 0 };
+    };
+
+    explicit ReplayServer(Config config) : config(std::move(config)) {
+#ifdef _WIN32
+        WSADATA wsa;
+        WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+        listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (listener == invalid_socket)
+            throw std::runtime_error("Failed to create replay server socket");
+        int one = 1;
+        ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof(one));
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(this->config.port);
+        if (::bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || ::listen(listener, 64) != 0) {
+            close_socket(listener);
+            throw std::runtime_error("Failed to listen on 127.0.0.1:" + std::to_string(this->config.port));
+        }
+        socklen_t len = sizeof(addr);
+        ::getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &len);
+        bound_port = ntohs(addr.sin_port);
+        window_start = std::chrono::steady_clock::now();
+        acceptor = std::thread([this]() { accept_loop(); });
+    }
+
+    ReplayServer(const ReplayServer&) = delete;
+    ReplayServer& operator=(const ReplayServer&) = delete;
+
+    ~ReplayServer() {
+        stopping = true;
+        acceptor.join();
+        close_socket(listener);
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex);
+            for (auto s : open_sockets)
+                ::shutdown(s, 2);
+        }
+        for (auto& t : workers)
+            t.join();
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+
+    // Base URL for set_datafeed_url.
+    std::string url() const { return "http://127.0.0.1:" + std::to_string(bound_port) + "/datafeed/"; }
+    uint16_t port() const { return bound_port; }
+    const Counters& counters() const { return stats; }
+
+    // Builds the synthetic hours of [first, last] ahead, so compression is not timed.
+    void prepare(const std::string& asset, std::chrono::system_clock::time_point first, std::chrono::system_clock::time_point last) {
+        for (auto h = first; h <= last; h += std::chrono::hours(1)) {
+            int64_t hour_s = std::chrono::duration_cast<std::chrono::seconds>(h.time_since_epoch()).count();
+            if (!closed(asset, hour_s))
+                synthetic_hour(asset, hour_s);
+        }
+    }
+
+private:
+#ifdef _WIN32
+    using socket_t = SOCKET;
+    static constexpr socket_t invalid_socket = INVALID_SOCKET;
+    static void close_socket(socket_t s) { closesocket(s); }
+    static int poll_one(socket_t s, int timeout_ms) {
+        WSAPOLLFD p = { s, POLLRDNORM, 0 };
+        return WSAPoll(&p, 1, timeout_ms);
+    }
+#else
+    using socket_t = int;
+    static constexpr socket_t invalid_socket = -1;
+    static void close_socket(socket_t s) { ::close(s); }
+    static int poll_one(socket_t s, int timeout_ms) {
+        pollfd p = { s, POLLIN, 0 };
+        return ::poll(&p, 1, timeout_ms);
+    }
+#endif
+
+    void accept_loop() {
+        while (!stopping) {
+            if (poll_one(listener, 50) <= 0)
+                continue;
+            socket_t s = ::accept(listener, nullptr, nullptr);
+            if (s == invalid_socket)
+                continue;
+            int one = 1;
+            ::setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+            std::lock_guard<std::mutex> lock(connections_mutex);
+            open_sockets.push_back(s);
+            workers.emplace_back([this, s]() { serve(s); });
+        }
+    }
+
+    void serve(socket_t s) {
+        std::string in;
+        char buf[4096];
+        while (!stopping) {
+            size_t end = in.find("\r\n\r\n");
+            if (end == std::string::npos) {
+                if (poll_one(s, 50) == 0)
+                    continue;
+                int n = static_cast<int>(::recv(s, buf, sizeof(buf), 0));
+                if (n <= 0)
+                    break;
+                in.append(buf, static_cast<size_t>(n));
+                continue;
+            }
+            std::string head = in.substr(0, end);
+            in.erase(0, end + 4);
+            bool keep_alive = head.find("Connection: close") == std::string::npos;
+            size_t sp1 = head.find(' '), sp2 = head.find(' ', sp1 + 1);
+            std::string path = sp1 == std::string::npos ? "" : head.substr(sp1 + 1, sp2 - sp1 - 1);
+            if (!respond(s, path, keep_alive) || !keep_alive)
+                break;
+        }
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex);
+            open_sockets.erase(std::remove(open_sockets.begin(), open_sockets.end(), s), open_sockets.end());
+        }
+        close_socket(s);
+    }
+
+    bool respond(socket_t s, const std::string& path, bool keep_alive) {
+        ++stats.requests;
+        if (config.latency.count() > 0)
+            std::this_thread::sleep_for(config.latency);
+        std::string asset;
+        int64_t hour_s = 0;
+        if (!parse_path(path, asset, hour_s))
+            return reply(s, 404, {}, keep_alive);
+        if (throttle(hour_s)) {
+            ++stats.throttled;
+            return reply(s, 429, {}, keep_alive);
+        }
+        std::shared_ptr<const std::vector<uint8_t>> body;
+        if (!config.source_dir.empty())
+            body = recorded_hour(path);
+        else if (!closed(asset, hour_s))
+            body = synthetic_hour(asset, hour_s);
+        if (!body) {
+            ++stats.not_found;
+            return reply(s, 404, {}, keep_alive);
+        }
+        ++stats.ok;
+        return reply(s, 200, body, keep_alive);
+    }
+
+    bool reply(socket_t s, int code, const std::shared_ptr<const std::vector<uint8_t>>& body, bool keep_alive) {
+        const char* reason = code == 200 ? "OK" : code == 429 ? "Too Many Requests" : "Not Found";
+        size_t size = body ? body->size() : 0;
+        std::string head = "HTTP/1.1 " + std::to_string(code) + " " + reason + "\r\n"
+            "Content-Type: application/octet-stream\r\n"
+            "Content-Length: " + std::to_string(size) + "\r\n" +
+            (code == 429 ? "Retry-After: 1\r\n" : "") +
+            (keep_alive ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+        if (!send_all(s, reinterpret_cast<const uint8_t*>(head.data()), head.size()))
+            return false;
+        if (size == 0)
+            return true;
+        if (config.bytes_per_second <= 0) {
+            stats.bytes += size;
+            return send_all(s, body->data(), size);
+        }
+        // paced: 16 KB chunks, each released when the rate allows it
+        const size_t chunk = 16384;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t sent = 0; sent < size; sent += chunk) {
+            size_t n = std::min(chunk, size - sent);
+            auto due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::duration<double>(sent / config.bytes_per_second));
+            std::this_thread::sleep_until(due);
+            if (!send_all(s, body->data() + sent, n))
+                return false;
+            stats.bytes += n;
+        }
+        return true;
+    }
+
+    static bool send_all(socket_t s, const uint8_t* p, size_t n) {
+        while (n > 0) {
+#ifdef _WIN32
+            int k = ::send(s, reinterpret_cast<const char*>(p), static_cast<int>(std::min<size_t>(n, 1 << 20)), 0);
+#else
+            ssize_t k = ::send(s, p, n, MSG_NOSIGNAL);
+#endif
+            if (k <= 0)
+                return false;
+            p += k;
+            n -= static_cast<size_t>(k);
+        }
+        return true;
+    }
+
+    // /datafeed/EURUSD/2024/00/15/13h_ticks.bi5
+    static bool parse_path(const std::string& path, std::string& asset, int64_t& hour_s) {
+        const std::string prefix = "/datafeed/";
+        if (path.compare(0, prefix.size(), prefix) != 0)
+            return false;
+        char name[64];
+        int y, m, d, h;
+        if (std::sscanf(path.c_str() + prefix.size(), "%63[^/]/%d/%d/%d/%dh_ticks.bi5", name, &y, &m, &d, &h) != 5)
+            return false;
+        if (m < 0 || m > 11 || d < 1 || d > 31 || h < 0 || h > 23)
+            return false;
+        asset = name;
+        // days_from_civil (proleptic Gregorian)
+        int yy = y - (m + 1 <= 2);
+        int era = (yy >= 0 ? yy : yy - 399) / 400;
+        unsigned yoe = static_cast<unsigned>(yy - era * 400);
+        unsigned mp = static_cast<unsigned>((m + 1 + 9) % 12);
+        unsigned doy = (153 * mp + 2) / 5 + static_cast<unsigned>(d) - 1;
+        unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+        int64_t days = static_cast<int64_t>(era) * 146097 + doe - 719468;
+        hour_s = days * 86400 + h * 3600;
+        return true;
+    }
+
+    static uint64_t mix(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    uint64_t hour_key(const std::string& asset, int64_t hour_s) const {
+        return mix(std::hash<std::string>()(asset) ^ mix(static_cast<uint64_t>(hour_s) ^ config.seed));
+    }
+
+    bool closed(const std::string& asset, int64_t hour_s) const {
+        int64_t h = hour_s / 3600;
+        int weekday = static_cast<int>((h / 24 + 4) % 7);
+        int hour = static_cast<int>(h % 24);
+        if (config.weekend_closed && (weekday == 6 || (weekday == 5 && hour >= 22) || (weekday == 0 && hour < 21)))
+            return true;
+        return config.missing_rate > 0 && (hour_key(asset, hour_s) >> 11) * 0x1.0p-53 < config.missing_rate;
+    }
+
+    bool throttle(int64_t hour_s) {
+        if (config.throttle_rate > 0 && (mix(hour_s ^ ++throttle_draws) >> 11) * 0x1.0p-53 < config.throttle_rate)
+            return true;
+        if (config.max_requests_per_second <= 0)
+            return false;
+        // fixed one-second windows
+        std::lock_guard<std::mutex> lock(window_mutex);
+        auto now = std::chrono::steady_clock::now();
+        if (now - window_start >= std::chrono::seconds(1)) {
+            window_start = now;
+            window_requests = 0;
+        }
+        return ++window_requests > config.max_requests_per_second;
+    }
+
+    std::shared_ptr<const std::vector<uint8_t>> recorded_hour(const std::string& path) {
+        auto file = std::filesystem::path(config.source_dir) / path.substr(std::string("/datafeed/").size());
+        std::ifstream in(file, std::ios::binary);
+        if (!in.is_open())
+            return nullptr;
+        auto data = std::make_shared<std::vector<uint8_t>>((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return data;
+    }
+
+    std::shared_ptr<const std::vector<uint8_t>> synthetic_hour(const std::string& asset, int64_t hour_s) {
+        uint64_t key = hour_key(asset, hour_s);
+        {
+            std::lock_guard<std::mutex> lock(hours_mutex);
+            auto it = hours.find(key);
+            if (it != hours.end())
+                return it->second;
+        }
+        std::mt19937_64 rng(key);
+        std::uniform_int_distribution<int> step(-2, 2);
+        std::uniform_int_distribution<int> spread(1, 4);
+        std::uniform_int_distribution<int> lots(1, 12);
+        size_t n = config.ticks_per_hour / 2 + rng() % (config.ticks_per_hour + 1);
+        std::vector<uint32_t> offsets(n);
+        for (auto& o : offsets)
+            o = static_cast<uint32_t>(rng() % 3600000);
+        std::sort(offsets.begin(), offsets.end());
+        int64_t hour_ms = hour_s * 1000;
+        int64_t bid = static_cast<int64_t>(1.07 * config.point) + static_cast<int64_t>(key % 2000) - 1000;
+        TickBatch t;
+        for (uint32_t o : offsets) {
+            bid += step(rng);
+            t.push_back(hour_ms + o, (bid + spread(rng)) / config.point, bid / config.point, lots(rng) * 0.75f, lots(rng) * 0.75f);
+        }
+        auto data = std::make_shared<const std::vector<uint8_t>>(encode_bi5(t, hour_ms, config.point));
+        std::lock_guard<std::mutex> lock(hours_mutex);
+        return hours.emplace(key, std::move(data)).first->second;
+    }
+
+    Config config;
+    Counters stats;
+    socket_t listener = invalid_socket;
+    uint16_t bound_port = 0;
+    std::atomic<bool> stopping{ false };
+    std::thread acceptor;
+    std::mutex connections_mutex;
+    std::vector<socket_t> open_sockets;
+    std::vector<std::thread> workers;
+    std::mutex hours_mutex;
+    std::unordered_map<uint64_t, std::shared_ptr<const std::vector<uint8_t>>> hours;
+    std::atomic<uint64_t> throttle_draws{ 0 };
+    std::mutex window_mutex;
+    std::chrono::steady_clock::time_point window_start;
+    double window_requests = 0;
+};
+
+#endif // DUKASREPLAY_HPP
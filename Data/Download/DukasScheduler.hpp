@@ -0,0 +1,221 @@
+#ifndef DUKASSCHEDULER_HPP
+#define DUKASSCHEDULER_HPP
+
+#include <stdexcept>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "Dukasloader.hpp"
+
+// One download of a manifest. Manifest lines are
+//
+//   ASSET START END [key=value ...]        # comment
+//
+// keys: dir, timeframe, timeframes (comma list), bars (comma list), pg, cache,
+// store, archive, calendar, verbose, and the prompt answers existing (u/r), until (e/n),
+// mode (f only: a livestream never ends), overwrite (y/n). Defaults: update, to the end date,
+// fixed point.
+struct ManifestEntry {
+    std::string asset;
+    std::string start_date;
+    std::string end_date;
+    std::string download_dir;
+    std::string timeframe;
+    std::string pg_url;
+    std::vector<std::string> timeframes;
+    std::vector<std::string> activity_bars;
+    std::string cache_dir;
+    std::string store_dir;
+    std::string archive_dir;
+    std::string calendar_dir;
+    DownloadChoices choices;
+    int verbose_level = 0;
+
+    // requested hours, used to start the longest downloads first
+    long long hours() const {
+        std::tm a = {}, b = {};
+        std::istringstream sa(start_date), sb(end_date);
+        sa >> std::get_time(&a, "%Y-%m-%d");
+        sb >> std::get_time(&b, "%Y-%m-%d");
+        if (sa.fail() || sb.fail())
+            return 0;
+        return (portable_timegm(&b) - portable_timegm(&a)) / 3600;
+    }
+};
+
+inline std::vector<std::string> split_list(const std::string& value) {
+    std::vector<std::string> items;
+    std::istringstream ss(value);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+inline std::vector<ManifestEntry> load_manifest(const std::string& path) {
+    std::ifstream in(path);
+    if (!in.is_open())
+        throw std::runtime_error("Cannot open manifest " + path);
+    std::vector<ManifestEntry> entries;
+    std::string line;
+    for (int number = 1; std::getline(in, line); ++number) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream ss(line);
+        ManifestEntry e;
+        if (!(ss >> e.asset))
+            continue;
+        if (!(ss >> e.start_date >> e.end_date))
+            throw std::runtime_error(path + ":" + std::to_string(number) + ": expected ASSET START END");
+        std::string option;
+        while (ss >> option) {
+            size_t eq = option.find('=');
+            if (eq == std::string::npos || eq + 1 == option.size())
+                throw std::runtime_error(path + ":" + std::to_string(number) + ": expected key=value, got " + option);
+            std::string key = option.substr(0, eq);
+            std::string value = option.substr(eq + 1);
+            if (key == "dir") e.download_dir = value;
+            else if (key == "timeframe") e.timeframe = value;
+            else if (key == "timeframes") e.timeframes = split_list(value);
+            else if (key == "bars") e.activity_bars = split_list(value);
+            else if (key == "pg") e.pg_url = value;
+            else if (key == "cache") e.cache_dir = value;
+            else if (key == "store") e.store_dir = value;
+            else if (key == "archive") e.archive_dir = value;
+            else if (key == "calendar") e.calendar_dir = value;
+            else if (key == "verbose") e.verbose_level = std::stoi(value);
+            else if (key == "existing") e.choices.existing = value[0];
+            else if (key == "until") e.choices.until = value[0];
+            else if (key == "mode") {
+                // livestream runs until 'q' is pressed: no unattended worker could stop it
+                if (value != "f")
+                    throw std::runtime_error(path + ":" + std::to_string(number) + ": mode must be f, livestream is not scheduled");
+                e.choices.mode = 'f';
+            }
+            else if (key == "overwrite") e.choices.overwrite = value[0];
+            else
+                throw std::runtime_error(path + ":" + std::to_string(number) + ": unknown key " + key);
+        }
+        entries.push_back(std::move(e));
+    }
+    return entries;
+}
+
+// Runs a manifest unattended: `workers` downloads at a time in one process, all
+// drawing hour requests from one RequestBudget. The longest ranges start first and
+// every download keeps `fetch_concurrency` requests queued, so when the short ones
+// are done the remaining ones absorb the whole budget instead of idling behind it.
+// A failing entry is reported and does not stop the others.
+class DownloadScheduler {
+public:
+    struct Config {
+        size_t workers = 4;
+        double requests_per_second = 40;
+        size_t fetch_concurrency = 16;
+        size_t decode_threads = 2;
+        std::string metrics_path;               // per-asset metrics file, empty: none
+        MetricsExporter::Format metrics_format = MetricsExporter::Format::Prometheus;
+        std::chrono::milliseconds metrics_interval{ 10000 };
+    };
+
+    struct Outcome {
+        std::string asset;
+        bool ok = false;
+        std::string error;
+        double seconds = 0;
+    };
+
+    DownloadScheduler(std::vector<ManifestEntry> entries, Config config)
+        : entries(std::move(entries)), config(config), budget(config.requests_per_second)
+    {
+        std::stable_sort(this->entries.begin(), this->entries.end(),
+            [](const ManifestEntry& a, const ManifestEntry& b) { return a.hours() > b.hours(); });
+    }
+
+    std::vector<Outcome> run() {
+        init_curl();
+        outcomes.assign(entries.size(), {});
+        next = 0;
+        std::unique_ptr<MetricsExporter> exporter;
+        metrics.clear();
+        if (!config.metrics_path.empty()) {
+            exporter = std::make_unique<MetricsExporter>(config.metrics_path, config.metrics_format, config.metrics_interval);
+            for (const auto& e : entries) {
+                metrics.push_back(std::make_unique<PipelineMetrics>(e.asset));
+                exporter->add(metrics.back().get());
+            }
+        }
+        std::vector<std::thread> pool;
+        size_t n = std::max<size_t>(1, std::min(config.workers, entries.size()));
+        for (size_t w = 0; w < n; ++w)
+            pool.emplace_back([this]() { work(); });
+        for (auto& t : pool)
+            t.join();
+        std::cout << "Scheduler: " << entries.size() << " downloads, " << budget.throttled()
+            << " throttled responses, final rate " << budget.rate() << " req/s" << std::endl;
+        return outcomes;
+    }
+
+private:
+    void work() {
+        for (size_t i = next++; i < entries.size(); i = next++) {
+            const ManifestEntry& e = entries[i];
+            Outcome& outcome = outcomes[i];
+            outcome.asset = e.asset;
+            auto start = std::chrono::steady_clock::now();
+            try {
+                DownloadChoices choices = e.choices;
+                choices.mode = 'f';    // entries built in code too: never livestream here
+                DukascopyDownloader downloader(e.asset, e.start_date, e.end_date, e.download_dir,
+                    e.timeframe, e.pg_url, e.verbose_level, &choices);
+                downloader.set_request_budget(&budget);
+                if (!metrics.empty())
+                    downloader.set_metrics(metrics[i].get());
+                downloader.set_fetch_concurrency(config.fetch_concurrency);
+                downloader.set_decode_threads(config.decode_threads);
+                if (!e.timeframes.empty())
+                    downloader.set_timeframes(e.timeframes);
+                if (!e.activity_bars.empty())
+                    downloader.set_activity_bars(e.activity_bars);
+                if (!e.cache_dir.empty())
+                    downloader.set_cache_dir(e.cache_dir);
+                if (!e.store_dir.empty())
+                    downloader.set_tick_store_dir(e.store_dir);
+                if (!e.archive_dir.empty())
+                    downloader.set_archive_dir(e.archive_dir);
+                if (!e.calendar_dir.empty())
+                    downloader.set_calendar_dir(e.calendar_dir);
+                downloader.download();
+                outcome.ok = true;
+            }
+            catch (const std::exception& ex) {
+                outcome.error = ex.what();
+            }
+            outcome.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::lock_guard<std::mutex> lock(print_mutex);
+            if (outcome.ok)
+                std::cout << "[" << e.asset << "] done in " << outcome.seconds << " s" << std::endl;
+            else
+                std::cout << "[" << e.asset << "] failed: " << outcome.error << std::endl;
+        }
+    }
+
+    std::vector<ManifestEntry> entries;
+    Config config;
+    RequestBudget budget;
+    std::atomic<size_t> next{ 0 };
+    std::vector<Outcome> outcomes;
+    std::vector<std::unique_ptr<PipelineMetrics>> metrics;
+    std::mutex print_mutex;
+};
+
+#endif // DUKASSCHEDULER_HPP
@@ -0,0 +1,346 @@
+#ifndef DUKASSHARD_HPP
+#define DUKASSHARD_HPP
+
+#include <condition_variable>
+#include <system_error>
+#include <filesystem>
+#include <stdexcept>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <limits>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <map>
+
+#include "Dukasloader.hpp"
+#include "DukasLedger.hpp"
+
+// Backfill split into (asset, UTC day) units that any number of processes, on one
+// host or many, claim from a WorkLedger. A unit is downloaded into
+// ledger/shards/ASSET/YYYYMMDD.part and renamed to YYYYMMDD before it is marked
+// done, so a finished shard is always complete. merge_shards() then appends the
+// shards of each asset, in day order, into the final files.
+//
+// Bars must not span units: every timeframe has to divide one day, and activity
+// bars (whose state runs across days) are not sharded. Shards write files only;
+// Postgres is loaded from the merged output.
+struct ShardPlan {
+    std::vector<std::string> assets;
+    std::string start_date;                 // first day, YYYY-MM-DD
+    std::string end_date;                   // day after the last one
+    std::string timeframe;                  // empty: ticks
+    std::vector<std::string> timeframes;    // more bar timeframes
+    std::string cache_dir;
+    bool tick_store = false;
+    bool archive = false;
+    size_t fetch_concurrency = 8;
+    size_t decode_threads = 2;
+
+    void validate() const {
+        std::vector<std::string> all = timeframes;
+        if (!timeframe.empty())
+            all.push_back(timeframe);
+        for (const auto& tf : all) {
+            if (86400000 % timeframe_to_ms(tf) != 0)
+                throw std::invalid_argument("Timeframe " + tf + " does not divide a day and cannot be sharded");
+        }
+    }
+
+    // UTC midnights (epoch seconds) of every day in [start_date, end_date)
+    std::vector<int64_t> days() const {
+        int64_t first = parse_day(start_date), end = parse_day(end_date);
+        std::vector<int64_t> out;
+        for (int64_t d = first; d < end; d += 86400)
+            out.push_back(d);
+        return out;
+    }
+
+    static int64_t parse_day(const std::string& date) {
+        std::tm tm = {};
+        std::istringstream ss(date);
+        ss >> std::get_time(&tm, "%Y-%m-%d");
+        if (ss.fail())
+            throw std::invalid_argument("Invalid date format, use YYYY-MM-DD");
+        return static_cast<int64_t>(portable_timegm(&tm));
+    }
+
+    static std::string format_day(int64_t day, const char* format) {
+        std::tm tm = {};
+        time_t t = static_cast<time_t>(day);
+        portable_gmtime(&tm, &t);
+        std::ostringstream oss;
+        oss << std::put_time(&tm, format);
+        return oss.str();
+    }
+
+    static std::string unit_name(const std::string& asset, int64_t day) {
+        return asset + "_" + format_day(day, "%Y%m%d");
+    }
+};
+
+// Claims and downloads units until every one is done. Units leased by other workers
+// are waited for (polling every lease/3) and taken over once their lease expires, so
+// the units of a crashed worker are not left behind. A heartbeat renews the lease of
+// the unit in progress; a unit whose lease was lost is thrown away instead of being
+// published twice. A unit that fails max_attempts times here is left to other workers.
+class ShardWorker {
+public:
+    ShardWorker(const std::string& ledger_dir, const std::string& worker, ShardPlan plan,
+        std::chrono::milliseconds lease = std::chrono::minutes(10), size_t max_attempts = 3)
+        : ledger_root(ledger_dir), ledger(ledger_dir, worker, lease), plan(std::move(plan)), lease(lease),
+          max_attempts(std::max<size_t>(1, max_attempts))
+    {
+        this->plan.validate();
+    }
+
+    // Returns the number of units this worker completed.
+    size_t run() {
+        std::vector<std::pair<std::string, int64_t>> units;
+        for (const auto& asset : plan.assets)
+            for (int64_t day : plan.days())
+                units.emplace_back(asset, day);
+        std::vector<size_t> failures(units.size(), 0);
+        // start at a worker-dependent offset so workers do not all race for the same unit
+        size_t offset = units.empty() ? 0 : std::hash<std::string>()(ledger.worker_id()) % units.size();
+        size_t completed = 0;
+        while (true) {
+            size_t held = 0, claimed = 0;
+            for (size_t k = 0; k < units.size(); ++k) {
+                size_t i = (offset + k) % units.size();
+                const auto& u = units[i];
+                std::string unit = ShardPlan::unit_name(u.first, u.second);
+                if (failures[i] >= max_attempts || ledger.state(unit) == WorkLedger::State::Done)
+                    continue;
+                if (!ledger.claim(unit)) {
+                    if (ledger.state(unit) != WorkLedger::State::Done)
+                        ++held;
+                    continue;
+                }
+                ++claimed;
+                try {
+                    if (process(unit, u.first, u.second)) {
+                        ++completed;
+                        continue;
+                    }
+                }
+                catch (const std::exception& e) {
+                    ++failures[i];
+                    std::cout << "[" << ledger.worker_id() << "] " << unit << " failed: " << e.what() << std::endl;
+                }
+                ledger.release(unit);
+                ++held;
+            }
+            if (held == 0)
+                break;
+            // everything left is leased by live workers: wait for them to finish or expire
+            if (claimed == 0)
+                std::this_thread::sleep_for(lease / 3);
+        }
+        return completed;
+    }
+
+private:
+    bool process(const std::string& unit, const std::string& asset, int64_t day) {
+        auto final_dir = ledger_root / "shards" / asset / ShardPlan::format_day(day, "%Y%m%d");
+        auto part_dir = final_dir;
+        part_dir += ".part";
+        std::error_code ec;
+        std::filesystem::remove_all(part_dir, ec);
+        std::filesystem::create_directories(part_dir, ec);
+
+        std::atomic<bool> lost{ false };
+        std::mutex m;
+        std::condition_variable cv;
+        bool finished = false;
+        std::thread heartbeat([&]() {
+            std::unique_lock<std::mutex> lock(m);
+            while (!cv.wait_for(lock, lease / 3, [&]() { return finished; })) {
+                if (!ledger.renew(unit))
+                    lost = true;
+            }
+        });
+        auto stop_heartbeat = [&]() {
+            {
+                std::lock_guard<std::mutex> lock(m);
+                finished = true;
+            }
+            cv.notify_all();
+            heartbeat.join();
+        };
+        try {
+            DownloadChoices choices;
+            choices.existing = 'r';
+            choices.overwrite = 'y';
+            DukascopyDownloader downloader(asset, ShardPlan::format_day(day, "%Y-%m-%d"), ShardPlan::format_day(day + 86400, "%Y-%m-%d"),
+                part_dir.string(), plan.timeframe, "", 0, &choices);
+            auto first = std::chrono::system_clock::from_time_t(static_cast<time_t>(day));
+            downloader.set_hours(first, first + std::chrono::hours(23));
+            downloader.set_journal_path("");
+            downloader.set_fetch_concurrency(plan.fetch_concurrency);
+            downloader.set_decode_threads(plan.decode_threads);
+            if (!plan.timeframes.empty())
+                downloader.set_timeframes(plan.timeframes);
+            if (!plan.cache_dir.empty())
+                downloader.set_cache_dir(plan.cache_dir);
+            if (plan.tick_store)
+                downloader.set_tick_store_dir(part_dir.string());
+            if (plan.archive)
+                downloader.set_archive_dir(part_dir.string());
+            downloader.download();
+        }
+        catch (...) {
+            stop_heartbeat();
+            throw;
+        }
+        stop_heartbeat();
+
+        if (lost || !ledger.renew(unit)) {
+            std::cout << "[" << ledger.worker_id() << "] lease on " << unit << " lost, shard discarded" << std::endl;
+            std::filesystem::remove_all(part_dir, ec);
+            return false;
+        }
+        std::filesystem::remove_all(final_dir, ec);
+        std::filesystem::rename(part_dir, final_dir, ec);
+        if (ec)
+            throw std::runtime_error("Cannot publish shard " + final_dir.string() + ": " + ec.message());
+        ledger.complete(unit);
+        std::cout << "[" << ledger.worker_id() << "] " << unit << " done" << std::endl;
+        return true;
+    }
+
+    std::filesystem::path ledger_root;
+    WorkLedger ledger;
+    ShardPlan plan;
+    std::chrono::milliseconds lease;
+    size_t max_attempts;
+};
+
+// Writer on an existing column store, with the columns it already has.
+inline ColumnStoreWriter reopen_column_store(const std::string& dir, const ColumnStoreReader& like) {
+    std::vector<ColumnStoreWriter::Column> columns;
+    for (size_t c = 1; c < like.columns(); ++c)
+        columns.push_back({ like.column_name(c), like.column_width(c) });
+    return ColumnStoreWriter(dir, columns);
+}
+
+// Appends the completed shards of every asset, in day order, to out_dir: CSVs
+// without their repeated header, tick archives block by block and column stores
+// column by column. It stops at the first day that is not done yet and can be
+// rerun later; out_dir/ASSET.merge records the last merged day and, while a day is
+// being appended, the output sizes to roll back to if the merge is interrupted.
+inline size_t merge_shards(const std::string& ledger_dir, const ShardPlan& plan, const std::string& out_dir) {
+    WorkLedger ledger(ledger_dir, "merge");
+    std::filesystem::path out(out_dir);
+    std::error_code ec;
+    std::filesystem::create_directories(out, ec);
+    size_t merged = 0;
+
+    for (const auto& asset : plan.assets) {
+        auto state_path = out / (asset + ".merge");
+        int64_t last_merged = std::numeric_limits<int64_t>::min();
+        std::map<std::string, uint64_t> rollback;
+        {
+            std::ifstream in(state_path);
+            std::string key;
+            while (in >> key) {
+                if (key == "merged")
+                    in >> last_merged;
+                else if (key == "size") {
+                    std::string name;
+                    uint64_t size;
+                    in >> name >> size;
+                    rollback[name] = size;
+                }
+            }
+        }
+        // an interrupted day: cut every output back to where it was before it
+        for (const auto& r : rollback) {
+            auto target = out / r.first;
+            if (std::filesystem::exists(target / "meta.txt")) {
+                ColumnStoreReader existing(target.string());
+                reopen_column_store(target.string(), existing).truncate(r.second);
+            }
+            else if (std::filesystem::is_regular_file(target))
+                std::filesystem::resize_file(target, r.second);
+        }
+        auto save_state = [&](const std::map<std::string, uint64_t>& sizes) {
+            std::ofstream state(state_path, std::ios::trunc);
+            state << "merged " << last_merged << "\n";
+            for (const auto& s : sizes)
+                state << "size " << s.first << " " << s.second << "\n";
+        };
+
+        for (int64_t day : plan.days()) {
+            if (day <= last_merged)
+                continue;
+            if (ledger.state(ShardPlan::unit_name(asset, day)) != WorkLedger::State::Done) {
+                std::cout << "Merge of " << asset << " stops before " << ShardPlan::format_day(day, "%Y-%m-%d") << " (not done yet)" << std::endl;
+                break;
+            }
+            auto shard = std::filesystem::path(ledger_dir) / "shards" / asset / ShardPlan::format_day(day, "%Y%m%d");
+            std::vector<std::filesystem::path> entries;
+            for (const auto& e : std::filesystem::directory_iterator(shard))
+                entries.push_back(e.path());
+            std::sort(entries.begin(), entries.end());
+
+            std::map<std::string, uint64_t> sizes;
+            for (const auto& e : entries) {
+                auto target = out / e.filename();
+                if (std::filesystem::is_directory(e))
+                    sizes[e.filename().string()] = std::filesystem::exists(target / "meta.txt") ? ColumnStoreReader(target.string()).size() : 0;
+                else
+                    sizes[e.filename().string()] = std::filesystem::exists(target) ? std::filesystem::file_size(target) : 0;
+            }
+            save_state(sizes);
+
+            for (const auto& e : entries) {
+                auto target = out / e.filename();
+                std::string ext = e.extension().string();
+                if (std::filesystem::is_directory(e)) {
+                    if (!std::filesystem::exists(e / "meta.txt"))
+                        continue;
+                    ColumnStoreReader reader(e.string());
+                    std::vector<const void*> values;
+                    for (size_t c = 1; c < reader.columns(); ++c)
+                        values.push_back(reader.column_data(c));
+                    ColumnStoreWriter writer = reopen_column_store(target.string(), reader);
+                    if (reader.size() > 0)
+                        writer.append(reader.timestamps(), values.data(), reader.size());
+                }
+                else if (ext == ".csv") {
+                    std::ifstream in(e, std::ios::binary);
+                    bool has_header = std::filesystem::exists(target) && std::filesystem::file_size(target) > 0;
+                    std::ofstream dst(target, std::ios::binary | std::ios::app);
+                    std::string header;
+                    std::getline(in, header);
+                    if (!has_header)
+                        dst << header << "\n";
+                    dst << in.rdbuf();
+                }
+                else if (ext == ".dka") {
+                    std::ifstream in(e, std::ios::binary);
+                    std::vector<char> image((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+                    if (image.size() < dka::file_header_size)
+                        continue;
+                    bool has_header = std::filesystem::exists(target) && std::filesystem::file_size(target) >= dka::file_header_size;
+                    std::ofstream dst(target, std::ios::binary | std::ios::app);
+                    size_t skip = has_header ? dka::file_header_size : 0;
+                    dst.write(image.data() + skip, static_cast<std::streamsize>(image.size() - skip));
+                }
+            }
+            last_merged = day;
+            save_state({});
+            ++merged;
+        }
+    }
+    return merged;
+}
+
+#endif // DUKASSHARD_HPP
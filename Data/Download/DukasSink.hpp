@@ -0,0 +1,179 @@
+#ifndef DUKASSINK_HPP
+#define DUKASSINK_HPP
+
+#include <stdexcept>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <thread>
+
+#include "DukasPipeline.hpp"
+#include "DukasBars.hpp"
+
+// Consumer of what a download produces. Calls come from the thread running
+// DukascopyDownloader::download(), in time order; the batches are the downloader's
+// own buffers and only valid during the call, nothing is copied or serialized.
+//
+//   on_ticks     ticks of one hour (one poll while livestreaming)
+//   on_bars      bars of one output that closed during that hour; series indexes the
+//                timeframes in set order followed by the activity bars
+//   on_hour_end  the hour is complete in every output
+//   on_finish    the download (and its livestream) is over
+class DataSink {
+public:
+    virtual ~DataSink() = default;
+    virtual void on_ticks(const TickBatch& ticks) { (void)ticks; }
+    virtual void on_bars(size_t series, const std::string& name, const Bar* bars, size_t count) {
+        (void)series; (void)name; (void)bars; (void)count;
+    }
+    virtual void on_hour_end() {}
+    virtual void on_finish() {}
+};
+
+// One item of a DataStream: a tick batch or the bars of one series.
+struct DataBatch {
+    enum class Kind { Ticks, Bars };
+    Kind kind = Kind::Ticks;
+    size_t series = 0;
+    std::string name;
+    TickBatch ticks;
+    std::vector<Bar> bars;
+};
+
+// Pull-style view of a download: `run` is called on a background thread with the
+// stream as its sink (typically: add_sink, then download()), and the batches come
+// out of next() or a range-for on the consumer's thread. Between the two threads
+// batches are copied once into buffers that are recycled, and at most `depth` are
+// queued, so a slow consumer holds the download back instead of growing memory.
+// Leaving the loop early stops the download at its next batch; an exception of
+// the download is rethrown by next() once the batches before it are consumed.
+class DataStream : public DataSink {
+public:
+    explicit DataStream(std::function<void(DataSink&)> run, size_t depth = 16)
+        : full(depth), spare(depth + 2)
+    {
+        producer = std::thread([this, run]() {
+            try {
+                run(*this);
+            }
+            catch (...) {
+                if (!cancelled.load())
+                    failure = std::current_exception();
+            }
+            done.store(true, std::memory_order_release);
+        });
+    }
+
+    DataStream(const DataStream&) = delete;
+    DataStream& operator=(const DataStream&) = delete;
+
+    ~DataStream() {
+        cancelled.store(true);
+        DataBatch drop;
+        while (!done.load(std::memory_order_acquire)) {
+            full.try_pop(drop);
+            std::this_thread::yield();
+        }
+        producer.join();
+    }
+
+    // False at the end of the download.
+    bool next(DataBatch& out) {
+        unsigned spins = 0;
+        DataBatch used = std::move(out);
+        spare.try_push(std::move(used));
+        while (!full.try_pop(out)) {
+            if (done.load(std::memory_order_acquire)) {
+                if (full.try_pop(out))
+                    return true;
+                if (failure)
+                    std::rethrow_exception(std::exchange(failure, nullptr));
+                return false;
+            }
+            pipeline_backoff(spins);
+        }
+        return true;
+    }
+
+    class iterator {
+    public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = DataBatch;
+        using difference_type = std::ptrdiff_t;
+        using pointer = DataBatch*;
+        using reference = DataBatch&;
+
+        iterator() = default;
+        explicit iterator(DataStream* s) : stream(s) { ++*this; }
+        DataBatch& operator*() { return batch; }
+        DataBatch* operator->() { return &batch; }
+        iterator& operator++() {
+            if (!stream->next(batch))
+                stream = nullptr;
+            return *this;
+        }
+        bool operator==(const iterator& o) const { return stream == o.stream; }
+        bool operator!=(const iterator& o) const { return stream != o.stream; }
+
+    private:
+        DataStream* stream = nullptr;
+        DataBatch batch;
+    };
+
+    iterator begin() { return iterator(this); }
+    iterator end() { return iterator(); }
+
+    void on_ticks(const TickBatch& ticks) override {
+        if (ticks.empty())
+            return;
+        DataBatch b = take();
+        b.kind = DataBatch::Kind::Ticks;
+        b.ticks.resize(ticks.size());
+        std::copy(ticks.ts_ms.begin(), ticks.ts_ms.end(), b.ticks.ts_ms.begin());
+        std::copy(ticks.ask.begin(), ticks.ask.end(), b.ticks.ask.begin());
+        std::copy(ticks.bid.begin(), ticks.bid.end(), b.ticks.bid.begin());
+        std::copy(ticks.ask_vol.begin(), ticks.ask_vol.end(), b.ticks.ask_vol.begin());
+        std::copy(ticks.bid_vol.begin(), ticks.bid_vol.end(), b.ticks.bid_vol.begin());
+        put(std::move(b));
+    }
+
+    void on_bars(size_t series, const std::string& name, const Bar* bars, size_t count) override {
+        DataBatch b = take();
+        b.kind = DataBatch::Kind::Bars;
+        b.series = series;
+        b.name = name;
+        b.bars.assign(bars, bars + count);
+        put(std::move(b));
+    }
+
+private:
+    DataBatch take() {
+        DataBatch b;
+        spare.try_pop(b);
+        return b;
+    }
+
+    void put(DataBatch&& b) {
+        unsigned spins = 0;
+        for (;;) {
+            if (cancelled.load())
+                throw std::runtime_error("Data stream closed by its consumer");
+            if (full.try_push(std::move(b)))
+                return;
+            pipeline_backoff(spins);
+        }
+    }
+
+    BoundedQueue<DataBatch> full;
+    BoundedQueue<DataBatch> spare;
+    std::thread producer;
+    std::atomic<bool> cancelled{ false };
+    std::atomic<bool> done{ false };
+    std::exception_ptr failure;
+};
+
+#endif // DUKASSINK_HPP
@@ -0,0 +1,304 @@
+#ifndef DUKASSWEEP_HPP
+#define DUKASSWEEP_HPP
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cmath>
+
+#include "DukasTrades.hpp"
+
+// Grid of Partial exit rules: every combination of the three lists, at one horizon.
+// Grid point g is (ma_windows[g / (F * M)], wait_factors[g / M % F], min_wait_ms[g % M])
+// for F wait factors and M minimum waits.
+struct SweepGrid {
+    std::vector<size_t> ma_windows{ 10 };
+    std::vector<double> wait_factors{ 0.2 };
+    std::vector<int64_t> min_wait_ms{ 60000 };
+    int64_t horizon_ms = 0;
+
+    size_t size() const { return ma_windows.size() * wait_factors.size() * min_wait_ms.size(); }
+
+    ExitRule rule(size_t g) const {
+        size_t f = wait_factors.size(), m = min_wait_ms.size();
+        ExitRule r;
+        r.ma_window = ma_windows[g / (f * m)];
+        r.wait_factor = wait_factors[g / m % f];
+        r.min_wait_ms = min_wait_ms[g % m];
+        r.horizon_ms = horizon_ms;
+        return r;
+    }
+};
+
+// The journal under one grid point. TP and SL trades close the same way at every
+// point; they are in the totals so rows compare whole journals.
+struct SweepRow {
+    ExitRule rule;
+    size_t closed = 0;              // trades with an outcome
+    size_t missing = 0;             // no data, no exit or no reversal
+    size_t wins = 0;                // closed with ret > 0
+    double total_ret = 0;           // sum of ret (% of the account)
+    double worst_mdd_pct = 0;       // lowest mdd_pct of a closed trade
+    double sum_mdd_pct = 0;
+    double sum_ulcer_pct = 0;
+
+    double mean_ret() const { return closed ? total_ret / closed : 0; }
+    double win_rate() const { return closed ? static_cast<double>(wins) / closed : 0; }
+    double mean_mdd_pct() const { return closed ? sum_mdd_pct / closed : 0; }
+    double mean_ulcer_pct() const { return closed ? sum_ulcer_pct / closed : 0; }
+
+    void add(const TradeOutcome& o) {
+        if (o.status != TradeOutcome::Status::Ok) {
+            ++missing;
+            return;
+        }
+        ++closed;
+        wins += o.ret > 0;
+        total_ret += o.ret;
+        worst_mdd_pct = std::min(worst_mdd_pct, o.mdd_pct);
+        sum_mdd_pct += o.mdd_pct;
+        sum_ulcer_pct += o.ulcer_pct;
+    }
+
+    void add(const SweepRow& o) {
+        closed += o.closed;
+        missing += o.missing;
+        wins += o.wins;
+        total_ret += o.total_ret;
+        worst_mdd_pct = std::min(worst_mdd_pct, o.worst_mdd_pct);
+        sum_mdd_pct += o.sum_mdd_pct;
+        sum_ulcer_pct += o.sum_ulcer_pct;
+    }
+};
+
+namespace trade_detail {
+
+// Ticks from `ts` on (and from tick `from`, for a threshold at its own T1 tick: the
+// ticks before it in its timestamp are not candidates); best is the tick closest to
+// the take profit before the next cut.
+template <bool Long>
+struct SweepCut {
+    int64_t ts = 0;
+    size_t from = 0;
+    double diff = std::numeric_limits<double>::infinity();
+    ExitPoint<Long> best;
+};
+
+template <bool Long>
+struct SweepState {
+    std::vector<RollingMean> means;
+    std::vector<double> prev_sma;
+    std::vector<ExitPoint<Long>> reversals;     // T1 of each ma_window
+    std::vector<SweepCut<Long>> cuts;           // sorted by (ts, from), one per distinct threshold
+    std::vector<std::pair<int64_t, size_t>> thresholds;     // per grid point: its cut
+    std::vector<size_t> chosen;                 // per cut: the cut holding its exit
+};
+
+// Every grid point of one Partial trade in a single forward pass. All ma_windows run
+// side by side until each has its T1; each T1 adds its thresholds as cuts. The ticks
+// between two cuts are a segment, and a threshold's exit (the first tick closest to
+// the take profit from it on) is the best of its own and the later segments, so one
+// running minimum per segment and a merge from the last cut back give every exit.
+// Exit points keep their drawdown snapshot, so no tick is visited twice. The scan
+// ends at an exact touch of the take profit past the last cut, once every window has
+// its T1.
+template <bool Long>
+inline void sweep_partial(const TickView& v, const Trade& t, const SweepGrid& grid, SweepState<Long>& s, TradeOutcome* out) {
+    const size_t npos = std::numeric_limits<size_t>::max();
+    const double* px = Long ? v.bid : v.ask;
+    const double level = t.exit_price;
+    const double tol = 1e-12 * std::fabs(level);
+    const size_t windows = grid.ma_windows.size();
+    const size_t per_window = grid.wait_factors.size() * grid.min_wait_ms.size();
+    const size_t m = grid.min_wait_ms.size();
+
+    s.means.resize(windows);
+    for (size_t w = 0; w < windows; ++w)
+        s.means[w].reset(grid.ma_windows[w]);
+    s.prev_sma.assign(windows, 0.0);
+    s.reversals.assign(windows, ExitPoint<Long>());
+    s.cuts.clear();
+    s.thresholds.assign(grid.size(), { 0, 0 });
+    auto before = [](const SweepCut<Long>& c, const std::pair<int64_t, size_t>& x) {
+        return c.ts < x.first || (c.ts == x.first && c.from < x.second);
+    };
+
+    size_t pending = windows;       // windows still waiting for their T1
+    size_t passed = 0;              // cuts at or before the current tick
+    size_t open_from = 0;           // cuts before it have their drawdown snapshot
+    bool reversal_open = false;
+    int64_t reversal_ts = 0;
+    bool tp_found = false;
+    int64_t tp_ms = 0;
+    PricePath<Long> path;
+    for (size_t i = 0; i < v.count; ++i) {
+        int64_t ts = v.ts_ms[i];
+        if (reversal_open && ts != reversal_ts) {
+            for (auto& r : s.reversals)
+                r.close_before(ts, path);
+            reversal_open = false;
+        }
+        // cuts are only inserted past the passed ones, so these indices hold
+        for (; open_from < passed; ++open_from) {
+            s.cuts[open_from].best.close_before(ts, path);
+            if (s.cuts[open_from].best.open)
+                break;
+        }
+        if (pending == 0 && passed && passed == s.cuts.size() && s.cuts[passed - 1].diff == 0 && open_from == passed)
+            break;
+        double p = px[i];
+        path.add(p);
+        if (!tp_found && (Long ? p >= level : p <= level)) {
+            tp_found = true;
+            tp_ms = ts;
+        }
+        if (pending) {
+            for (size_t w = 0; w < windows; ++w) {
+                if (s.reversals[w].set)
+                    continue;
+                double sma = s.means[w].push(p);
+                if (i > 0 && reversal_cross<Long>(s.prev_sma[w], sma, level, tol)) {
+                    s.reversals[w].mark(ts, p);
+                    reversal_open = true;
+                    reversal_ts = ts;
+                    --pending;
+                    int64_t since_entry = (tp_found ? tp_ms : ts) - t.entry_ms;
+                    for (size_t k = 0; k < per_window; ++k) {
+                        int64_t thr = reversal_threshold(ts, since_entry, grid.wait_factors[k / m], grid.min_wait_ms[k % m]);
+                        std::pair<int64_t, size_t> key(thr, thr == ts ? i : 0);
+                        s.thresholds[w * per_window + k] = key;
+                        // key is past every passed cut: thr >= ts, and a cut at ts starts here
+                        auto at = std::lower_bound(s.cuts.begin() + passed, s.cuts.end(), key, before);
+                        if (at == s.cuts.end() || at->ts != key.first || at->from != key.second) {
+                            SweepCut<Long> cut;
+                            cut.ts = key.first;
+                            cut.from = key.second;
+                            s.cuts.insert(at, cut);
+                        }
+                    }
+                }
+                s.prev_sma[w] = sma;
+            }
+        }
+        while (passed < s.cuts.size() && s.cuts[passed].ts <= ts && s.cuts[passed].from <= i)
+            ++passed;
+        open_from = std::min(open_from, passed ? passed - 1 : 0);
+        if (passed) {
+            auto& c = s.cuts[passed - 1];
+            double diff = std::fabs(p - level);
+            if (diff < c.diff) {
+                c.diff = diff;
+                c.best.mark(ts, p);
+            }
+        }
+    }
+    for (auto& r : s.reversals)
+        if (r.open)
+            r.path = path;
+    for (; open_from < passed; ++open_from)
+        if (s.cuts[open_from].best.open)
+            s.cuts[open_from].best.path = path;
+
+    // a tie goes to the earlier segment: the first closest tick wins
+    s.chosen.assign(s.cuts.size(), npos);
+    for (size_t k = s.cuts.size(); k-- > 0;) {
+        size_t later = k + 1 < s.cuts.size() ? s.chosen[k + 1] : npos;
+        bool own = s.cuts[k].best.set && (later == npos || s.cuts[k].diff <= s.cuts[later].diff);
+        s.chosen[k] = own ? k : later;
+    }
+    for (size_t g = 0; g < grid.size(); ++g) {
+        const auto& reversal = s.reversals[g / per_window];
+        if (!reversal.set) {
+            out[g] = { TradeOutcome::Status::NoReversal };
+            continue;
+        }
+        auto at = std::lower_bound(s.cuts.begin(), s.cuts.end(), s.thresholds[g], before);
+        size_t c = s.chosen[static_cast<size_t>(at - s.cuts.begin())];
+        out[g] = finish(t, c != npos ? s.cuts[c].best : reversal);
+    }
+}
+
+} // namespace trade_detail
+
+// Per-thread state of sweep_trade, reused from trade to trade.
+struct SweepScratch {
+    trade_detail::SweepState<true> longs;
+    trade_detail::SweepState<false> shorts;
+    trade_detail::RollingMean mean;
+};
+
+// Outcomes of one trade under every grid point (out[g] as evaluate_trade would give
+// for grid.rule(g)), v being the ticks from its entry up to the grid's horizon.
+inline void sweep_trade(const TickView& v, const Trade& t, const SweepGrid& grid, SweepScratch& scratch, TradeOutcome* out) {
+    if (t.mode == ExitMode::Partial && v.count > 0) {
+        if (t.is_long)
+            trade_detail::sweep_partial<true>(v, t, grid, scratch.longs, out);
+        else
+            trade_detail::sweep_partial<false>(v, t, grid, scratch.shorts, out);
+        return;
+    }
+    TradeOutcome o = evaluate_trade(v, t, grid.rule(0), scratch.mean);
+    std::fill(out, out + grid.size(), o);
+}
+
+// One SweepRow per grid point (in grid order) over the whole journal. Threads take
+// blocks of trades as they finish one; every block sums into its own rows and the
+// blocks are added up in journal order, so totals do not depend on the scheduling.
+// 0 threads: one per core.
+inline std::vector<SweepRow> sweep_exit_rules(const TradeEvaluator& evaluator, const std::vector<Trade>& trades,
+                                              const SweepGrid& grid, size_t threads = 0) {
+    const size_t points = grid.size();
+    if (points == 0)
+        throw std::invalid_argument("Invalid sweep grid: no rules");
+    const size_t block = 64;
+    const size_t blocks = (trades.size() + block - 1) / block;
+    std::vector<SweepRow> partial(blocks * points);
+    const int64_t horizon = grid.horizon_ms;
+    const size_t workers = parallel_workers(blocks, threads);
+    std::vector<SweepScratch> scratch(workers);
+    std::vector<std::vector<TradeOutcome>> outcomes(workers, std::vector<TradeOutcome>(points));
+    parallel_indices(blocks, threads, [&](size_t worker, size_t b) {
+        SweepRow* rows = partial.data() + b * points;
+        for (size_t i = b * block; i < std::min(trades.size(), (b + 1) * block); ++i) {
+            const Trade& t = trades[i];
+            int64_t end = horizon > 0 ? t.entry_ms + horizon : std::numeric_limits<int64_t>::max();
+            sweep_trade(ticks_between(evaluator.ticks(), t.entry_ms, end), t, grid, scratch[worker], outcomes[worker].data());
+            for (size_t g = 0; g < points; ++g)
+                rows[g].add(outcomes[worker][g]);
+        }
+    });
+
+    std::vector<SweepRow> rows(points);
+    for (size_t g = 0; g < points; ++g) {
+        rows[g].rule = grid.rule(g);
+        for (size_t b = 0; b < blocks; ++b)
+            rows[g].add(partial[b * points + g]);
+    }
+    return rows;
+}
+
+enum class SweepRank { Return, Drawdown };
+
+inline SweepRank parse_sweep_rank(const std::string& s) {
+    if (s == "return")
+        return SweepRank::Return;
+    if (s == "drawdown")
+        return SweepRank::Drawdown;
+    throw std::invalid_argument("Invalid sweep ranking: " + s);
+}
+
+// Best first: highest total return, or shallowest worst drawdown (then return).
+// Equal rows keep grid order.
+inline void rank_sweep(std::vector<SweepRow>& rows, SweepRank by) {
+    std::stable_sort(rows.begin(), rows.end(), [by](const SweepRow& a, const SweepRow& b) {
+        if (by == SweepRank::Drawdown && a.worst_mdd_pct != b.worst_mdd_pct)
+            return a.worst_mdd_pct > b.worst_mdd_pct;
+        return a.total_ret > b.total_ret;
+    });
+}
+
+#endif // DUKASSWEEP_HPP
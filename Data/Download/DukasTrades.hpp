@@ -0,0 +1,368 @@
+#ifndef DUKASTRADES_HPP
+#define DUKASTRADES_HPP
+
+#include <stdexcept>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cmath>
+
+#include "DukasColumnStore.hpp"
+#include "DukasPipeline.hpp"
+
+// One journal trade: entered at entry_ms (the entry tick) and closed by the first
+// touch of exit_price (TP, SL) or by the reversal rule (Partial).
+enum class ExitMode { TP, SL, Partial };
+
+struct Trade {
+    int64_t entry_ms = 0;           // UTC epoch milliseconds
+    double entry_price = 0;
+    bool is_long = true;
+    double exit_price = 0;          // take profit (TP, Partial) or stop level (SL)
+    double stop = 0;                // stop loss; entry - stop is one unit of risk
+    double risk = 1;                // % of the account risked
+    ExitMode mode = ExitMode::TP;
+};
+
+struct TradeOutcome {
+    enum class Status { Ok, NoData, NoExit, NoReversal };
+    Status status = Status::NoData;
+    double ret = 0;                 // % of the account: R multiple * risk
+    double mdd_pct = 0;             // max drawdown of the exit-side price while open (<= 0)
+    double ulcer_pct = 0;           // ulcer index of that drawdown
+    int64_t exit_ms = 0;
+    double exit_price = 0;
+    size_t ticks = 0;               // ticks from entry through the exit timestamp
+};
+
+// Parameters of the Partial exit: after the SMA of the exit-side price crosses back
+// through the take profit (T1), wait max(wait_factor * (first TP touch - entry),
+// min_wait) and exit on the tick closest to the take profit from then on.
+struct ExitRule {
+    size_t ma_window = 10;
+    double wait_factor = 0.2;
+    int64_t min_wait_ms = 60000;
+    int64_t horizon_ms = 0;         // ticks looked at after entry (0: up to the end of the data)
+};
+
+namespace trade_detail {
+
+// Running drawdown of the exit-side price: from the running max for longs (bid), from
+// the running min for shorts (ask).
+template <bool Long>
+struct PricePath {
+    double extreme = 0;
+    double mdd = 0;
+    double sum_sq = 0;
+    size_t n = 0;
+
+    void add(double p) {
+        if (n == 0 || (Long ? p > extreme : p < extreme))
+            extreme = p;
+        double dd = Long ? (p - extreme) / extreme : (extreme - p) / extreme;
+        mdd = std::min(mdd, dd);
+        sum_sq += dd * dd;
+        ++n;
+    }
+};
+
+// An exit tick; its price path is taken once every tick of its timestamp is in, as
+// the drawdown covers all ticks stamped at or before the exit.
+template <bool Long>
+struct ExitPoint {
+    bool set = false;
+    bool open = false;
+    int64_t ts = 0;
+    double price = 0;
+    PricePath<Long> path;
+
+    void mark(int64_t t, double p) {
+        set = open = true;
+        ts = t;
+        price = p;
+    }
+
+    void close_before(int64_t t, const PricePath<Long>& current) {
+        if (open && t != ts) {
+            path = current;
+            open = false;
+        }
+    }
+};
+
+// SMA with min_periods = 1, re-summed each time its ring wraps so it does not drift.
+struct RollingMean {
+    std::vector<double> ring;
+    double sum = 0;
+    size_t filled = 0;
+    size_t slot = 0;
+
+    void reset(size_t window) {
+        ring.assign(std::max<size_t>(window, 1), 0.0);
+        sum = 0;
+        filled = slot = 0;
+    }
+
+    double push(double p) {
+        size_t w = ring.size();
+        sum += p - ring[slot];
+        ring[slot] = p;
+        slot = slot + 1 == w ? 0 : slot + 1;
+        filled = std::min(filled + 1, w);
+        if (slot == 0) {
+            sum = 0;
+            for (double x : ring)
+                sum += x;
+        }
+        return sum / static_cast<double>(filled);
+    }
+};
+
+template <bool Long>
+inline TradeOutcome finish(const Trade& t, const ExitPoint<Long>& exit) {
+    TradeOutcome out;
+    out.status = TradeOutcome::Status::Ok;
+    out.exit_ms = exit.ts;
+    out.exit_price = exit.price;
+    out.ticks = exit.path.n;
+    out.mdd_pct = exit.path.mdd * 100;
+    out.ulcer_pct = exit.path.n ? std::sqrt(exit.path.sum_sq / exit.path.n) * 100 : 0;
+    out.ret = Long ? (exit.price - t.entry_price) / (t.entry_price - t.stop) * t.risk
+                   : (t.entry_price - exit.price) / (t.stop - t.entry_price) * t.risk;
+    return out;
+}
+
+template <bool Long>
+inline TradeOutcome first_touch(const TickView& v, const Trade& t) {
+    const double* px = Long ? v.bid : v.ask;
+    const double level = t.exit_price;
+    const bool toward = t.mode == ExitMode::TP;
+    PricePath<Long> path;
+    ExitPoint<Long> exit;
+    for (size_t i = 0; i < v.count; ++i) {
+        if (exit.set) {
+            exit.close_before(v.ts_ms[i], path);
+            if (!exit.open)
+                break;
+        }
+        double p = px[i];
+        path.add(p);
+        if (!exit.set && (toward ? (Long ? p >= level : p <= level) : (Long ? p <= level : p >= level)))
+            exit.mark(v.ts_ms[i], p);
+    }
+    if (!exit.set)
+        return { TradeOutcome::Status::NoExit };
+    if (exit.open)
+        exit.path = path;
+    return finish(t, exit);
+}
+
+// T1 crossing of the SMA back through the take profit. An SMA within tol of the take
+// profit touches it, whatever order it was summed in.
+template <bool Long>
+inline bool reversal_cross(double prev_sma, double sma, double level, double tol) {
+    return Long ? prev_sma > level + tol && sma <= level + tol : prev_sma < level - tol && sma >= level - tol;
+}
+
+// first tick at or after T1 + max(wait_factor * (first TP touch - entry), min_wait)
+inline int64_t reversal_threshold(int64_t t1, int64_t since_entry, double wait_factor, int64_t min_wait_ms) {
+    int64_t wait = static_cast<int64_t>(std::ceil(wait_factor * static_cast<double>(since_entry)));
+    return t1 + std::max(wait, min_wait_ms);
+}
+
+template <bool Long>
+inline TradeOutcome partial_exit(const TickView& v, const Trade& t, const ExitRule& rule, RollingMean& mean) {
+    const double* px = Long ? v.bid : v.ask;
+    const double level = t.exit_price;
+    const double tol = 1e-12 * std::fabs(level);
+    mean.reset(rule.ma_window);
+    double prev_sma = 0;
+    bool tp_found = false, reversed = false;
+    int64_t tp_ms = 0, threshold = 0;
+    double best_diff = std::numeric_limits<double>::infinity();
+    PricePath<Long> path;
+    ExitPoint<Long> reversal, best;
+    for (size_t i = 0; i < v.count; ++i) {
+        int64_t ts = v.ts_ms[i];
+        reversal.close_before(ts, path);
+        best.close_before(ts, path);
+        // an exact touch of the take profit cannot be beaten by a later tick
+        if (best.set && !best.open && best_diff == 0)
+            break;
+        double p = px[i];
+        path.add(p);
+        double sma = mean.push(p);
+        if (!tp_found && (Long ? p >= level : p <= level)) {
+            tp_found = true;
+            tp_ms = ts;
+        }
+        if (!reversed && i > 0 && reversal_cross<Long>(prev_sma, sma, level, tol)) {
+            reversed = true;
+            reversal.mark(ts, p);
+            threshold = reversal_threshold(ts, (tp_found ? tp_ms : ts) - t.entry_ms, rule.wait_factor, rule.min_wait_ms);
+        }
+        if (reversed && ts >= threshold) {
+            double diff = std::fabs(p - level);
+            if (diff < best_diff) {
+                best_diff = diff;
+                best.mark(ts, p);
+            }
+        }
+        prev_sma = sma;
+    }
+    if (!reversed)
+        return { TradeOutcome::Status::NoReversal };
+    if (reversal.open)
+        reversal.path = path;
+    if (best.open)
+        best.path = path;
+    return finish(t, best.set ? best : reversal);
+}
+
+} // namespace trade_detail
+
+// Outcome of one trade over v, the ticks from its entry on (sorted by time). One
+// forward pass that stops at the exit; a Partial exit scans up to the end of v (or the
+// rule's horizon) for the tick closest to the take profit, unless it hits it exactly.
+// scratch holds the SMA window between calls.
+inline TradeOutcome evaluate_trade(const TickView& v, const Trade& t, const ExitRule& rule, trade_detail::RollingMean& scratch) {
+    if (v.count == 0)
+        return { TradeOutcome::Status::NoData };
+    if (t.mode == ExitMode::Partial)
+        return t.is_long ? trade_detail::partial_exit<true>(v, t, rule, scratch) : trade_detail::partial_exit<false>(v, t, rule, scratch);
+    return t.is_long ? trade_detail::first_touch<true>(v, t) : trade_detail::first_touch<false>(v, t);
+}
+
+// Evaluates trades against a tick store (ColumnStoreWriter layout, e.g. the
+// downloader's dir/ASSET_ticks), mapped once and shared by every thread.
+class TradeEvaluator {
+public:
+    explicit TradeEvaluator(const std::string& store_dir) : store(store_dir) {}
+
+    const ColumnStoreReader& ticks() const { return store; }
+
+    TradeOutcome evaluate(const Trade& t, const ExitRule& rule, trade_detail::RollingMean& scratch) const {
+        int64_t end = rule.horizon_ms > 0 ? t.entry_ms + rule.horizon_ms : std::numeric_limits<int64_t>::max();
+        return evaluate_trade(ticks_between(store, t.entry_ms, end), t, rule, scratch);
+    }
+
+    // Outcomes in the order of trades; threads take the next trade as they finish
+    // one, since trade lengths vary by orders of magnitude. 0 threads: one per core.
+    std::vector<TradeOutcome> evaluate_all(const std::vector<Trade>& trades, const ExitRule& rule, size_t threads = 0) const {
+        std::vector<TradeOutcome> out(trades.size());
+        std::vector<trade_detail::RollingMean> scratch(parallel_workers(trades.size(), threads));
+        parallel_indices(trades.size(), threads, [&](size_t worker, size_t i) {
+            out[i] = evaluate(trades[i], rule, scratch[worker]);
+        });
+        return out;
+    }
+
+private:
+    ColumnStoreReader store;
+};
+
+// days since 1970-01-01 of a proleptic Gregorian date (H. Hinnant's days_from_civil)
+inline int64_t days_from_civil(int y, int mo, int d) {
+    int yy = y - (mo <= 2);
+    int era = (yy >= 0 ? yy : yy - 399) / 400;
+    unsigned yoe = static_cast<unsigned>(yy - era * 400);
+    unsigned mp = static_cast<unsigned>((mo + 9) % 12);
+    unsigned doy = (153 * mp + 2) / 5 + static_cast<unsigned>(d) - 1;
+    unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return static_cast<int64_t>(era) * 146097 + doe - 719468;
+}
+
+// "YYYY-MM-DD HH:MM:SS[.mmm]" (or with a 'T'), or "DD/MM/YYYY HH:MM[:SS[.mmm]]" (or
+// "DD.MM.YYYY ...", as in Dukascopy exports), as UTC.
+inline bool parse_utc_ms(const std::string& s, int64_t& out) {
+    int y = 0, mo = 0, d = 0, h = 0, mi = 0;
+    double sec = 0;
+    char sep = 0;
+    bool iso = std::sscanf(s.c_str(), "%4d-%2d-%2d%c%2d:%2d:%lf", &y, &mo, &d, &sep, &h, &mi, &sec) == 7 && (sep == ' ' || sep == 'T');
+    if (!iso && std::sscanf(s.c_str(), "%2d/%2d/%4d %2d:%2d:%lf", &d, &mo, &y, &h, &mi, &sec) < 5
+             && std::sscanf(s.c_str(), "%2d.%2d.%4d %2d:%2d:%lf", &d, &mo, &y, &h, &mi, &sec) < 5)
+        return false;
+    if (mo < 1 || mo > 12 || d < 1 || d > 31 || h < 0 || h > 23 || mi < 0 || mi > 59 || sec < 0 || sec >= 61)
+        return false;
+    int64_t ms = std::llround(sec * 1000);
+    out = (days_from_civil(y, mo, d) * 86400 + h * 3600 + mi * 60) * 1000 + ms;
+    return true;
+}
+
+inline ExitMode parse_exit_mode(std::string s) {
+    for (auto& c : s)
+        c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+    if (s == "TP")
+        return ExitMode::TP;
+    if (s == "SL")
+        return ExitMode::SL;
+    if (s == "PARTIAL")
+        return ExitMode::Partial;
+    throw std::invalid_argument("Invalid exit mode: " + s);
+}
+
+// Trades from a CSV journal with the columns
+//   entry_time,type,entry_price,exit_price,sl,risk,exit_mode
+// (type long/short, exit_mode TP/SL/Partial); a header line is skipped.
+inline std::vector<Trade> read_trades_csv(const std::string& path) {
+    std::ifstream in(path);
+    if (!in.is_open())
+        throw std::runtime_error("Cannot open trades file " + path);
+    std::vector<Trade> trades;
+    std::string line;
+    size_t line_no = 0;
+    while (std::getline(in, line)) {
+        ++line_no;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty())
+            continue;
+        std::vector<std::string> f;
+        std::stringstream ss(line);
+        std::string cell;
+        while (std::getline(ss, cell, ','))
+            f.push_back(cell);
+        Trade t;
+        if (f.size() < 7 || !parse_utc_ms(f[0], t.entry_ms)) {
+            if (line_no == 1)
+                continue;
+            throw std::runtime_error("Invalid trade on line " + std::to_string(line_no) + " of " + path);
+        }
+        std::string type = f[1];
+        for (auto& c : type)
+            c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+        if (type != "long" && type != "short")
+            throw std::runtime_error("Invalid trade type on line " + std::to_string(line_no) + " of " + path);
+        t.is_long = type == "long";
+        try {
+            t.entry_price = std::stod(f[2]);
+            t.exit_price = std::stod(f[3]);
+            t.stop = std::stod(f[4]);
+            t.risk = std::stod(f[5]);
+            t.mode = parse_exit_mode(f[6]);
+        }
+        catch (const std::exception&) {
+            throw std::runtime_error("Invalid trade on line " + std::to_string(line_no) + " of " + path);
+        }
+        trades.push_back(t);
+    }
+    return trades;
+}
+
+inline const char* status_name(TradeOutcome::Status s) {
+    switch (s) {
+    case TradeOutcome::Status::Ok: return "ok";
+    case TradeOutcome::Status::NoData: return "no_data";
+    case TradeOutcome::Status::NoExit: return "no_exit";
+    case TradeOutcome::Status::NoReversal: return "no_reversal";
+    }
+    return "";
+}
+
+#endif // DUKASTRADES_HPP
@@ -2,7 +2,14 @@
 
 int main() {
     DukascopyDownloader downloader("BTCUSD", "2023-01-01", "2025-03-19", "", "DOWNLOAD_PATH", "POSTGRE_URL", 1); // 1: Progress Bar, 2: Verbose
+    downloader.set_fetch_concurrency(16); // hour files in flight
+    downloader.set_decode_threads(4);     // parallel LZMA workers
+    // downloader.set_timeframes({ "5m", "1h", "1d" }); // more bar files/tables from the same pass
+    // downloader.set_activity_bars({ "1000tick", "1e7dollar", "500tib" });
+    // downloader.set_tick_filter(TickFilter::Config()); // list spikes, crossed and zero quotes in ASSET_flags.csv (action: drop or repair them)
     downloader.download();
+    // in-process instead of files: for (DataBatch& b : *downloader.stream()) { ... b.ticks / b.bars ... }
+    // backtest while downloading: Backtester bt(my_strategy, Backtester::Config()); downloader.add_sink(&bt); (DukasBacktest.hpp)
     return 0;
 }
 
@@ -0,0 +1,24 @@
+#include "DukasScheduler.hpp"
+
+// usage: DukascopyBatch manifest.txt [workers] [requests_per_second] [metrics.prom|metrics.jsonl]
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " manifest.txt [workers] [requests_per_second] [metrics.prom|metrics.jsonl]" << std::endl;
+        return 2;
+    }
+    DownloadScheduler::Config config;
+    if (argc > 2)
+        config.workers = std::stoul(argv[2]);
+    if (argc > 3)
+        config.requests_per_second = std::stod(argv[3]);
+    if (argc > 4) {
+        config.metrics_path = argv[4];
+        if (std::filesystem::path(config.metrics_path).extension() == ".jsonl")
+            config.metrics_format = MetricsExporter::Format::JsonLines;
+    }
+    DownloadScheduler scheduler(load_manifest(argv[1]), config);
+    int failed = 0;
+    for (const auto& outcome : scheduler.run())
+        failed += outcome.ok ? 0 : 1;
+    return failed == 0 ? 0 : 1;
+}
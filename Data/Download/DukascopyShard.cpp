@@ -0,0 +1,37 @@
+#include "DukasShard.hpp"
+#include "DukasScheduler.hpp" // split_list
+
+// Sharded backfill. Start any number of workers (processes or hosts) on the same
+// ledger directory, then merge once they are done:
+//
+//   DukascopyShard work  LEDGER WORKER_ID ASSETS START END [TIMEFRAME]
+//   DukascopyShard merge LEDGER ASSETS START END OUT_DIR [TIMEFRAME]
+//
+// ASSETS is a comma list, END is exclusive. Locally:
+//   for i in 1 2 3 4; do ./DukascopyShard work /tmp/ledger w$i EURUSD,USDJPY 2024-01-01 2024-02-01 & done; wait
+//   ./DukascopyShard merge /tmp/ledger EURUSD,USDJPY 2024-01-01 2024-02-01 ./out
+int main(int argc, char** argv) {
+    std::string mode = argc > 1 ? argv[1] : "";
+    bool work = mode == "work" && argc >= 7;
+    bool merge = mode == "merge" && argc >= 7;
+    if (!work && !merge) {
+        std::cerr << "usage: " << argv[0] << " work LEDGER WORKER_ID ASSETS START END [TIMEFRAME]\n"
+            << "       " << argv[0] << " merge LEDGER ASSETS START END OUT_DIR [TIMEFRAME]" << std::endl;
+        return 2;
+    }
+    int a = work ? 4 : 3;
+    ShardPlan plan;
+    plan.assets = split_list(argv[a]);
+    plan.start_date = argv[a + 1];
+    plan.end_date = argv[a + 2];
+    plan.archive = true;
+    if (argc > 7)
+        plan.timeframe = argv[7];
+    if (work) {
+        ShardWorker worker(argv[2], argv[3], plan);
+        std::cout << worker.run() << " units completed by " << argv[3] << std::endl;
+    }
+    else
+        std::cout << merge_shards(argv[2], plan, argv[6]) << " days merged" << std::endl;
+    return 0;
+}
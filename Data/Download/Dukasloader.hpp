@@ -5,6 +5,7 @@
 #include <sstream>
 #include <iomanip>
 #include <cstring>
+#include <cstdlib>
 #include <string>
 #include <vector>
 #include <limits>
@@ -14,6 +15,26 @@
 #include <cmath>
 #include <regex>
 #include <thread>
+#include <memory>
+#include <atomic>
+#include <mutex>
+
+#include "DukasFetcher.hpp"
+#include "DukasPipeline.hpp"
+#include "DukasDecoder.hpp"
+#include "DukasPgCopy.hpp"
+#include "DukasPgPipeline.hpp"
+#include "DukasCache.hpp"
+#include "DukasColumnStore.hpp"
+#include "DukasArchive.hpp"
+#include "DukasBars.hpp"
+#include "DukasJournal.hpp"
+#include "DukasCalendar.hpp"
+#include "DukasCsv.hpp"
+#include "DukasSink.hpp"
+#include "DukasMetrics.hpp"
+#include "DukasBuffers.hpp"
+#include "DukasQuality.hpp"
 
 #ifdef _WIN32
 #include <conio.h>
@@ -40,6 +61,28 @@ inline time_t portable_timegm(std::tm* tm) {
 #endif
 }
 
+// Once per process, whoever needs cURL first: downloaders may be constructed on
+// several threads (DownloadScheduler). Cleaned up at exit.
+inline void init_curl() {
+    static std::once_flag once;
+    static CURLcode res = CURLE_OK;
+    std::call_once(once, []() {
+        res = curl_global_init(CURL_GLOBAL_DEFAULT);
+        if (res == CURLE_OK)
+            std::atexit(curl_global_cleanup);
+    });
+    if (res != CURLE_OK)
+        throw std::runtime_error(std::string("Failed to initialize cURL: ") + curl_easy_strerror(res));
+}
+
+// Answers to the constructor's questions, so a run can be scripted.
+struct DownloadChoices {
+    char existing = 'u';  // output already exists: Update (u) or Restart (r)
+    char until = 'e';     // update to: End date (e) or Now (n)
+    char mode = 'f';      // when updating to now: Fixed point (f) or Livestream (l)
+    char overwrite = 'n'; // remove an existing output file (y/n)
+};
+
 class DukascopyDownloader {
 public:
     DukascopyDownloader(
@@ -49,11 +92,14 @@ public:
         const std::string& download_dir = "",
         const std::string& timeframe = "",
         const std::string& pg_url = "",
-        int verbose_level = 2
-    ) : asset(asset), download_dir(download_dir), verbose_level(verbose_level), pg_url(pg_url)
+        int verbose_level = 2,
+        const DownloadChoices* choices = nullptr
+    ) : asset(asset), download_dir(download_dir), verbose_level(verbose_level), pg_url(pg_url),
+        scripted(choices != nullptr), choices(choices ? *choices : DownloadChoices())
     {
         if (!timeframe.empty()) {
             parse_timeframe(timeframe);
+            bar_timeframes.push_back(timeframe);
             aggregation_enabled = true;
         }
         else {
@@ -64,6 +110,8 @@ public:
         parse_dates(start_date, end_date);
         try {
             double point = determine_scaling(asset);
+            tick_decoder = Bi5Decoder(point);
+            csv_emitter.set_point(point);
             std::cout << "Asset: " << asset << ", Point: " << point << std::endl;
 
                 std::string count_str = PQgetvalue(res, 0, 0);
@@ -74,7 +122,9 @@ public:
             if (table_exists) {
                 std::cout << "Table \"" << table_name << "\" already exists. Update (u) or Restart (r)? ";
                 char response;
-                std::cin >> response;
+                response = answer(&DownloadChoices::existing);
+                if (response == 'r' || response == 'R')
+                    restart_mode = true;
 
                 if (response == 'u' || response == 'U') {
                     update_mode = true;
@@ -97,14 +147,14 @@ public:
                                 std::cout << "Last data point: " << last_ts << std::endl;
                                 std::cout << "Download from last data point to: End date (e), Now (n)? ";
                                 char update_option;
-                                std::cin >> update_option;
+                                update_option = answer(&DownloadChoices::until);
                                 
                                 if (update_option == 'n' || update_option == 'N') {
                                     end_time = std::chrono::system_clock::now();
                                     
                                     std::cout << "Download mode: Fixed point (f), Livestream (l)? ";
                                     char stream_option;
-                                    std::cin >> stream_option;
+                                    stream_option = answer(&DownloadChoices::mode);
                                     
                                     if (stream_option == 'l' || stream_option == 'L') {
                                         livestream_mode = true;
@@ -127,15 +177,12 @@ public:
             if (std::filesystem::exists(csv_path)) {
                 std::cout << "CSV file " << csv_path << " already exists. Update (u) or Restart (r)? ";
                 char response;
-                std::cin >> response;
+                response = answer(&DownloadChoices::existing);
+                if (response == 'r' || response == 'R')
+                    restart_mode = true;
                 if (response == 'u' || response == 'U') {
                     update_mode = true;
-                    std::ifstream infile(csv_path);
-                    std::string line, last;
-                    while (std::getline(infile, line)) {
-                        if (!line.empty())
-                            last = line;
-                    }
+                    std::string last = read_last_line(csv_path);
                     if (!last.empty()) {
                         std::istringstream iss(last);
                         std::string ts;
@@ -151,14 +198,14 @@ public:
                                     std::cout << "Last data point: " << ts << std::endl;
                                     std::cout << "Download from last data point to: End date (e), Now (n)? ";
                                     char update_option;
-                                    std::cin >> update_option;
+                                    update_option = answer(&DownloadChoices::until);
                                     
                                     if (update_option == 'n' || update_option == 'N') {
                                         end_time = std::chrono::system_clock::now();
                                         
                                         std::cout << "Download mode: Fixed point (f), Livestream (l)? ";
                                         char stream_option;
-                                        std::cin >> stream_option;
+                                        stream_option = answer(&DownloadChoices::mode);
                                         
                                         if (stream_option == 'l' || stream_option == 'L') {
                                             livestream_mode = true;
@@ -173,7 +220,7 @@ public:
                             }
 
             char response;
-            std::cin >> response;
+            response = answer(&DownloadChoices::overwrite);
             if (response == 'y' || response == 'Y') {
                 std::error_code ec;
                 if (std::filesystem::remove(outputFile, ec))
@@ -187,44 +234,471 @@ public:
         }
         return true;
     }
+    // one .bi5 hour travelling through the download pipeline
+    struct HourData {
+        std::chrono::system_clock::time_point hour;
+        std::string url;
+        long http_code = 0;
+        size_t bytes = 0;
+        bool from_cache = false;
+        bool decoded = false;
+        std::vector<uint8_t> compressed;
+        std::vector<uint8_t> decompressed;
+        TickBatch ticks;
+    };
+
+    // Number of hour files the fetch stage keeps in flight; 1 reproduces the old one-by-one fetch.
+    void set_fetch_concurrency(size_t n) {
+        fetch_concurrency = std::max<size_t>(1, n);
+    }
+
+    // Threads running decompress_lzma in parallel.
+    void set_decode_threads(size_t n) {
+        pipeline_config.decode_threads = std::max<size_t>(1, n);
+    }
+
+    // Rows per Postgres COPY transaction; 0 commits once per hour. With the journal on,
+    // every hour is committed as well before it is checkpointed.
+    void set_pg_flush_rows(size_t n) {
+        pg_flush_rows = n;
+    }
+
+    // How often livestream() re-fetches the in-progress hour.
+    void set_live_poll_interval(std::chrono::milliseconds interval) {
+        live_poll_interval = interval;
+    }
+
+    // Base URL of the hour files, e.g. a local HTTP stand-in serving a growing .bi5.
+    void set_datafeed_url(const std::string& url) {
+        datafeed_url = url;
+    }
+
+    // Keeps raw .bi5 hours (and known closed hours) under dir so re-runs work offline.
+    void set_cache_dir(const std::string& dir) {
+        cache = dir.empty() ? nullptr : std::make_unique<Bi5Cache>(dir);
+    }
+
+    // Also writes ticks to a memory-mappable column store in dir/ASSET_ticks (appends on
+    // update, starts over on restart like the CSV and table).
+    void set_tick_store_dir(const std::string& dir) {
+        tick_store.reset();
+        tick_store_root = dir;
+        if (dir.empty())
+            return;
+        std::string path = dir + "/" + asset + "_ticks";
+        if (restart_mode) {
+            std::error_code ec;
+            std::filesystem::remove_all(path, ec);
+        }
+        tick_store = std::make_unique<ColumnStoreWriter>(path, tick_store_columns());
+    }
+
+    // Also writes ticks to a compressed archive dir/ASSET_ticks.dka (appends on update,
+    // starts over on restart).
+    void set_archive_dir(const std::string& dir) {
+        tick_archive.reset();
+        if (dir.empty())
+            return;
+        std::string path = dir + "/" + asset + "_ticks.dka";
+        if (restart_mode) {
+            std::error_code ec;
+            std::filesystem::remove(path, ec);
+        }
+        tick_archive = std::make_unique<TickArchiveWriter>(path, tick_decoder.price_point());
+    }
+
+    // Hours allowed between the fetch stage and the writer; bounds memory when the sink lags.
+    void set_pipeline_depth(size_t n) {
+        pipeline_config.max_buffered = std::max<size_t>(1, n);
+    }
+
+    // More bar timeframes ("1m", "1h", "1d", ...) built in the same pass as the constructor's.
+    // Each one gets download_dir/ASSET_<tf>.csv, table asset_<tf> and, with a tick store,
+    // a column store ASSET_<tf> next to it.
+    void set_timeframes(const std::vector<std::string>& extra) {
+        bar_timeframes.resize(aggregation_enabled ? 1 : 0);
+        for (const auto& tf : extra) {
+            timeframe_to_ms(tf);
+            if (std::find(bar_timeframes.begin(), bar_timeframes.end(), tf) == bar_timeframes.end())
+                bar_timeframes.push_back(tf);
+        }
+    }
+
+    // Checkpoint journal of committed hours used to resume an update exactly; defaults to
+    // download_dir/ASSET_<timeframe|ticks>.journal, an empty path turns it off.
+    void set_journal_path(const std::string& path) {
+        journal_file = path;
+        journal_enabled = !path.empty();
+    }
+
+    // Overrides the date range with exact hours, both included (e.g. one shard of a backfill).
+    void set_hours(std::chrono::system_clock::time_point first, std::chrono::system_clock::time_point last) {
+        start_time = first;
+        end_time = last;
+    }
+
+    // Keeps what the trading calendar learns from 404s in dir/ASSET.calendar across runs.
+    void set_calendar_dir(const std::string& dir) {
+        calendar_dir = dir;
+    }
+
+    // Shares a process-wide request budget; throttled hours are retried with backoff.
+    void set_request_budget(RequestBudget* budget) {
+        request_budget = budget;
+    }
+
+    // Activity-sampled bars ("1000tick", "50vol", "1e7dollar", "500tib", "500vrb", ...,
+    // see ActivityBarBuilder), written like the extra timeframes to ASSET_<spec>.csv,
+    // table asset_<spec> and a column store, with millisecond bar start times.
+    void set_activity_bars(const std::vector<std::string>& specs) {
+        activity_bars.clear();
+        for (const auto& spec : specs) {
+            if (!ActivityBarBuilder::is_spec(spec))
+                throw std::invalid_argument("Invalid bar spec: " + spec);
+            activity_bars.emplace_back(spec);
+        }
+    }
+
+    // Checks every tick before any output sees it (spikes, crossed or non-positive
+    // quotes, wide spreads, frozen quotes; see TickFilter) and flags, drops or repairs
+    // the bad ones. Each hour's counts go to download_dir/ASSET_quality.csv and, unless
+    // they are dropped, the flagged ticks to ASSET_flags.csv (Timestamp,Ask,Bid,Flags
+    // with the TickFlag bits), the only place Flag leaves a mark on the output.
+    void set_tick_filter(TickFilter::Config config) {
+        if (config.point <= 0)
+            config.point = tick_decoder.price_point();
+        tick_filter = std::make_unique<TickFilter>(config);
+    }
+
+    // The filter, if set; its flags() belong to the batch a sink's on_ticks is called with
+    // (Flag and Repair actions, except in the checkpoint hour of a resumed run).
+    const TickFilter* quality_filter() const {
+        return tick_filter.get();
+    }
+
+    // Hands every tick batch and every hour's bars to sink as well, after the CSV and
+    // Postgres outputs (which are sinks themselves). The sink is not owned.
+    void add_sink(DataSink* sink) {
+        sinks.push_back(sink);
+    }
+
+    // Pull-style access: download() runs on a background thread and its batches are
+    // read from the returned stream, e.g. `for (DataBatch& b : *downloader.stream())`.
+    std::unique_ptr<DataStream> stream(size_t depth = 16) {
+        return std::make_unique<DataStream>([this](DataSink& sink) {
+            add_sink(&sink);
+            try {
+                download();
+            }
+            catch (...) {
+                sinks.erase(std::remove(sinks.begin(), sinks.end(), &sink), sinks.end());
+                throw;
+            }
+            sinks.erase(std::remove(sinks.begin(), sinks.end(), &sink), sinks.end());
+        }, depth);
+    }
+
+    // What the last download() did, with the CPU time of each pipeline stage summed
+    // over its threads (fetch: curl and the fetch loop, lzma: decompression, parse:
+    // .bi5 records to TickBatch, sink: outputs, bars and journal).
+    struct DownloadStats {
+        std::atomic<uint64_t> files{ 0 };
+        std::atomic<uint64_t> ticks{ 0 };
+        std::atomic<uint64_t> bytes{ 0 };
+        std::atomic<uint64_t> fetch_cpu_ns{ 0 };
+        std::atomic<uint64_t> lzma_cpu_ns{ 0 };
+        std::atomic<uint64_t> parse_cpu_ns{ 0 };
+        std::atomic<uint64_t> sink_cpu_ns{ 0 };
+
+        void reset() {
+            for (auto* c : { &files, &ticks, &bytes, &fetch_cpu_ns, &lzma_cpu_ns, &parse_cpu_ns, &sink_cpu_ns })
+                c->store(0);
+        }
+    };
+
+    const DownloadStats& stats() const {
+        return run_stats;
+    }
+
+    // Per-stage counters and latency histograms, e.g. exported by a MetricsExporter;
+    // nullptr (the default) or metrics->enabled = false turns the instrumentation off.
+    void set_metrics(PipelineMetrics* m) {
+        metrics = m;
+    }
+
+    // fetch (1 thread, fetch_concurrency transfers) -> LZMA decode + parse to TickBatch
+    // (decode_threads) -> filter + sink (calling thread, chronological order)
     void download() {
-        auto current_time = start_time;
+        run_stats.reset();
+        open_bar_outputs();
+        open_journal();
+        open_quality_log();
         int total_hours = std::chrono::duration_cast<std::chrono::hours>(end_time - start_time).count();
-        int current_index = 0;
         size_t total_bytes_downloaded = 0;
         auto overall_start = std::chrono::steady_clock::now();
 
-        while (current_time <= end_time) {
+        HourPipeline<HourData> pipeline(pipeline_config);
+        pipeline.run(
+            [&](const HourPipeline<HourData>::Emit& emit) {
+                uint64_t cpu = thread_cpu_ns();
+                fetch_hours(emit);
+                run_stats.fetch_cpu_ns += thread_cpu_ns() - cpu;
+            },
+            [&](HourData& h) {
+                bool timed = metrics_on();
+                auto t0 = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+                uint64_t cpu = thread_cpu_ns();
+                if (h.http_code == 200 && !h.compressed.empty()) {
+                    h.decompressed = decompressed_pool.acquire();
+                    h.decoded = decompress_lzma(h.compressed, h.decompressed);
+                    if (h.decoded && cache && !h.from_cache)
+                        cache->store(asset, h.hour, h.compressed);
+                }
+                compressed_pool.release(std::move(h.compressed));
+                uint64_t unpacked = thread_cpu_ns();
+                run_stats.lzma_cpu_ns += unpacked - cpu;
+                auto t1 = timed ? std::chrono::steady_clock::now() : t0;
+                if (timed)
+                    metrics->lzma_seconds.observe(t1 - t0);
+                if (h.decoded) {
+                    spare_batches.try_pop(h.ticks);
+                    h.ticks.clear();
+                    int64_t hour_ms = std::chrono::duration_cast<std::chrono::milliseconds>(h.hour.time_since_epoch()).count();
+                    tick_decoder.decode(h.decompressed, hour_ms, h.ticks);
+                    run_stats.parse_cpu_ns += thread_cpu_ns() - unpacked;
+                    if (timed) {
+                        metrics->parse_seconds.observe(std::chrono::steady_clock::now() - t1);
+                        metrics->files_decoded.add();
+                        metrics->ticks_parsed.add(h.ticks.size());
+                    }
+                }
+                decompressed_pool.release(std::move(h.decompressed));
+            },
+            [&](HourData& h) {
+                total_bytes_downloaded += h.bytes;
+                run_stats.bytes += h.bytes;
+                if (h.decoded) {
+                    bool timed = metrics_on();
+                    auto t0 = timed ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+                    uint64_t cpu = thread_cpu_ns();
+                    run_stats.files += 1;
+                    run_stats.ticks += h.ticks.size();
+                    if (tick_filter)
+                        filter_ticks(h.ticks);
+                    process_ticks(h.ticks);
+                    spare_batches.try_push(std::move(h.ticks));
+                    end_hour();
+                    commit_hour(h.hour);
+                    end_quality_hour(h.hour);
+                    run_stats.sink_cpu_ns += thread_cpu_ns() - cpu;
+                    if (timed)
+                        metrics->sink_seconds.observe(std::chrono::steady_clock::now() - t0);
+                }
+                else if (h.http_code != 200)
+                    log("HTTP " + std::to_string(h.http_code) + " for " + h.url + ", hour skipped.");
+                else if (h.bytes > 0)
+                    log("LZMA decoding error for " + h.url + ", hour skipped.");
+                if (verbose_level == 1) {
+                    int current_index = std::chrono::duration_cast<std::chrono::hours>(h.hour - start_time).count() + 1;
+                    update_progress(current_index, total_hours, total_bytes_downloaded, overall_start);
+                }
+            });
+        bars.flush(bar_sink);
+        end_hour();
+        if (quality_csv.is_open())
+            quality_csv.flush();
+        if (flags_csv.is_open())
+            flags_csv.flush();
+        if (verbose_level == 1)
+            std::cout << std::endl;
+        if (livestream_mode)
+            livestream();
+        for_each_sink([](DataSink& sink) { sink.on_finish(); });
+    }
+
+    // Follows the live edge: re-fetches the in-progress hour every live_poll_interval
+    // over one kept-alive connection, keeps only ticks newer than the last one written
+    // and queues their inserts in libpq pipeline mode, so commits overlap the next
+    // poll. Reports tick-to-commit lag. Press 'q' to stop.
+    void livestream() {
+        if (pg_copy) {
+            pg_copy->commit();
+            pg_copy.reset();
+        }
+        if (pg_conn) {
+            std::string table_name = sanitize_identifier(asset) + (aggregation_enabled ? "_" + sanitize_identifier(timeframe) : "_tickdata");
+            pg_live = std::make_unique<PgPipelineWriter>(pg_conn);
+            pg_live_statement = pg_live->prepare(table_name, aggregation_enabled ? 10 : 4);
+            for (auto& out : bar_outputs) {
+                if (!out || !out->pg)
+                    continue;
+                out->pg->commit();
+                out->pg.reset();
+                out->live_statement = pg_live->prepare(out->table, 10);
+            }
+        }
+        DukasFetcher fetcher(1);
+        fetcher.set_budget(request_budget);
+        std::vector<uint8_t> decompressed;
+        TickBatch ticks;
+        std::vector<PgPipelineWriter::CommitReport> reports;
+        auto hour = std::chrono::floor<std::chrono::hours>(std::chrono::system_clock::now());
+        std::cout << "Livestream started, press 'q' to stop." << std::endl;
+
+        while (true) {
+            auto poll_start = std::chrono::steady_clock::now();
+            auto now_hour = std::chrono::floor<std::chrono::hours>(std::chrono::system_clock::now());
+
             std::tm tm_base = {};
-            time_t t = std::chrono::system_clock::to_time_t(current_time);
-            gmtime_s(&tm_base, &t);
+            time_t t = std::chrono::system_clock::to_time_t(hour);
             portable_gmtime(&tm_base, &t);
-            int year = tm_base.tm_year + 1900;
-            int month = tm_base.tm_mon + 1;
-            int day = tm_base.tm_mday;
-            int hour = tm_base.tm_hour;
-            std::ostringstream oss_url;
-            oss_url << "https://datafeed.dukascopy.com/datafeed/" << asset << "/"
-                << std::put_time(&tm_base, "%Y/")
-                << std::setw(2) << std::setfill('0') << tm_base.tm_mon << "/"
-                << std::put_time(&tm_base, "%d/")
-                << std::put_time(&tm_base, "%H") << "h_ticks.bi5";
-            std::string url = oss_url.str();
+            fetcher.submit(hour, hour_url(tm_base));
+            DukasFetcher::Result fetched;
+            fetcher.next(fetched);
+            if (fetched.http_code == 200 && !fetched.data.empty() && decompress_lzma(fetched.data, decompressed)) {
+                ticks.clear();
+                int64_t hour_ms = std::chrono::duration_cast<std::chrono::milliseconds>(hour.time_since_epoch()).count();
+                tick_decoder.decode(decompressed, hour_ms, ticks);
+                ticks.drop_through(last_tick_ms);
+                if (tick_filter && !ticks.empty()) {
+                    // dropped ticks are not seen again by the next poll
+                    last_tick_ms = std::max(last_tick_ms, ticks.ts_ms.back());
+                    filter_ticks(ticks);
+                }
+                if (!ticks.empty()) {
+                    process_ticks(ticks);
+                    end_hour();
+                    if (csv_file.is_open())
+                        csv_file.flush();
+                    for (auto& out : bar_outputs) {
+                        if (out && out->csv.is_open())
+                            out->csv.flush();
+                    }
+                    log("Live: " + std::to_string(ticks.size()) + " new ticks");
+                }
+            }
+            else if (fetched.http_code == 200 && !fetched.data.empty()) {
+                log("Live: LZMA decoding error for " + fetched.url);
+            }
+            else if (fetched.http_code != 404 && fetched.http_code != 200) {
+                log("Live: HTTP " + std::to_string(fetched.http_code) + " for " + fetched.url);
+            }
+            // the hour that just closed was fetched once more above, move to the next one
+            if (now_hour > hour) {
+                end_quality_hour(hour);
+                if (quality_csv.is_open())
+                    quality_csv.flush();
+                if (flags_csv.is_open())
+                    flags_csv.flush();
+                hour += std::chrono::hours(1);
+            }
+
+            if (pg_live) {
+                reports.clear();
+                pg_live->poll(reports);
+                report_live_lag(reports);
+            }
+            if (_kbhit()) {
+                char key = _getch();
+                if (key == 'q' || key == 'Q')
+                    break;
+            }
+            std::this_thread::sleep_until(poll_start + live_poll_interval);
+        }
 
+        bars.flush(bar_sink);
+        end_hour();
+        if (pg_live) {
+            pg_live->end_batch();
+            reports.clear();
+            pg_live->drain(&reports);
+            report_live_lag(reports);
+            pg_live.reset();
+        }
+        std::cout << std::endl << "Livestream stopped, max lag " << live_max_lag_ms << " ms." << std::endl;
+    }
+
+    void report_live_lag(const std::vector<PgPipelineWriter::CommitReport>& reports) {
+        for (const auto& r : reports) {
+            live_max_lag_ms = std::max(live_max_lag_ms, r.oldest_lag_ms());
             if (verbose_level == 2)
-                log("Starting download for " + url);
-
-            auto download_start = std::chrono::steady_clock::now();
-            std::vector<uint8_t> compressed_data;
-            int http_code = download_file(url, compressed_data);
-            if (http_code == 404) {
-                if (verbose_level == 2)
-                    log("Received 404 for " + url + ", skipping the entire day.");
-                current_time = skip_day(current_time);
-                current_index += (24 - hour);
+                log("Live commit: " + std::to_string(r.rows) + " rows, lag newest " + std::to_string(r.newest_lag_ms())
+                    + " ms, oldest " + std::to_string(r.oldest_lag_ms()) + " ms");
+            else if (verbose_level == 1)
+                std::cout << "\rLive: " << r.rows << " rows committed, lag " << r.newest_lag_ms()
+                    << " ms (max " << live_max_lag_ms << " ms)   " << std::flush;
+        }
+    }
+
+    // Fetch stage: issues hour requests through DukasFetcher and emits them in
+    // chronological order. Hours the trading calendar knows to be closed are never
+    // requested; a 404 on an hour it expected open is a gap of that hour only.
+    void fetch_hours(const HourPipeline<HourData>::Emit& emit) {
+        auto next_request = start_time;
+        DukasFetcher fetcher(fetch_concurrency);
+        fetcher.set_budget(request_budget);
+        fetcher.set_buffer_pool(&compressed_pool);
+        TradingCalendar calendar(TradingCalendar::classify(asset),
+            calendar_dir.empty() ? "" : calendar_dir + "/" + asset + ".calendar");
+        size_t closed_hours = 0, gap_hours = 0;
+
+        while (true) {
+            while (next_request <= end_time && fetcher.pending() < fetch_concurrency) {
+                if (!calendar.is_open(next_request)) {
+                    ++closed_hours;
+                    next_request += std::chrono::hours(1);
+                    continue;
+                }
+                std::tm tm_request = {};
+                time_t t_request = std::chrono::system_clock::to_time_t(next_request);
+                portable_gmtime(&tm_request, &t_request);
+                std::string request_url = hour_url(tm_request);
+                Bi5Cache::State cached = cache ? cache->lookup(asset, next_request) : Bi5Cache::State::Missing;
+                std::vector<uint8_t> cached_data;
+                if (cached == Bi5Cache::State::Closed)
+                    fetcher.submit_completed(next_request, request_url, 404, {});
+                else if (cached == Bi5Cache::State::Cached && cache->load(asset, next_request, cached_data))
+                    fetcher.submit_completed(next_request, request_url, 200, std::move(cached_data));
+                else {
+                    if (verbose_level == 2)
+                        log("Starting download for " + request_url);
+                    fetcher.submit(next_request, request_url);
+                }
+                next_request += std::chrono::hours(1);
+            }
+            DukasFetcher::Result fetched;
+            if (!fetcher.next(fetched))
+                break;
+            if (metrics_on())
+                record_fetch(fetched);
+            if (fetched.curl_code != CURLE_OK)
+                log("cURL error for " + fetched.url + ": " + curl_easy_strerror(fetched.curl_code));
+            // 200 bodies are cached by the decode stage, once they are known to decode
+            if (cache && !fetched.from_cache && fetched.curl_code == CURLE_OK && fetched.http_code == 404)
+                cache->mark_closed(asset, fetched.hour);
+            if (fetched.curl_code == CURLE_OK)
+                calendar.observe(fetched.hour, fetched.http_code);
+            if (fetched.http_code == 404) {
+                ++gap_hours;
+                compressed_pool.release(std::move(fetched.data));
+                log("Received 404 for " + fetched.url + ", no data for this hour.");
                 continue;
             }
 
+            HourData h;
+            h.hour = fetched.hour;
+            h.url = std::move(fetched.url);
+            h.http_code = fetched.http_code;
+            h.from_cache = fetched.from_cache;
+            h.bytes = fetched.data.size();
+            h.compressed = std::move(fetched.data);
+            if (!emit(std::move(h)))
+                return;
+        }
+        log("Calendar: " + std::to_string(closed_hours) + " closed hours not requested, "
+            + std::to_string(gap_hours) + " hours without data");
+    }
+
                 "total_ask_volume DOUBLE PRECISION,"
                 "total_bid_volume DOUBLE PRECISION);";
         }
@@ -246,52 +720,349 @@ public:
             std::cout << "Table \"" << table_name << "\" is ready." << std::endl;
     }
 
-    void write_aggregated_bar(const AggregatedBar& bar) {
-        std::tm time_tm;
-        if (csv_file.is_open()) {
-            std::time_t t = std::chrono::system_clock::to_time_t(bar.interval_start);
-            gmtime_s(&time_tm, &t);
-            portable_gmtime(&time_tm, &t);
-            csv_file << std::put_time(&time_tm, "%Y-%m-%d %H:%M:%S") << ","
-                << bar.open_ask << "," << bar.high_ask << "," << bar.low_ask << "," << bar.close_ask << ","
-                << bar.open_bid << "," << bar.high_bid << "," << bar.low_bid << "," << bar.close_bid << ","
-                << bar.total_ask_volume << "," << bar.total_bid_volume << "\n";
-        }
-        if (pg_conn) {
-            std::string table_name = sanitize_identifier(asset) + (aggregation_enabled ? "_" + sanitize_identifier(timeframe) : "_tickdata");
-            std::ostringstream oss;
-            oss << "INSERT INTO \"" << table_name << "\" VALUES ("
-                << "'" << std::put_time(&time_tm, "%Y-%m-%d %H:%M:%S") << "',"
-                << bar.open_ask << "," << bar.high_ask << "," << bar.low_ask << "," << bar.close_ask << ","
-                << bar.open_bid << "," << bar.high_bid << "," << bar.low_bid << "," << bar.close_bid << ","
-                << bar.total_ask_volume << "," << bar.total_bid_volume << ");";
-            PGresult* res = PQexec(pg_conn, oss.str().c_str());
-            if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-                PQclear(res);
-                throw std::runtime_error("Failed to insert bar: " + std::string(PQerrorMessage(pg_conn)));
+    // outputs of one extra timeframe (set_timeframes); the constructor's timeframe keeps
+    // csv_file and the main table
+    struct BarOutput {
+        CsvFile csv;
+        std::string table;
+        std::unique_ptr<PgCopyWriter> pg;
+        std::unique_ptr<ColumnStoreWriter> store;
+        std::string csv_path;
+        size_t live_statement = 0;
+        bool ms_timestamps = false;
+    };
+
+    void open_bar_outputs() {
+        bars = TimeframeAggregator(bar_timeframes);
+        bar_sink = [this](size_t i, const Bar& bar) { write_bar(i, bar); };
+        bar_outputs.clear();
+        hour_bars.assign(bars.size() + activity_bars.size(), {});
+        for (size_t i = 0; i < bars.size() + activity_bars.size(); ++i) {
+            if (aggregation_enabled && i == 0) {
+                bar_outputs.emplace_back();
+                continue;
+            }
+            auto out = std::make_unique<BarOutput>();
+            out->ms_timestamps = i >= bars.size();
+            const std::string& tf = out->ms_timestamps ? activity_bars[i - bars.size()].name() : bars.name(i);
+            if (!download_dir.empty()) {
+                out->csv_path = download_dir + "/" + asset + "_" + tf + ".csv";
+                if (!out->csv.open(out->csv_path))
+                    throw std::runtime_error("Cannot open output file: " + out->csv_path);
+                if (out->csv.size() == 0)
+                    out->csv.write("Timestamp,OpenAsk,HighAsk,LowAsk,CloseAsk,OpenBid,HighBid,LowBid,CloseBid,TotalAskVolume,TotalBidVolume\n");
             }
+            if (pg_conn) {
+                out->table = sanitize_identifier(asset) + "_" + sanitize_identifier(tf);
+                create_bar_table(out->table);
+                out->pg = std::make_unique<PgCopyWriter>(pg_conn, out->table, pg_flush_rows);
+            }
+            if (!tick_store_root.empty()) {
+                std::string store_path = tick_store_root + "/" + asset + "_" + tf;
+                if (restart_mode) {
+                    std::error_code ec;
+                    std::filesystem::remove_all(store_path, ec);
+                }
+                out->store = std::make_unique<ColumnStoreWriter>(store_path, bar_store_columns());
+            }
+            bar_outputs.push_back(std::move(out));
+        }
+    }
+
+    void create_bar_table(const std::string& table_name) {
+        std::string create_sql = "CREATE TABLE IF NOT EXISTS \"" + table_name + "\" ("
+            "interval_start TIMESTAMP(3) WITHOUT TIME ZONE,"
+            "open_ask DOUBLE PRECISION,"
+            "high_ask DOUBLE PRECISION,"
+            "low_ask DOUBLE PRECISION,"
+            "close_ask DOUBLE PRECISION,"
+            "open_bid DOUBLE PRECISION,"
+            "high_bid DOUBLE PRECISION,"
+            "low_bid DOUBLE PRECISION,"
+            "close_bid DOUBLE PRECISION,"
+            "total_ask_volume DOUBLE PRECISION,"
+            "total_bid_volume DOUBLE PRECISION);";
+        PGresult* res = PQexec(pg_conn, create_sql.c_str());
+        if (PQresultStatus(res) != PGRES_COMMAND_OK) {
             PQclear(res);
+            throw std::runtime_error("Failed to create table: " + std::string(PQerrorMessage(pg_conn)));
+        }
+        PQclear(res);
+    }
+
+    // Bar column store layout: ts_ms (bucket start), then the ten bar values as f64.
+    static std::vector<ColumnStoreWriter::Column> bar_store_columns() {
+        return { { "open_ask", 8 }, { "high_ask", 8 }, { "low_ask", 8 }, { "close_ask", 8 },
+            { "open_bid", 8 }, { "high_bid", 8 }, { "low_bid", 8 }, { "close_bid", 8 },
+            { "total_ask_volume", 8 }, { "total_bid_volume", 8 } };
+    }
+
+    void write_bar(size_t level, const Bar& bar) {
+        // already written before the checkpoint this run resumed from
+        size_t slot = journal_slot(level);
+        if (bar.start_ms <= resume_after[slot])
+            return;
+        marks[slot].last_ms = bar.start_ms;
+        BarOutput* out = bar_outputs[level].get();
+        if (out && out->store) {
+            const void* values[10] = { &bar.open_ask, &bar.high_ask, &bar.low_ask, &bar.close_ask,
+                &bar.open_bid, &bar.high_bid, &bar.low_bid, &bar.close_bid,
+                &bar.total_ask_volume, &bar.total_bid_volume };
+            out->store->append(&bar.start_ms, values, 1);
+        }
+        hour_bars[level].push_back(bar);
+    }
+
+    // hour boundary: the hour's bars go to the sinks series by series, column stores
+    // are made readable
+    void end_hour() {
+        for (size_t level = 0; level < hour_bars.size(); ++level) {
+            std::vector<Bar>& batch = hour_bars[level];
+            if (batch.empty())
+                continue;
+            const std::string& name = series_name(level);
+            for_each_sink([&](DataSink& sink) { sink.on_bars(level, name, batch.data(), batch.size()); });
+            if (metrics_on())
+                metrics->rows_written.add(batch.size());
+            batch.clear();
+        }
+        for (auto& out : bar_outputs) {
+            if (out && out->store)
+                out->store->flush();
         }
+        for_each_sink([](DataSink& sink) { sink.on_hour_end(); });
     }
 
-    static size_t write_callback(void* contents, size_t size, size_t nmemb, void* userp) {
-        auto* buffer = static_cast<std::vector<uint8_t>*>(userp);
-        size_t total = size * nmemb;
-        buffer->insert(buffer->end(), static_cast<uint8_t*>(contents), static_cast<uint8_t*>(contents) + total);
-        return total;
+    // One decoder per pipeline thread, so its liblzma state is reused from hour to hour.
+    static bool decompress_lzma(const std::vector<uint8_t>& in, std::vector<uint8_t>& out) {
+        thread_local LzmaDecoder decoder;
+        return decoder.decode(in, out);
     }
 
-    void init_curl() {
-        static bool initialized = false;
-        if (!initialized) {
-            CURLcode res = curl_global_init(CURL_GLOBAL_DEFAULT);
-            if (res != CURLE_OK)
-                throw std::runtime_error(std::string("Failed to initialize cURL: ") + curl_easy_strerror(res));
-            initialized = true;
+    void open_quality_log() {
+        if (!tick_filter || download_dir.empty() || quality_csv.is_open())
+            return;
+        std::string path = download_dir + "/" + asset + "_quality.csv";
+        if (journal_resume_ms != std::numeric_limits<int64_t>::min())
+            rewind_log(path, journal_resume_ms);
+        if (!quality_csv.open(path))
+            throw std::runtime_error("Cannot open quality file: " + path);
+        if (quality_csv.size() == 0)
+            quality_csv.write("Hour,Ticks,NonPositive,Crossed,Spikes,WideSpread,Stale,Flagged,Dropped,Repaired\n");
+        if (tick_filter->settings().action == TickFilter::Action::Drop)
+            return;
+        std::string flags_path = download_dir + "/" + asset + "_flags.csv";
+        if (journal_resume_ms != std::numeric_limits<int64_t>::min())
+            rewind_log(flags_path, journal_resume_ms);
+        if (!flags_csv.open(flags_path))
+            throw std::runtime_error("Cannot open flags file: " + flags_path);
+        if (flags_csv.size() == 0)
+            flags_csv.write("Timestamp,Ask,Bid,Flags\n");
+    }
+
+    // A resumed run filters again from the hour it restarts at: the rows of the quality
+    // and flags logs it would write twice are cut (rows are in time order, with
+    // fixed-width timestamps).
+    void rewind_log(const std::string& path, int64_t from_ms) {
+        std::ifstream in(path, std::ios::binary);
+        if (!in.is_open())
+            return;
+        char ts[24];
+        std::string from(ts, csv_emitter.timestamps().format(from_ms, ts, false));
+        std::string line;
+        uint64_t keep = 0;
+        bool header = true;
+        while (std::getline(in, line)) {
+            if (!header && line.compare(0, from.size(), from) >= 0)
+                break;
+            header = false;
+            keep += line.size() + 1;
+        }
+        in.close();
+        if (keep < std::filesystem::file_size(path))
+            std::filesystem::resize_file(path, keep);
+    }
+
+    void filter_ticks(TickBatch& ticks) {
+        auto before = tick_filter->hour();
+        tick_filter->apply(ticks);
+        const std::vector<uint8_t>& flags = tick_filter->flags();
+        if (flags_csv.is_open() && tick_filter->hour().flagged > before.flagged) {
+            for (size_t i = 0; i < flags.size(); ++i) {
+                if (!flags[i])
+                    continue;
+                char* p = flags_csv.reserve(128);
+                p = csv_emitter.timestamps().format(ticks.ts_ms[i], p);
+                *p++ = ',';
+                p = csv_emitter.price(p, ticks.ask[i]);
+                *p++ = ',';
+                p = csv_emitter.price(p, ticks.bid[i]);
+                *p++ = ',';
+                p = std::to_chars(p, p + 4, flags[i]).ptr;
+                *p++ = '\n';
+                flags_csv.commit(p);
+            }
+        }
+        if (metrics_on()) {
+            metrics->ticks_flagged.add(tick_filter->hour().flagged - before.flagged);
+            metrics->ticks_dropped.add(tick_filter->hour().dropped - before.dropped);
+        }
+    }
+
+    // one row of quality counts per hour that had ticks
+    void end_quality_hour(std::chrono::system_clock::time_point hour) {
+        if (!tick_filter)
+            return;
+        const auto& c = tick_filter->hour();
+        if (c.ticks > 0 && quality_csv.is_open()) {
+            char ts[24];
+            int64_t hour_ms = std::chrono::duration_cast<std::chrono::milliseconds>(hour.time_since_epoch()).count();
+            std::string row(ts, csv_emitter.timestamps().format(hour_ms, ts, false));
+            for (uint64_t v : { c.ticks, c.nonpositive, c.crossed, c.spikes, c.wide_spread, c.stale, c.flagged, c.dropped, c.repaired })
+                row += "," + std::to_string(v);
+            row += "\n";
+            quality_csv.write(row);
+        }
+        tick_filter->end_hour();
+    }
+
+    bool metrics_on() const {
+        return metrics && metrics->on();
+    }
+
+    void record_fetch(const DukasFetcher::Result& fetched) {
+        if (fetched.from_cache) {
+            metrics->cache_hits.add();
+            return;
+        }
+        metrics->http_requests.add(1 + fetched.retries);
+        metrics->retries.add(fetched.retries);
+        metrics->http_seconds.observe(fetched.finished - fetched.started);
+        if (fetched.curl_code != CURLE_OK || (fetched.http_code != 200 && fetched.http_code != 404))
+            metrics->http_errors.add();
+        else if (fetched.http_code == 404)
+            metrics->http_not_found.add();
+        else
+            metrics->bytes_downloaded.add(fetched.data.size());
+    }
+
+    const std::string& series_name(size_t level) const {
+        return level < bars.size() ? bars.name(level) : activity_bars[level - bars.size()].name();
+    }
+
+    template <typename Fn>
+    void for_each_sink(Fn&& fn) {
+        fn(csv_output);
+        fn(pg_output);
+        for (DataSink* sink : sinks)
+            fn(*sink);
+    }
+
+    // The CSV files under download_dir, as a sink.
+    class CsvOutput : public DataSink {
+    public:
+        explicit CsvOutput(DukascopyDownloader& d) : d(d) {}
+
+        void on_ticks(const TickBatch& ticks) override {
+            if (d.aggregation_enabled || !d.csv_file.is_open())
+                return;
+            for (size_t i = 0; i < ticks.size(); ++i)
+                d.csv_emitter.tick(d.csv_file, ticks.ts_ms[i], ticks.ask[i], ticks.bid[i], ticks.ask_vol[i], ticks.bid_vol[i]);
+        }
+
+        void on_bars(size_t series, const std::string&, const Bar* bars, size_t count) override {
+            BarOutput* out = d.bar_outputs[series].get();
+            CsvFile& csv = out ? out->csv : d.csv_file;
+            if (!csv.is_open())
+                return;
+            for (size_t i = 0; i < count; ++i)
+                d.csv_emitter.bar(csv, bars[i], out && out->ms_timestamps);
+        }
+
+    private:
+        DukascopyDownloader& d;
+    };
+
+    // The Postgres tables: binary COPY, or pipelined inserts while livestreaming. One
+    // transaction per hour unless pg_flush_rows says otherwise.
+    class PgOutput : public DataSink {
+    public:
+        explicit PgOutput(DukascopyDownloader& d) : d(d) {}
+
+        void on_ticks(const TickBatch& ticks) override {
+            if (d.aggregation_enabled || !d.pg_conn)
+                return;
+            for (size_t i = 0; i < ticks.size(); ++i) {
+                const double values[4] = { ticks.ask[i], ticks.bid[i], ticks.ask_vol[i], ticks.bid_vol[i] };
+                d.pg_row(ticks.ts_ms[i], values, 4);
+            }
+        }
+
+        void on_bars(size_t series, const std::string&, const Bar* bars, size_t count) override {
+            if (!d.pg_conn)
+                return;
+            BarOutput* out = d.bar_outputs[series].get();
+            for (size_t i = 0; i < count; ++i) {
+                const Bar& bar = bars[i];
+                const double values[10] = {
+                    bar.open_ask, bar.high_ask, bar.low_ask, bar.close_ask,
+                    bar.open_bid, bar.high_bid, bar.low_bid, bar.close_bid,
+                    bar.total_ask_volume, bar.total_bid_volume };
+                if (!out)
+                    d.pg_row(bar.start_ms, values, 10);
+                else if (d.pg_live)
+                    d.pg_live->add_row(out->live_statement, bar.start_ms, values, 10);
+                else if (out->pg)
+                    out->pg->add_row(bar.start_ms, values, 10);
+            }
+        }
+
+        void on_hour_end() override {
+            if (d.pg_live)
+                d.pg_live->end_batch();
+            if (d.pg_copy)
+                d.pg_copy->end_batch();
+            for (auto& out : d.bar_outputs) {
+                if (out && out->pg)
+                    out->pg->end_batch();
+            }
+        }
+
+        void on_finish() override {
+            if (d.pg_copy)
+                d.pg_copy->commit();
+            for (auto& out : d.bar_outputs) {
+                if (out && out->pg)
+                    out->pg->commit();
+            }
+        }
+
+    private:
+        DukascopyDownloader& d;
+    };
+
+    // Preset answer when scripted (echoed after the question), otherwise read from stdin.
+    char answer(char DownloadChoices::* field) {
+        if (!scripted) {
+            char c;
+            std::cin >> c;
+            return c;
         }
+        std::cout << choices.*field << std::endl;
+        return choices.*field;
     }
 
 
+    std::string hour_url(const std::tm& tm_base) {
+        std::ostringstream oss_url;
+        oss_url << datafeed_url << asset << "/"
+            << std::put_time(&tm_base, "%Y/")
+            << std::setw(2) << std::setfill('0') << tm_base.tm_mon << "/"
+            << std::put_time(&tm_base, "%d/")
+            << std::put_time(&tm_base, "%H") << "h_ticks.bi5";
+        return oss_url.str();
+    }
+
     std::chrono::system_clock::time_point parse_date(const std::string& date_str) {
         std::tm tm = {};
         std::istringstream ss(date_str);
@@ -312,22 +1083,6 @@ public:
         end_time = parse_date(end_date);
     }
 
-    int download_file(const std::string& url, std::vector<uint8_t>& buffer) {
-        CURL* curl = curl_easy_init();
-        if (!curl)
-            throw std::runtime_error("Failed to initialize cURL easy handle");
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_callback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &buffer);
-        curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl/1.0");
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
-        curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
-        CURLcode res = curl_easy_perform(curl);
-        long http_code = 0;
-        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
-        curl_easy_cleanup(curl);
-
             strm.avail_out = output.size() - strm.total_out;
             ret = lzma_code(&strm, LZMA_FINISH);
             if (ret == LZMA_STREAM_END) {
@@ -345,102 +1100,237 @@ public:
         } while (true);
     }
 
-    float read_be_float(const uint8_t* data) {
-        uint32_t bits = (uint32_t)data[0] << 24 | (uint32_t)data[1] << 16 | (uint32_t)data[2] << 8 | data[3];
-        float value;
-        std::memcpy(&value, &bits, sizeof(float));
-        return value;
+    // journal slot 0 is the constructor's output (ticks or bars), then one per extra bar output
+    size_t journal_slot(size_t level) const {
+        return aggregation_enabled ? level : level + 1;
     }
 
-    std::string format_tick_timestamp(const std::tm& base_tm, uint32_t offset_ms) {
-        time_t base_seconds = _mkgmtime(const_cast<std::tm*>(&base_tm));
-        time_t base_seconds = portable_timegm(const_cast<std::tm*>(&base_tm));
-        time_t display_seconds = base_seconds + (offset_ms / 1000);
-        unsigned ms = offset_ms % 1000;
-        std::tm display_tm;
-        gmtime_s(&display_tm, &display_seconds);
-        portable_gmtime(&display_tm, &display_seconds);
-        std::ostringstream oss;
-        oss << std::put_time(&display_tm, "%Y-%m-%d %H:%M:%S")
-            << "." << std::setw(3) << std::setfill('0') << ms;
-        return oss.str();
+    // Resumes exactly after the last committed hour: every output is cut back to what
+    // it held at that checkpoint and fetching restarts at the oldest bar still open.
+    void open_journal() {
+        size_t slots = 1 + bar_outputs.size() - (aggregation_enabled ? 1 : 0);
+        marks.assign(slots, {});
+        resume_after.assign(slots, std::numeric_limits<int64_t>::min());
+        activity_resume.assign(activity_bars.size(), std::numeric_limits<int64_t>::min());
+        journal_resume_ms = std::numeric_limits<int64_t>::min();
+        if (!journal_enabled || (download_dir.empty() && !pg_conn))
+            return;
+        std::string path = journal_file;
+        if (path.empty())
+            path = (download_dir.empty() ? std::string(".") : download_dir) + "/" + asset + "_" + (aggregation_enabled ? timeframe : "ticks") + ".journal";
+        journal = std::make_unique<ResumeJournal>(path, slots, activity_bars.size() * ActivityBarBuilder::state_words);
+        ResumeJournal::Checkpoint checkpoint;
+        if (!update_mode || !journal->last(checkpoint)) {
+            journal->reset();
+            // rows already in the tables predate this journal: a rewind must keep them
+            if (pg_conn)
+                for (size_t slot = 0; slot < slots; ++slot)
+                    marks[slot].last_ms = table_last_ms(slot);
+            return;
+        }
+        for (size_t slot = 0; slot < slots; ++slot) {
+            marks[slot] = checkpoint.marks[slot];
+            resume_after[slot] = checkpoint.marks[slot].last_ms;
+            rewind_slot(slot, checkpoint.marks[slot]);
+        }
+        for (size_t k = 0; k < activity_bars.size(); ++k) {
+            activity_resume[k] = checkpoint.marks[journal_slot(bars.size() + k)].open_ms;
+            activity_bars[k].load_state(checkpoint.state.data() + k * ActivityBarBuilder::state_words);
+        }
+        start_time = std::chrono::system_clock::time_point(std::chrono::milliseconds(checkpoint.resume_ms));
+        journal_resume_ms = checkpoint.resume_ms;
+        std::tm tm_resume = {};
+        time_t t = std::chrono::system_clock::to_time_t(start_time);
+        portable_gmtime(&tm_resume, &t);
+        std::cout << "Resuming from journal at " << format_date_hour(tm_resume) << std::endl;
     }
 
+    // Drops whatever one output received after the checkpoint.
+    void rewind_slot(size_t slot, const ResumeJournal::Mark& mark) {
+        BarOutput* out = nullptr;
+        if (slot > 0)
+            out = bar_outputs[aggregation_enabled ? slot : slot - 1].get();
+        CsvFile& csv = out ? out->csv : csv_file;
+        const std::string& path = out ? out->csv_path : csv_output_path;
+        if (csv.is_open() && csv.size() > mark.bytes) {
+            csv.close();
+            std::filesystem::resize_file(path, mark.bytes);
+            if (!csv.open(path))
+                throw std::runtime_error("Cannot reopen output file: " + path);
+        }
+        if (out && out->store)
+            out->store->truncate(mark.rows);
+        if (!pg_conn)
+            return;
+        std::string table, column;
+        slot_table(slot, table, column);
+        // last_ms is seeded from the table when the journal starts, so it is only unset
+        // when the table was empty then and every row in it is from this journal
+        std::string sql = "DELETE FROM \"" + table + "\"";
+        if (mark.last_ms != std::numeric_limits<int64_t>::min()) {
+            char ts[24];
+            format_ms_timestamp(mark.last_ms, ts);
+            sql += " WHERE " + column + " > '" + ts + "'";
+        }
+        PGresult* res = PQexec(pg_conn, sql.c_str());
+        if (PQresultStatus(res) != PGRES_COMMAND_OK) {
+            PQclear(res);
+            throw std::runtime_error("Failed to rewind table " + table + ": " + std::string(PQerrorMessage(pg_conn)));
+        }
+        PQclear(res);
+    }
 
-    Tick parse_tick20(const uint8_t* data, const std::tm& base_tm) {
-        uint32_t offset = (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | data[3];
-        uint32_t ask_raw = (uint32_t(data[4]) << 24) | (uint32_t(data[5]) << 16) | (uint32_t(data[6]) << 8) | data[7];
-        uint32_t bid_raw = (uint32_t(data[8]) << 24) | (uint32_t(data[9]) << 16) | (uint32_t(data[10]) << 8) | data[11];
-        float ask_vol_raw = read_be_float(data + 12);
-        float bid_vol_raw = read_be_float(data + 16);
-        double point = determine_scaling(asset); // TODO: do it automatically
-
-        double ask = static_cast<double>(ask_raw) / point;
-        double bid = static_cast<double>(bid_raw) / point;
-
-        double ask_volume = ask_vol_raw;
-        double bid_volume = bid_vol_raw;
-        std::string ts = format_tick_timestamp(base_tm, offset);
-        time_t base_seconds = _mkgmtime(const_cast<std::tm*>(&base_tm));
-        time_t base_seconds = portable_timegm(const_cast<std::tm*>(&base_tm));
-        auto base_timepoint = std::chrono::system_clock::from_time_t(base_seconds);
-        auto timepoint = base_timepoint + std::chrono::milliseconds(offset);
-        return { ts, timepoint, ask, bid, ask_volume, bid_volume };
-    }
-
-    void process_ticks(std::vector<uint8_t> data, const std::tm& base_tm) {
-        while (!data.empty()) {
-            std::string headerPrefix = "Timestamp";
-            if (data.size() >= headerPrefix.size() &&
-                std::equal(headerPrefix.begin(), headerPrefix.end(), data.begin())) {
-                auto newlineIt = std::find(data.begin(), data.end(), '\n');
-                if (newlineIt != data.end()) {
-                    data.erase(data.begin(), newlineIt + 1);
-                    continue;
-                }
-                break;
+    void slot_table(size_t slot, std::string& table, std::string& column) {
+        BarOutput* out = slot > 0 ? bar_outputs[aggregation_enabled ? slot : slot - 1].get() : nullptr;
+        table = out ? out->table
+            : sanitize_identifier(asset) + (aggregation_enabled ? "_" + sanitize_identifier(timeframe) : "_tickdata");
+        column = (out || aggregation_enabled) ? "interval_start" : "timestamp";
+    }
+
+    // Newest row of a slot's table in epoch ms, or INT64_MIN when it is empty.
+    int64_t table_last_ms(size_t slot) {
+        std::string table, column;
+        slot_table(slot, table, column);
+        std::string sql = "SELECT (extract(epoch FROM max(" + column + ")) * 1000)::bigint FROM \"" + table + "\"";
+        PGresult* res = PQexec(pg_conn, sql.c_str());
+        if (PQresultStatus(res) != PGRES_TUPLES_OK) {
+            PQclear(res);
+            throw std::runtime_error("Failed to read the last row of " + table + ": " + std::string(PQerrorMessage(pg_conn)));
+        }
+        int64_t last = PQgetisnull(res, 0, 0) ? std::numeric_limits<int64_t>::min() : std::stoll(PQgetvalue(res, 0, 0));
+        PQclear(res);
+        return last;
+    }
+
+    // Called once an hour is fully written. Its rows are committed and synced to every
+    // output before the checkpoint that covers them (also with pg_flush_rows set, whose
+    // COPY transactions would otherwise span hours).
+    void commit_hour(std::chrono::system_clock::time_point hour) {
+        if (!journal)
+            return;
+        if (pg_copy)
+            pg_copy->commit();
+        ResumeJournal::Checkpoint checkpoint;
+        checkpoint.hour_ms = std::chrono::duration_cast<std::chrono::milliseconds>(hour.time_since_epoch()).count();
+        int64_t next_ms = checkpoint.hour_ms + 3600000;
+        int64_t open_ms = bars.open_since();
+        for (const auto& a : activity_bars)
+            open_ms = std::min(open_ms, a.open_since());
+        checkpoint.resume_ms = std::min(next_ms, floor_to(open_ms, 3600000));
+        checkpoint.marks = marks;
+        // adaptive thresholds as of each activity bar's open_ms, where a resume replays from
+        checkpoint.state.resize(activity_bars.size() * ActivityBarBuilder::state_words);
+        for (size_t k = 0; k < activity_bars.size(); ++k)
+            activity_bars[k].save_state(checkpoint.state.data() + k * ActivityBarBuilder::state_words);
+        if (csv_file.is_open()) {
+            csv_file.sync();
+            checkpoint.marks[0].bytes = csv_file.size();
+        }
+        for (size_t level = 0; level < bar_outputs.size(); ++level) {
+            BarOutput* out = bar_outputs[level].get();
+            if (!out)
+                continue;
+            ResumeJournal::Mark& mark = checkpoint.marks[journal_slot(level)];
+            if (out->pg)
+                out->pg->commit();
+            if (out->csv.is_open()) {
+                out->csv.sync();
+                mark.bytes = out->csv.size();
             }
-            bool isPrintable = true;
-            for (size_t i = 0; i < std::min<size_t>(data.size(), 10); ++i) {
-                if (data[i] < 32 || data[i] > 126) { isPrintable = false; break; }
+            if (out->store)
+                mark.rows = out->store->size();
+            if (level >= bars.size())
+                mark.open_ms = std::min(next_ms, activity_bars[level - bars.size()].open_since());
+        }
+        journal->commit(checkpoint);
+    }
+
+    // Bars stay open across hour boundaries; download() and livestream() flush the last time
+    // bars, unfinished activity bars are carried over.
+    void process_ticks(const TickBatch& ticks) {
+        if (tick_store) {
+            append_ticks(*tick_store, ticks);
+            tick_store->flush();
+        }
+        if (tick_archive) {
+            tick_archive->append(ticks);
+            tick_archive->flush();
+        }
+        if (!aggregation_enabled && !ticks.empty() && ticks.ts_ms.front() <= resume_after[0]) {
+            // resumed run: only what was not written before the checkpoint
+            resumed_ticks.clear();
+            for (size_t i = 0; i < ticks.size(); ++i) {
+                if (ticks.ts_ms[i] > resume_after[0])
+                    resumed_ticks.push_back(ticks.ts_ms[i], ticks.ask[i], ticks.bid[i], ticks.ask_vol[i], ticks.bid_vol[i]);
             }
-            if (isPrintable) {
-                auto newlineIt = std::find(data.begin(), data.end(), '\n');
-                if (newlineIt != data.end()) {
-                    data.erase(data.begin(), newlineIt + 1);
-
-                    current_bar.low_bid = std::min(current_bar.low_bid, tick.bid);
-                    current_bar.close_bid = tick.bid;
-                    current_bar.total_ask_volume += tick.ask_volume;
-                    current_bar.total_bid_volume += tick.bid_volume;
-                }
+            for_each_sink([&](DataSink& sink) { sink.on_ticks(resumed_ticks); });
+            if (metrics_on())
+                metrics->rows_written.add(resumed_ticks.size());
+        }
+        else {
+            for_each_sink([&](DataSink& sink) { sink.on_ticks(ticks); });
+            if (metrics_on() && !aggregation_enabled)
+                metrics->rows_written.add(ticks.size());
+        }
+        if (!aggregation_enabled && !ticks.empty())
+            marks[0].last_ms = std::max(marks[0].last_ms, ticks.ts_ms.back());
+        bars.add(ticks, bar_sink);
+        for (size_t k = 0; k < activity_bars.size(); ++k) {
+            auto emit = [&](const Bar& bar) { write_bar(bars.size() + k, bar); };
+            int64_t from = activity_resume[k];
+            if (ticks.empty() || ticks.ts_ms.front() >= from) {
+                activity_bars[k].add(ticks, emit);
+                continue;
             }
-            else {
-                write_tick(tick);
+            // resumed run: this builder restarts at the bar that was open at the checkpoint
+            TickBatch tail;
+            for (size_t i = 0; i < ticks.size(); ++i) {
+                if (ticks.ts_ms[i] >= from)
+                    tail.push_back(ticks.ts_ms[i], ticks.ask[i], ticks.bid[i], ticks.ask_vol[i], ticks.bid_vol[i]);
             }
+            activity_bars[k].add(tail, emit);
         }
-        if (has_current_bar) {
-            write_aggregated_bar(current_bar);
-        }
+        if (!ticks.empty())
+            last_tick_ms = std::max(last_tick_ms, ticks.ts_ms.back());
         log("Completed processing ticks");
     }
 
+    // "YYYY-MM-DD HH:MM:SS.mmm" into out[24]
+    void format_ms_timestamp(int64_t ts_ms, char* out) {
+        *csv_emitter.timestamps().format(ts_ms, out) = '\0';
+    }
+
     std::string format_date_hour(const std::tm& tm) {
         std::ostringstream oss;
         oss << std::put_time(&tm, "%Y-%m-%d %H:00:00");
         return oss.str();
     }
 
-    std::chrono::system_clock::time_point skip_day(const std::chrono::system_clock::time_point& current) {
-        std::time_t t = std::chrono::system_clock::to_time_t(current);
-        std::tm tm;
-        gmtime_s(&tm, &t);
-        portable_gmtime(&tm, &t);
-        tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
-        tm.tm_mday += 1;
-        time_t next_day = _mkgmtime(&tm);
-        time_t next_day = portable_timegm(&tm);
-        return std::chrono::system_clock::from_time_t(next_day);
+    // Last non-empty line, read backwards from the end so large files cost the same as small ones.
+    static std::string read_last_line(const std::string& path) {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in.is_open())
+            return {};
+        std::streamoff end = in.tellg();
+        std::string tail;
+        const std::streamoff chunk = 4096;
+        for (std::streamoff pos = end; pos > 0;) {
+            std::streamoff n = std::min(chunk, pos);
+            pos -= n;
+            std::string block(static_cast<size_t>(n), '\0');
+            in.seekg(pos);
+            in.read(&block[0], n);
+            tail.insert(0, block);
+            size_t last = tail.find_last_not_of("\r\n");
+            if (last == std::string::npos)
+                continue;
+            size_t first = tail.find_last_of('\n', last);
+            if (first != std::string::npos)
+                return tail.substr(first + 1, last - first);
+            if (pos == 0)
+                return tail.substr(0, last + 1);
+        }
+        return {};
     }
 
     void prepare_csv() {
@@ -458,14 +1348,14 @@ public:
             std::filesystem::create_directories(dir, ec);
         }
         
-        csv_file.open(path, std::ios::app);
-        if (!csv_file.is_open())
+        csv_output_path = path;
+        if (!csv_file.open(path))
             throw std::runtime_error("Cannot open output file: " + path);
-        if (csv_file.tellp() == 0) {
+        if (csv_file.size() == 0) {
             if (aggregation_enabled)
-                csv_file << "Timestamp,OpenAsk,HighAsk,LowAsk,CloseAsk,OpenBid,HighBid,LowBid,CloseBid,TotalAskVolume,TotalBidVolume\n";
+                csv_file.write("Timestamp,OpenAsk,HighAsk,LowAsk,CloseAsk,OpenBid,HighBid,LowBid,CloseBid,TotalAskVolume,TotalBidVolume\n");
             else 
-                csv_file << "Timestamp,Ask,Bid,AskVolume,BidVolume\n";
+                csv_file.write("Timestamp,Ask,Bid,AskVolume,BidVolume\n");
         }
     }
 
@@ -486,26 +1376,21 @@ public:
     */
     
 
-    void write_tick(const Tick& tick) {
-        csv_file << tick.timestamp << "," << tick.ask << "," << tick.bid << ","
-            << tick.ask_volume << "," << tick.bid_volume << "\n";
-        if (pg_conn) {
-            std::string table_name = sanitize_identifier(asset) + "_tickdata";
-            std::ostringstream oss;
-            oss << "INSERT INTO \"" << table_name << "\" VALUES ("
-                << '\'' << tick.timestamp << "',"
-                << tick.ask << ","
-                << tick.bid << ","
-                << tick.ask_volume << ","
-                << tick.bid_volume << ");";
-            PGresult* res = PQexec(pg_conn, oss.str().c_str());
-            if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-                PQclear(res);
-
-                throw std::runtime_error("Failed to insert tick: " + std::string(PQerrorMessage(pg_conn)));
-            }
-            PQclear(res);
+    // rows go through the pipeline writer while livestreaming, through COPY otherwise
+    void pg_row(int64_t ts_ms, const double* values, size_t n) {
+        if (pg_live)
+            pg_live->add_row(pg_live_statement, ts_ms, values, n);
+        else
+            pg_writer().add_row(ts_ms, values, n);
+    }
+
+    // COPY (binary) stream into the tick or bar table, opened on first use
+    PgCopyWriter& pg_writer() {
+        if (!pg_copy) {
+            std::string table_name = sanitize_identifier(asset) + (aggregation_enabled ? "_" + sanitize_identifier(timeframe) : "_tickdata");
+            pg_copy = std::make_unique<PgCopyWriter>(pg_conn, table_name, pg_flush_rows);
         }
+        return *pg_copy;
     }
 
     void log(const std::string& message) {
@@ -594,6 +1479,55 @@ public:
     }
 #endif
 
+private:
+    bool scripted = false;
+    DownloadChoices choices;
+    RequestBudget* request_budget = nullptr;
+    size_t fetch_concurrency = 8;
+    HourPipeline<HourData>::Config pipeline_config;
+    Bi5Decoder tick_decoder;
+    BoundedQueue<TickBatch> spare_batches{ 64 };
+    BufferPool compressed_pool{ 64 };
+    BufferPool decompressed_pool{ 64, 256 * 1024 };
+    std::vector<std::string> bar_timeframes;
+    TimeframeAggregator bars;
+    TimeframeAggregator::Emit bar_sink;
+    std::vector<ActivityBarBuilder> activity_bars;
+    std::vector<std::unique_ptr<BarOutput>> bar_outputs;
+    std::string tick_store_root;
+    std::string calendar_dir;
+    CsvFile csv_file;
+    CsvFile quality_csv{ 64 * 1024 };
+    CsvFile flags_csv{ 64 * 1024 };
+    std::unique_ptr<TickFilter> tick_filter;
+    CsvEmitter csv_emitter;
+    CsvOutput csv_output{ *this };
+    PgOutput pg_output{ *this };
+    std::vector<DataSink*> sinks;
+    DownloadStats run_stats;
+    PipelineMetrics* metrics = nullptr;
+    std::vector<std::vector<Bar>> hour_bars;      // per bar output, closed during the current hour
+    TickBatch resumed_ticks;
+    std::string csv_output_path;
+    std::unique_ptr<ResumeJournal> journal;
+    std::string journal_file;
+    bool journal_enabled = true;
+    std::vector<ResumeJournal::Mark> marks;        // per journal slot, what has been written so far
+    std::vector<int64_t> resume_after;             // per journal slot, written before this run
+    std::vector<int64_t> activity_resume;          // per activity bar, first tick to feed it
+    int64_t journal_resume_ms = std::numeric_limits<int64_t>::min();   // hour a resumed run restarts at
+    size_t pg_flush_rows = 0;
+    std::unique_ptr<PgCopyWriter> pg_copy;
+    std::unique_ptr<PgPipelineWriter> pg_live;
+    size_t pg_live_statement = 0;
+    std::unique_ptr<Bi5Cache> cache;
+    std::unique_ptr<ColumnStoreWriter> tick_store;
+    std::unique_ptr<TickArchiveWriter> tick_archive;
+    bool restart_mode = false;                     // existing output answered with Restart
+    std::string datafeed_url = "https://datafeed.dukascopy.com/datafeed/";
+    std::chrono::milliseconds live_poll_interval{ 1000 };
+    int64_t last_tick_ms = std::numeric_limits<int64_t>::min();
+    int64_t live_max_lag_ms = 0;
 };
 
 #endif // DUKASLOADER_HPP
@@ -0,0 +1,80 @@
+#include "DukasEntryMatch.hpp"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+
+// Exact entry times of a journal written with approximate times, from a tick store
+// (the downloader's set_tick_store_dir output) or a Dukascopy candle export:
+//   EntryMatch SOURCE JOURNAL.csv [OUT.csv [THREADS [WINDOW_H [paris|utc]]]]
+// JOURNAL.csv is read as by TradeEval (entry_time,type,entry_price,exit_price,sl,risk,
+// exit_mode), its times being Paris local time unless "utc" is given. OUT.csv starts
+// with the same seven columns, entry_time being the matched UTC time to the ms, so it
+// can go straight to TradeEval; then the journal time in UTC, the match status, its
+// offset in ms and the offsets of the other candidates.
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " SOURCE JOURNAL.csv [OUT.csv [THREADS [WINDOW_H [paris|utc]]]]" << std::endl;
+        return 2;
+    }
+    std::string source = argv[1];
+    std::string out_path = argc > 3 ? argv[3] : "matched_trades.csv";
+    size_t threads = argc > 4 ? std::stoul(argv[4]) : 0;
+    EntryMatcher::Config config;
+    if (argc > 5)
+        config.window_ms = static_cast<int64_t>(std::stod(argv[5]) * 3600000);
+    std::string zone = argc > 6 ? argv[6] : "paris";
+    if (zone != "paris" && zone != "utc")
+        throw std::invalid_argument("Invalid journal time zone: " + zone);
+
+    std::vector<Trade> trades = read_trades_csv(argv[2]);
+    if (zone == "paris")
+        for (auto& t : trades)
+            t.entry_ms = paris_to_utc_ms(t.entry_ms);
+
+    std::unique_ptr<ColumnStoreReader> store;
+    CandleSeries bars;
+    std::unique_ptr<EntryMatcher> matcher;
+    auto t0 = std::chrono::steady_clock::now();
+    if (std::filesystem::is_directory(source)) {
+        store = std::make_unique<ColumnStoreReader>(source);
+        matcher = std::make_unique<EntryMatcher>(*store, config);
+    }
+    else {
+        bars = read_candles_csv(source);
+        matcher = std::make_unique<EntryMatcher>(bars, config);
+    }
+    double index_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    t0 = std::chrono::steady_clock::now();
+    std::vector<EntryMatch> matches = matcher->match_all(trades, threads);
+    double match_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    std::ofstream out(out_path, std::ios::trunc);
+    if (!out.is_open())
+        throw std::runtime_error("Cannot open output file: " + out_path);
+    out << "entry_time,type,entry_price,exit_price,sl,risk,exit_mode,journal_time,status,offset_ms,candidates_ms\n"
+        << std::setprecision(10);
+    CsvTimestamp stamps;
+    char ts[24];
+    size_t touched = 0;
+    for (size_t i = 0; i < trades.size(); ++i) {
+        const Trade& t = trades[i];
+        const EntryMatch& m = matches[i];
+        bool found = m.status != EntryMatch::Status::NoData;
+        out << std::string(ts, stamps.format(found ? m.entry_ms : t.entry_ms, ts)) << "," << (t.is_long ? "long" : "short") << ","
+            << (found ? m.price : t.entry_price) << "," << t.exit_price << "," << t.stop << "," << t.risk << ","
+            << (t.mode == ExitMode::TP ? "TP" : t.mode == ExitMode::SL ? "SL" : "Partial") << ","
+            << std::string(ts, stamps.format(t.entry_ms, ts)) << "," << match_status_name(m.status) << ",";
+        if (found)
+            out << m.entry_ms - t.entry_ms;
+        out << ",";
+        for (size_t k = 1; k < m.candidates.size(); ++k)
+            out << (k > 1 ? ";" : "") << m.candidates[k].offset_ms;
+        out << "\n";
+        touched += m.status == EntryMatch::Status::Touched;
+    }
+    std::cout << trades.size() << " trades (" << touched << " touched) against " << (store ? "ticks" : "bars") << ": index "
+        << std::fixed << std::setprecision(3) << index_s << " s, match " << match_s << " s, " << std::setprecision(0)
+        << trades.size() / std::max(match_s, 1e-9) << " trades/s -> " << out_path << std::endl;
+    return 0;
+}
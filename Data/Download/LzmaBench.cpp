@@ -0,0 +1,205 @@
+#include "DukasBuffers.hpp"
+#include "DukasReplay.hpp"
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// Hour decode throughput, heap allocations and peak RSS of the .bi5 path:
+//   fresh   what decompress_lzma did before: a new lzma_stream per file, output and
+//           body vectors grown as data arrives and freed after each hour
+//   pooled  LzmaDecoder per thread and BufferPool buffers, as the downloader runs now
+// Each hour is received in 16 KB pieces (like curl's write callback), inflated and
+// parsed into a TickBatch. With fork() every mode runs in its own process so peak
+// RSS is its own.
+// usage: LzmaBench [hours [threads]]   (2000 synthetic hours of 1k-20k ticks, 4 threads)
+
+static std::atomic<uint64_t> heap_allocs{ 0 };
+static std::atomic<uint64_t> lzma_allocs{ 0 };
+
+void* operator new(size_t n) {
+    heap_allocs.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+static void* lzma_counting_alloc(void*, size_t nmemb, size_t size) {
+    lzma_allocs.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(nmemb * size);
+}
+static void lzma_counting_free(void*, void* p) { std::free(p); }
+static const lzma_allocator counting_allocator = { lzma_counting_alloc, lzma_counting_free, nullptr };
+
+static constexpr size_t piece = 16 * 1024;
+
+static std::vector<std::vector<uint8_t>> synthetic_hours(size_t n, double point, size_t threads) {
+    std::vector<std::vector<uint8_t>> files(n);
+    std::atomic<size_t> next{ 0 };
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < std::max<size_t>(threads, 1); ++w) {
+        workers.emplace_back([&]() {
+            for (size_t h; (h = next.fetch_add(1)) < n;) {
+                std::mt19937_64 rng(h);
+                std::uniform_int_distribution<int> count(1000, 20000);
+                std::uniform_int_distribution<int> step(-2, 2);
+                int64_t hour_ms = 1704067200000LL + static_cast<int64_t>(h) * 3600000;
+                int64_t bid = 107000;
+                TickBatch t;
+                size_t ticks = static_cast<size_t>(count(rng));
+                for (size_t i = 0; i < ticks; ++i) {
+                    bid += step(rng);
+                    t.push_back(hour_ms + static_cast<int64_t>(i * 3600000 / ticks), (bid + 2) / point, bid / point, 1.5f, 0.75f);
+                }
+                files[h] = encode_bi5(t, hour_ms, point);
+            }
+        });
+    }
+    for (auto& t : workers)
+        t.join();
+    return files;
+}
+
+static void receive(const std::vector<uint8_t>& file, std::vector<uint8_t>& body) {
+    for (size_t off = 0; off < file.size(); off += piece) {
+        size_t n = std::min(piece, file.size() - off);
+        body.insert(body.end(), file.data() + off, file.data() + off + n);
+    }
+}
+
+static bool fresh_decompress(const std::vector<uint8_t>& in, std::vector<uint8_t>& out) {
+    lzma_stream strm = LZMA_STREAM_INIT;
+    strm.allocator = &counting_allocator;
+    if (lzma_alone_decoder(&strm, UINT64_MAX) != LZMA_OK)
+        return false;
+    uint8_t chunk[piece];
+    strm.next_in = in.data();
+    strm.avail_in = in.size();
+    lzma_ret ret = LZMA_OK;
+    while (ret == LZMA_OK) {
+        strm.next_out = chunk;
+        strm.avail_out = sizeof(chunk);
+        ret = lzma_code(&strm, LZMA_FINISH);
+        out.insert(out.end(), chunk, chunk + (sizeof(chunk) - strm.avail_out));
+    }
+    lzma_end(&strm);
+    return ret == LZMA_STREAM_END;
+}
+
+struct Result {
+    double seconds = 0;
+    uint64_t ticks = 0;
+    uint64_t heap = 0;
+    uint64_t lzma = 0;
+};
+
+static Result run(const std::vector<std::vector<uint8_t>>& files, size_t threads, bool pooled, double point) {
+    BufferPool compressed_pool(64), decompressed_pool(64, 256 * 1024);
+    std::atomic<size_t> next{ 0 };
+    std::atomic<uint64_t> ticks{ 0 };
+    uint64_t heap0 = heap_allocs.load(), lzma0 = lzma_allocs.load();
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (size_t w = 0; w < threads; ++w) {
+        workers.emplace_back([&]() {
+            LzmaDecoder decoder(&counting_allocator);
+            Bi5Decoder parser(point);
+            TickBatch batch;
+            int64_t hour_ms = 1704067200000LL;
+            for (size_t i; (i = next.fetch_add(1)) < files.size();) {
+                bool ok;
+                if (pooled) {
+                    std::vector<uint8_t> body = compressed_pool.acquire();
+                    receive(files[i], body);
+                    std::vector<uint8_t> raw = decompressed_pool.acquire();
+                    ok = decoder.decode(body, raw);
+                    compressed_pool.release(std::move(body));
+                    batch.clear();
+                    if (ok)
+                        parser.decode(raw, hour_ms + static_cast<int64_t>(i) * 3600000, batch);
+                    decompressed_pool.release(std::move(raw));
+                }
+                else {
+                    std::vector<uint8_t> body, raw;
+                    receive(files[i], body);
+                    ok = fresh_decompress(body, raw);
+                    batch.clear();
+                    if (ok)
+                        parser.decode(raw, hour_ms + static_cast<int64_t>(i) * 3600000, batch);
+                }
+                if (!ok)
+                    throw std::runtime_error("Failed to decompress hour " + std::to_string(i));
+                ticks.fetch_add(batch.size());
+            }
+        });
+    }
+    for (auto& t : workers)
+        t.join();
+    Result r;
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    r.ticks = ticks.load();
+    r.heap = heap_allocs.load() - heap0;
+    r.lzma = lzma_allocs.load() - lzma0;
+    return r;
+}
+
+static double peak_rss_mb() {
+#ifndef _WIN32
+    rusage usage = {};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+#else
+    return 0;
+#endif
+}
+
+static void report(const char* name, const Result& r, size_t hours, double rss) {
+    std::cout << std::left << std::setw(8) << name << std::right << std::fixed << std::setprecision(1)
+        << std::setw(10) << hours / r.seconds << std::setw(10) << r.ticks / r.seconds / 1e6
+        << std::setw(12) << static_cast<double>(r.heap) / hours << std::setw(12) << static_cast<double>(r.lzma) / hours
+        << std::setw(10) << rss << std::endl;
+}
+
+int main(int argc, char** argv) {
+    size_t hours = argc > 1 ? std::stoul(argv[1]) : 2000;
+    size_t threads = argc > 2 ? std::stoul(argv[2]) : 4;
+    const double point = 100000;
+    auto files = synthetic_hours(hours, point, std::thread::hardware_concurrency());
+    size_t packed = 0;
+    for (const auto& f : files)
+        packed += f.size();
+    std::cout << hours << " hours, " << std::setprecision(1) << std::fixed << packed / 1e6 << " MB compressed, "
+        << threads << " threads\n"
+        << std::left << std::setw(8) << "mode" << std::right << std::setw(10) << "hours/s" << std::setw(10) << "Mticks/s"
+        << std::setw(12) << "new/hour" << std::setw(12) << "lzma/hour" << std::setw(10) << "peak MB" << std::endl;
+
+    for (bool pooled : { false, true }) {
+        const char* name = pooled ? "pooled" : "fresh";
+#ifndef _WIN32
+        pid_t pid = fork();
+        if (pid == 0) {
+            double base = peak_rss_mb();
+            Result r = run(files, threads, pooled, point);
+            report(name, r, hours, peak_rss_mb() - base);
+            std::_Exit(0);
+        }
+        int status = 0;
+        waitpid(pid, &status, 0);
+#else
+        report(name, run(files, threads, pooled, point), hours, 0);
+#endif
+    }
+    return 0;
+}
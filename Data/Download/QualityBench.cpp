@@ -0,0 +1,137 @@
+#include "DukasQuality.hpp"
+#include "DukasBuffers.hpp"
+#include "DukasReplay.hpp"
+#include <iostream>
+#include <iomanip>
+#include <random>
+#include <chrono>
+
+// TickFilter throughput against the single-thread LZMA + .bi5 parse rate of the same
+// ticks, and how well it finds the bad ticks planted in a synthetic random walk:
+// spikes of 20-200 points, crossed quotes, zero prices and frozen runs of 40 repeats.
+// usage: QualityBench [ticks]   (4M ticks by default)
+
+struct Planted {
+    TickBatch ticks;
+    std::vector<uint8_t> truth;     // TickFlag bit planted at each tick, 0: clean
+};
+
+static Planted synthetic_ticks(size_t n, double point) {
+    std::mt19937_64 rng(11);
+    std::geometric_distribution<int> gap(0.002);
+    std::uniform_int_distribution<int> step(-2, 2);
+    std::uniform_int_distribution<int> spread(1, 4);
+    std::uniform_int_distribution<int> jump(20, 200);
+    std::uniform_real_distribution<double> u(0, 1);
+    Planted p;
+    int64_t ts = 1704067200000LL;
+    int64_t bid = 107000;
+    for (size_t i = 0; i < n; ++i) {
+        ts += gap(rng);
+        bid += step(rng);
+        int64_t b = bid, a = bid + spread(rng);
+        uint8_t planted = 0;
+        double r = u(rng);
+        if (r < 0.002) {
+            int64_t d = jump(rng) * (u(rng) < 0.5 ? -1 : 1);
+            a += d;
+            b += d;
+            planted = TickSpike;
+        }
+        else if (r < 0.0025) {
+            std::swap(a, b);
+            b += 3;
+            planted = TickCrossed;
+        }
+        else if (r < 0.0027) {
+            b = 0;
+            planted = TickNonPositive;
+        }
+        else if (r < 0.0028) {
+            for (int k = 0; k < 40 && i < n; ++k, ++i) {
+                ts += gap(rng);
+                p.ticks.push_back(ts, a / point, b / point, 1.5f, 0.75f);
+                p.truth.push_back(k >= 20 ? TickStale : 0);
+            }
+            --i;
+            continue;
+        }
+        p.ticks.push_back(ts, a / point, b / point, 1.5f, 0.75f);
+        p.truth.push_back(planted);
+    }
+    return p;
+}
+
+int main(int argc, char** argv) {
+    size_t n = argc > 1 ? std::stoull(argv[1]) : 4000000;
+    const double point = 100000;
+    Planted planted = synthetic_ticks(n, point);
+    std::cout << std::fixed << std::setprecision(2);
+
+    // decode side: the same ticks as hour files of 5000 ticks
+    const size_t per_hour = 5000;
+    std::vector<std::vector<uint8_t>> files;
+    for (size_t off = 0; off < planted.ticks.size(); off += per_hour) {
+        TickBatch hour;
+        size_t end = std::min(off + per_hour, planted.ticks.size());
+        int64_t hour_ms = planted.ticks.ts_ms[off];
+        for (size_t i = off; i < end; ++i)
+            hour.push_back(planted.ticks.ts_ms[i], std::max(planted.ticks.ask[i], 0.0), std::max(planted.ticks.bid[i], 0.0), 1.5f, 0.75f);
+        files.push_back(encode_bi5(hour, hour_ms, point, 1));
+    }
+    LzmaDecoder inflater;
+    Bi5Decoder parser(point);
+    std::vector<uint8_t> raw;
+    TickBatch decoded;
+    auto t0 = std::chrono::steady_clock::now();
+    for (const auto& f : files) {
+        decoded.clear();
+        if (inflater.decode(f, raw))
+            parser.decode(raw, 0, decoded);
+    }
+    double decode_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    std::cout << "lzma + parse (1 thread): " << planted.ticks.size() / decode_s / 1e6 << " Mticks/s\n";
+
+    for (auto action : { TickFilter::Action::Flag, TickFilter::Action::Drop, TickFilter::Action::Repair }) {
+        TickFilter::Config config;
+        config.action = action;
+        config.point = point;
+        config.stale_repeats = 20;
+        TickFilter filter(config);
+        TickBatch batch;
+        size_t hits = 0, planted_spikes = 0, false_flags = 0, clean = 0;
+        double seconds = 0;
+        for (size_t off = 0; off < planted.ticks.size(); off += per_hour) {
+            size_t end = std::min(off + per_hour, planted.ticks.size());
+            batch.clear();
+            for (size_t i = off; i < end; ++i)
+                batch.push_back(planted.ticks.ts_ms[i], planted.ticks.ask[i], planted.ticks.bid[i], 1.5f, 0.75f);
+            auto s0 = std::chrono::steady_clock::now();
+            filter.apply(batch);
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - s0).count();
+            if (action != TickFilter::Action::Flag)
+                continue;
+            for (size_t i = off; i < end; ++i) {
+                uint8_t f = filter.flags()[i - off];
+                if (planted.truth[i] == TickSpike) {
+                    ++planted_spikes;
+                    hits += (f & TickSpike) != 0;
+                }
+                else if (planted.truth[i] == 0) {
+                    ++clean;
+                    false_flags += f != 0;
+                }
+            }
+        }
+        filter.end_hour();
+        const auto& c = filter.total();
+        const char* name = action == TickFilter::Action::Flag ? "flag  " : action == TickFilter::Action::Drop ? "drop  " : "repair";
+        std::cout << "filter " << name << ": " << planted.ticks.size() / seconds / 1e6 << " Mticks/s, flagged " << c.flagged
+            << " (spikes " << c.spikes << ", crossed " << c.crossed << ", non-positive " << c.nonpositive
+            << ", wide " << c.wide_spread << ", stale " << c.stale << "), dropped " << c.dropped << ", repaired " << c.repaired << "\n";
+        if (action == TickFilter::Action::Flag)
+            std::cout << "  spike recall " << 100.0 * hits / std::max<size_t>(planted_spikes, 1) << "%, false flags on clean ticks "
+                << 100.0 * false_flags / std::max<size_t>(clean, 1) << "%\n";
+    }
+    return 0;
+}
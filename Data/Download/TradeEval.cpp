@@ -0,0 +1,63 @@
+#include "DukasTrades.hpp"
+#include "DukasCsv.hpp"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <chrono>
+
+// Returns, drawdowns and exit times of a trade journal, evaluated on a tick store
+// (the downloader's set_tick_store_dir output, e.g. ./store/EURUSD_ticks):
+//   TradeEval STORE TRADES.csv [OUT.csv [THREADS [MA_WINDOW [MIN_WAIT_S [HORIZON_H]]]]]
+// TRADES.csv: entry_time,type,entry_price,exit_price,sl,risk,exit_mode (see read_trades_csv).
+// OUT.csv gets one row per trade in journal order, with UPI and Calmar as
+// (return - risk) / ulcer and (return - risk) / |mdd|.
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " STORE TRADES.csv [OUT.csv [THREADS [MA_WINDOW [MIN_WAIT_S [HORIZON_H]]]]]" << std::endl;
+        return 2;
+    }
+    std::string out_path = argc > 3 ? argv[3] : "trade_outcomes.csv";
+    size_t threads = argc > 4 ? std::stoul(argv[4]) : 0;
+    ExitRule rule;
+    if (argc > 5)
+        rule.ma_window = std::stoul(argv[5]);
+    if (argc > 6)
+        rule.min_wait_ms = static_cast<int64_t>(std::stod(argv[6]) * 1000);
+    if (argc > 7)
+        rule.horizon_ms = static_cast<int64_t>(std::stod(argv[7]) * 3600000);
+
+    TradeEvaluator evaluator(argv[1]);
+    std::vector<Trade> trades = read_trades_csv(argv[2]);
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<TradeOutcome> outcomes = evaluator.evaluate_all(trades, rule, threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    std::ofstream out(out_path, std::ios::trunc);
+    if (!out.is_open())
+        throw std::runtime_error("Cannot open output file: " + out_path);
+    out << "entry_time,type,exit_mode,status,exit_time,exit_price,return,mdd,ulcer,upi,calmar,ticks\n" << std::setprecision(10);
+    CsvTimestamp stamps;
+    char ts[24];
+    size_t ok = 0, ticks = 0;
+    for (size_t i = 0; i < trades.size(); ++i) {
+        const Trade& t = trades[i];
+        const TradeOutcome& o = outcomes[i];
+        out << std::string(ts, stamps.format(t.entry_ms, ts)) << "," << (t.is_long ? "long" : "short") << ","
+            << (t.mode == ExitMode::TP ? "TP" : t.mode == ExitMode::SL ? "SL" : "Partial") << "," << status_name(o.status);
+        if (o.status == TradeOutcome::Status::Ok) {
+            double excess = o.ret - t.risk;
+            out << "," << std::string(ts, stamps.format(o.exit_ms, ts)) << "," << o.exit_price << "," << o.ret << "," << o.mdd_pct
+                << "," << o.ulcer_pct << "," << (o.ulcer_pct != 0 ? excess / o.ulcer_pct : 0) << ","
+                << (o.mdd_pct != 0 ? excess / std::fabs(o.mdd_pct) : 0) << "," << o.ticks;
+            ++ok;
+        }
+        else
+            out << ",,,,,,,,";
+        out << "\n";
+        ticks += o.ticks;
+    }
+    std::cout << trades.size() << " trades (" << ok << " closed) in " << std::fixed << std::setprecision(3) << seconds << " s, "
+        << std::setprecision(0) << trades.size() / seconds << " trades/s, " << std::setprecision(1) << ticks / seconds / 1e6
+        << " Mticks/s to exit -> " << out_path << std::endl;
+    return 0;
+}
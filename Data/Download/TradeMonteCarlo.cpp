@@ -0,0 +1,54 @@
+#include "DukasMonteCarlo.hpp"
+#include <iostream>
+#include <iomanip>
+#include <chrono>
+
+// Distributions of a journal's final return, max drawdown and risk of ruin, and
+// equity bands, over resampled trade sequences:
+//   TradeMonteCarlo RETURNS.csv [OUT_PREFIX [iid|block|permutation [RESAMPLES [BLOCK [THREADS [SEED [additive|compound [RUIN_PCT]]]]]]]]
+// RETURNS.csv: TradeEval's output (its "return" column, trades not closed skipped) or
+// one return per line. Writes OUT_PREFIX_summary.csv, OUT_PREFIX_bands.csv and
+// OUT_PREFIX.bin (see write_monte_carlo_binary); the same seed gives the same
+// output whatever the thread count.
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: " << argv[0] << " RETURNS.csv [OUT_PREFIX [iid|block|permutation [RESAMPLES [BLOCK [THREADS [SEED"
+                     " [additive|compound [RUIN_PCT]]]]]]]]" << std::endl;
+        return 2;
+    }
+    std::string prefix = argc > 2 ? argv[2] : "monte_carlo";
+    MonteCarlo::Config config;
+    if (argc > 3)
+        config.method = MonteCarlo::parse_method(argv[3]);
+    if (argc > 4)
+        config.resamples = std::stoull(argv[4]);
+    if (argc > 5)
+        config.block = std::stoul(argv[5]);
+    size_t threads = argc > 6 ? std::stoul(argv[6]) : 0;
+    if (argc > 7)
+        config.seed = std::stoull(argv[7]);
+    std::string growth = argc > 8 ? argv[8] : "additive";
+    if (growth != "additive" && growth != "compound")
+        throw std::invalid_argument("Invalid equity growth: " + growth);
+    config.compound = growth == "compound";
+    if (argc > 9)
+        config.ruin_pct = std::stod(argv[9]);
+
+    MonteCarlo mc(read_returns_csv(argv[1]), config);
+    auto t0 = std::chrono::steady_clock::now();
+    MonteCarlo::Result r = mc.run(threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    write_monte_carlo_csv(r, prefix);
+    write_monte_carlo_binary(r, prefix + ".bin");
+
+    auto median = [&](const MonteCarlo::Distribution& d) {
+        auto it = std::find(r.quantiles.begin(), r.quantiles.end(), 0.5);
+        return it != r.quantiles.end() ? d.q[it - r.quantiles.begin()] : d.mean;
+    };
+    std::cout << r.trades << " trades, " << r.resamples << " paths of " << r.length << " in " << std::fixed << std::setprecision(3)
+        << seconds << " s (" << std::setprecision(1) << r.resamples * r.length / std::max(seconds, 1e-9) / 1e6
+        << " M trades/s): final return median " << std::setprecision(2) << median(r.final_return) << "%, max drawdown median "
+        << median(r.max_drawdown) << "%, ruin " << std::setprecision(4) << r.ruin_probability * 100 << "% -> " << prefix
+        << "_summary.csv" << std::endl;
+    return 0;
+}
@@ -0,0 +1,71 @@
+#include "DukasSweep.hpp"
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+
+// Partial exit rules of a trade journal swept over a grid, on a tick store:
+//   TradeSweep STORE TRADES.csv MA_WINDOWS WAIT_FACTORS MIN_WAITS_S [OUT.csv [RANK [THREADS [HORIZON_H]]]]
+// The three lists are comma separated (e.g. 5,10,20 0,0.2,0.5 0,60,300); every
+// combination is a grid point. OUT.csv gets one row per grid point, best first by
+// RANK: "return" (total return, the default) or "drawdown" (worst trade drawdown).
+static std::vector<std::string> split_list(const std::string& s) {
+    std::vector<std::string> out;
+    std::stringstream ss(s);
+    std::string item;
+    while (std::getline(ss, item, ','))
+        if (!item.empty())
+            out.push_back(item);
+    if (out.empty())
+        throw std::invalid_argument("Invalid sweep list: " + s);
+    return out;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 6) {
+        std::cerr << "usage: " << argv[0] << " STORE TRADES.csv MA_WINDOWS WAIT_FACTORS MIN_WAITS_S [OUT.csv [RANK [THREADS [HORIZON_H]]]]" << std::endl;
+        return 2;
+    }
+    SweepGrid grid;
+    grid.ma_windows.clear();
+    grid.wait_factors.clear();
+    grid.min_wait_ms.clear();
+    for (const auto& s : split_list(argv[3]))
+        grid.ma_windows.push_back(std::stoul(s));
+    for (const auto& s : split_list(argv[4]))
+        grid.wait_factors.push_back(std::stod(s));
+    for (const auto& s : split_list(argv[5]))
+        grid.min_wait_ms.push_back(static_cast<int64_t>(std::stod(s) * 1000));
+    std::string out_path = argc > 6 ? argv[6] : "exit_sweep.csv";
+    SweepRank rank = argc > 7 ? parse_sweep_rank(argv[7]) : SweepRank::Return;
+    size_t threads = argc > 8 ? std::stoul(argv[8]) : 0;
+    if (argc > 9)
+        grid.horizon_ms = static_cast<int64_t>(std::stod(argv[9]) * 3600000);
+
+    TradeEvaluator evaluator(argv[1]);
+    std::vector<Trade> trades = read_trades_csv(argv[2]);
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<SweepRow> rows = sweep_exit_rules(evaluator, trades, grid, threads);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    rank_sweep(rows, rank);
+
+    std::ofstream out(out_path, std::ios::trunc);
+    if (!out.is_open())
+        throw std::runtime_error("Cannot open output file: " + out_path);
+    out << "rank,ma_window,wait_factor,min_wait_s,closed,missing,win_rate,total_return,mean_return,worst_mdd,mean_mdd,mean_ulcer\n"
+        << std::setprecision(10);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const SweepRow& r = rows[i];
+        out << i + 1 << "," << r.rule.ma_window << "," << r.rule.wait_factor << "," << r.rule.min_wait_ms / 1000.0 << ","
+            << r.closed << "," << r.missing << "," << r.win_rate() << "," << r.total_ret << "," << r.mean_ret() << ","
+            << r.worst_mdd_pct << "," << r.mean_mdd_pct() << "," << r.mean_ulcer_pct() << "\n";
+    }
+    const SweepRow& best = rows.front();
+    std::cout << trades.size() << " trades x " << grid.size() << " rules in " << std::fixed << std::setprecision(3) << seconds
+        << " s (" << std::setprecision(0) << trades.size() * grid.size() / seconds << " trade-rules/s), best: ma_window "
+        << best.rule.ma_window << ", wait_factor " << std::setprecision(2) << best.rule.wait_factor << ", min_wait "
+        << std::setprecision(0) << best.rule.min_wait_ms / 1000.0 << " s -> total return " << std::setprecision(2) << best.total_ret
+        << ", worst mdd " << best.worst_mdd_pct << "% -> " << out_path << std::endl;
+    return 0;
+}